@@ -0,0 +1,21 @@
+# Build options shared by all Makefiles, included after CFLAGS and LIBS are set
+
+# Reproducible floating point (use "REPRODUCIBLE=1"):
+# - no contraction of a * b + c into fused multiply-add, so builds for CPUs with and
+#   without FMA give the same bits. Default x86-64 builds have no FMA, so it matters where
+#   compiler may fuse (ARM64, POWER, x86-64 with -march supporting FMA); costs FMA speedup there
+# - compensated sums of diagnostics (see diagnostics.h), about 4x flops of O(N) pass
+#   made every diagnostics interval, nothing per step
+# Engine results don't depend on workers number either way (every parallel sum has fixed order)
+ifdef REPRODUCIBLE
+CFLAGS += -ffp-contract=off -D"REPRODUCIBLE_SUMS=1"
+endif
+
+# Trajectory compression (use "TRAJECTORY_ZLIB=0" to build without zlib)
+ifndef TRAJECTORY_ZLIB
+TRAJECTORY_ZLIB = 1
+endif
+CFLAGS += -D"TRAJECTORY_ZLIB=$(TRAJECTORY_ZLIB)"
+ifeq ($(TRAJECTORY_ZLIB), 1)
+LIBS += -lz
+endif
@@ -211,6 +211,68 @@ namespace phys_templates {
     }
     
     
+    // Softened 1/r^3 by squared distance, for scalar type T (float or double).
+    // Finite for coinciding bodies and written with selects only (vectorizable).
+    template <class T>
+    inline T NewtonInvDist3(const T& dist2)
+    {
+        T dist = sqrt(dist2);
+        return (dist2 > T(0)) ? T(1) / (dist2 * dist) : T(0);
+    }
+
+    template <class T>
+    inline T PlummerInvDist3(const T& dist2, const T& eps)
+    {
+        T soft2 = dist2 + eps * eps;
+        T soft = sqrt(soft2);
+        return (soft2 > T(0)) ? T(1) / (soft2 * soft) : T(0);
+    }
+
+    // Cubic spline kernel (Hernquist & Katz, 1989) of radius h = 2.8 * eps
+    template <class T>
+    inline T SplineInvDist3(const T& dist2, const T& eps)
+    {
+        T dist = sqrt(dist2);
+        T h = T(2.8) * eps;
+        T h_inv = (h > T(0)) ? T(1) / h : T(0);
+        T h_inv3 = h_inv * h_inv * h_inv;
+        T u = (h > T(0)) ? dist * h_inv : T(2); // No softening: always outside kernel
+        T u2 = u * u;
+        T u3 = u2 * u;
+        T inner = h_inv3 * (T(10.666666666667) + u2 * (T(32) * u - T(38.4)));
+        T outer = h_inv3 * (T(21.333333333333) - T(48) * u + T(38.4) * u2 - T(10.666666666667) * u3 - T(0.066666666667) / u3);
+        return (u < T(0.5)) ? inner : ((u < T(1)) ? outer : NewtonInvDist3(dist2));
+    }
+
+    // Softened 1/r of the same kernels: potential of mass M is -CONST_G * M * InvDist
+    template <class T>
+    inline T NewtonInvDist(const T& dist2)
+    {
+        T dist = sqrt(dist2);
+        return (dist2 > T(0)) ? T(1) / dist : T(0);
+    }
+
+    template <class T>
+    inline T PlummerInvDist(const T& dist2, const T& eps)
+    {
+        T soft2 = dist2 + eps * eps;
+        return (soft2 > T(0)) ? T(1) / sqrt(soft2) : T(0);
+    }
+
+    template <class T>
+    inline T SplineInvDist(const T& dist2, const T& eps)
+    {
+        T dist = sqrt(dist2);
+        T h = T(2.8) * eps;
+        T h_inv = (h > T(0)) ? T(1) / h : T(0);
+        T u = (h > T(0)) ? dist * h_inv : T(2);
+        T u2 = u * u;
+        T inner = h_inv * (T(2.8) - u2 * (T(5.333333333333) + u2 * (T(6.4) * u - T(9.6))));
+        T outer = h_inv * (T(3.2) - T(0.066666666667) / u - u2 * (T(10.666666666667) + u * (T(-16) + u * (T(9.6) - T(2.133333333333) * u))));
+        return (u < T(0.5)) ? inner : ((u < T(1)) ? outer : NewtonInvDist(dist2));
+    }
+
+
     // Movement with constant acceleration
     template <class T>
     void moveOneStep(Position<T>& pos, Velocity<T>& vel, const Acceleration<T>& acc, const T& time)
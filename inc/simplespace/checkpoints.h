@@ -0,0 +1,78 @@
+//
+//  checkpoints.h
+//  simple-space
+//
+
+#ifndef __simple_space__checkpoints__
+#define __simple_space__checkpoints__
+
+#include <string>
+#include <vector>
+#include <deque>
+
+#include "scene_file.h"
+
+struct CheckpointConfig {
+    CheckpointConfig()
+    : interval_steps(0),
+      retention(3),
+      prefix("checkpoint") {}
+
+    unsigned long interval_steps; // 0 - off
+    unsigned int retention;       // Newest files kept, older ones are deleted
+    std::string prefix;           // Files are <prefix>_<step>.ssc
+};
+
+struct CheckpointStats {
+    CheckpointStats() : started(0), written(0), failed(0), skipped(0) {}
+
+    unsigned long started;
+    unsigned long written;
+    unsigned long failed;
+    unsigned long skipped;  // Due while previous one was still being written
+    std::string last_path;  // Of last written checkpoint
+};
+
+// Periodic scene files (with engine state) written in background. On POSIX systems
+// scene is serialized into memory image, then process forks and child writes the image
+// with plain system calls, so simulation pauses for one copy of scene and fork() only.
+// Elsewhere files are written in place.
+// Not thread-safe: called by simulation with scene locked.
+class Checkpointer
+{
+    struct Writer {
+        long pid;
+        std::string path;
+    };
+
+    CheckpointConfig _config;
+    CheckpointStats _stats;
+    std::vector<Writer> _writers;  // Running children
+    std::deque<std::string> _kept; // Written files, oldest first
+    std::vector<unsigned char> _image; // Of file being written, kept for capacity
+
+    void finish(const std::string& path, bool ok);
+
+    Checkpointer(const Checkpointer&);            // Not copyable
+    Checkpointer& operator=(const Checkpointer&);
+
+public:
+    Checkpointer() {}
+    ~Checkpointer(); // Waits for running writers
+
+    void configure(const CheckpointConfig& config);
+    const CheckpointConfig& config() const {return _config;}
+    const CheckpointStats& stats() const {return _stats;}
+
+    bool is_due(unsigned long steps_count) const {
+        return (_config.interval_steps > 0) && (steps_count % _config.interval_steps == 0);
+    }
+
+    // Starts writing checkpoint of given step; arguments are captured as they are now
+    void start(unsigned long steps_count, const std::vector<Planet>& planets, const ParticleBelt& belt,
+               const SceneEngineState& engine);
+    void poll(); // Collects finished writers, doesn't block
+    void wait(); // Blocks until all writers finish
+};
+
+#endif /* defined(__simple_space__checkpoints__) */
@@ -0,0 +1,63 @@
+//
+//  command_queue.h
+//  simple-space
+//
+
+#ifndef __simple_space__command_queue__
+#define __simple_space__command_queue__
+
+#include <atomic>
+
+#include "planet.h"
+
+// Scene edits posted by UI (or any other thread) and applied by simulation at step boundaries
+enum SpaceCommandType {
+    CMD_ADD_PLANET,
+    CMD_REMOVE_PLANET,
+    CMD_REMOVE_ALL,
+    CMD_MODIFY_PLANET
+};
+
+struct SpaceCommand {
+    SpaceCommand(SpaceCommandType Type = CMD_REMOVE_ALL,
+                 unsigned int Id = 0,
+                 const Planet& Pl = Planet())
+    : type(Type),
+      id(Id),
+      planet(Pl) {}
+
+    SpaceCommandType type;
+    unsigned int id;  // Target planet for remove/modify (id of new planet for add)
+    Planet planet;    // Payload for add/modify
+};
+
+// Multiple producers / single consumer lock-free queue (intrusive list with stub node)
+// push() may be called from any thread and never blocks;
+// pop() must be called only from one (simulation) thread at a time.
+class CommandQueue
+{
+    struct Node {
+        Node() : next(NULL) {}
+        Node(const SpaceCommand& Cmd) : next(NULL), cmd(Cmd) {}
+
+        std::atomic<Node*> next;
+        SpaceCommand cmd;
+    };
+
+    std::atomic<Node*> _head; // Last pushed node (producers side)
+    Node* _tail;              // Last consumed node (consumer side)
+    Node _stub;
+
+    CommandQueue(const CommandQueue&);            // Not copyable
+    CommandQueue& operator=(const CommandQueue&);
+
+public:
+    CommandQueue();
+    ~CommandQueue();
+
+    void push(const SpaceCommand& cmd);
+    bool pop(SpaceCommand& cmd);
+    bool empty() const;
+};
+
+#endif /* defined(__simple_space__command_queue__) */
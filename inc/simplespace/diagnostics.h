@@ -0,0 +1,62 @@
+//
+//  diagnostics.h
+//  simple-space
+//
+
+#ifndef __simple_space__diagnostics__
+#define __simple_space__diagnostics__
+
+#include <stddef.h> // size_t
+#include <math.h>   // fabs
+#include <vector>
+
+#include "planet.h"
+#include "WorkerPool.h"
+
+#define DIAGNOSTICS_CHUNK 4096 // Bodies per task of parallel sums (fixed, so sums don't depend on workers number)
+#ifndef REPRODUCIBLE_SUMS
+#define REPRODUCIBLE_SUMS 0    // Compensated sums, added by pairwise tree over chunks: 1-on ("make REPRODUCIBLE=1"); 0-off
+#endif
+
+// Conserved quantities of bodies (belt particles are massless and not included), measured
+// by state at step beginning. Potential comes from gravity pass of the step itself, so
+// measuring costs O(N) on top of it. Total energy is conserved only without borders and
+// external fields, minus what collisions take (and what sleeping bodies lose when stopped).
+struct SpaceDiagnostics {
+    SpaceDiagnostics()
+    : valid(false),
+      step(0),
+      bodies(0),
+      kinetic_j(0),
+      potential_j(0),
+      potential_valid(false),
+      angular_momentum(0),
+      collision_loss_j(0),
+      initial_j(0) {}
+
+    bool valid;               // Measured at least once
+    unsigned long step;       // Steps made before measured state
+    size_t bodies;
+    double kinetic_j;
+    double potential_j;       // Pairs of massive bodies, plus test particles in their field
+    bool potential_valid;     // False for solvers without potential (particle-mesh)
+    Vector2d momentum;        // kg*m/s
+    double angular_momentum;  // About origin, kg*m^2/s
+    double collision_loss_j;  // Kinetic energy taken by collisions since diagnostics were switched on
+    double initial_j;         // Total energy plus collision loss at first measurement
+
+    double total_j() const {return kinetic_j + potential_j;}
+    // Of total energy with collision losses added back, relative to initial one
+    double drift() const {return (initial_j != 0) ? (total_j() + collision_loss_j - initial_j) / fabs(initial_j) : 0;}
+};
+
+// Parallel sums over planets: chunks are summed by tasks, chunk sums are added in their order
+// (with REPRODUCIBLE_SUMS: compensated, so totals are accurate to last bits of double for
+// any bodies number, at about 4x flops of this O(N) pass).
+// Kinetic energy, momentum and angular momentum:
+void measure_motion(WorkerPool& pool, const std::vector<Planet>& planets, SpaceDiagnostics& diagnostics);
+// Potential energy by potential of every planet (J/kg): pairs of massive bodies are in
+// potential of both, so they are halved; test particles are in field of massive ones only
+double measure_potential_energy(WorkerPool& pool, const std::vector<Planet>& planets, const double* potential);
+
+#endif /* defined(__simple_space__diagnostics__) */
@@ -0,0 +1,159 @@
+//
+//  gravity.h
+//  simple-space
+//
+
+#ifndef __simple_space__gravity__
+#define __simple_space__gravity__
+
+#include <stddef.h> // size_t
+#include <vector>
+
+#include "physics.h"
+#include "scratch_arena.h"
+#include "WorkerPool.h"
+using Physics::Vector2d;
+
+enum GravitySolverType {
+    GRAVITY_SOLVER_REFERENCE, // One-sided direct sum fused with movement (every pair visited twice)
+    GRAVITY_SOLVER_SYMMETRIC, // Direct sum visiting every pair once (Newton's third law)
+    GRAVITY_SOLVER_TILED,     // One-sided direct sum blocked for L1/L2 caches (exact forces for validation runs)
+    GRAVITY_SOLVER_PM         // Particle-mesh (FFT) for big dense scenes
+};
+
+enum GravityPrecision {
+    GRAVITY_PRECISION_DOUBLE, // Double everywhere
+    GRAVITY_PRECISION_MIXED   // Float pair terms (twice SIMD width, half memory traffic), double sums
+};
+
+struct CollisionPair {
+    CollisionPair(size_t A = 0, size_t B = 0) : a(static_cast<unsigned int>(A)), b(static_cast<unsigned int>(B)) {}
+
+    bool operator<(const CollisionPair& rhs) const {
+        return (a < rhs.a) || ((a == rhs.a) && (b < rhs.b));
+    }
+
+    unsigned int a; // Planets indexes, a < b
+    unsigned int b;
+};
+
+// Bodies state gathered by engine into flat arrays (positions at step beginning).
+// Massive bodies go first: [0, massive_count) are gravity sources, the rest are
+// test particles, which feel gravity of massive bodies but exert none.
+// Sleeping bodies may go first of all: [0, sleeping_count) are sources only, their
+// accelerations are not needed, so pairs of them are not evaluated at all.
+struct GravityBodies {
+    GravityBodies()
+    : count(0),
+      massive_count(0),
+      sleeping_count(0),
+      x(NULL),
+      y(NULL),
+      mass(NULL),
+      rad(NULL),
+      soft(NULL),
+      softening(Physics::SOFTENING_NONE),
+      precision(GRAVITY_PRECISION_DOUBLE) {}
+
+    size_t count;
+    size_t massive_count;
+    size_t sleeping_count;            // Solvers may still add (partial) accelerations to them
+    const double* x;
+    const double* y;
+    const double* mass;
+    const double* rad;
+    const double* soft;               // Softening length of every body; pair uses bigger one
+    Physics::SofteningType softening;
+    GravityPrecision precision;       // Scalar type of pair terms (solvers may support only double)
+};
+
+// Common interface of solvers used by SimpleSpace::move_one_step()
+class GravitySolver
+{
+public:
+    virtual ~GravitySolver() {}
+
+    // Adds gravity accelerations of all bodies to acc[].
+    // Solvers evaluating pairwise distances also collect collision candidates: pairs with
+    // distance < rad_sum + skin_dist, in ascending (a, b) order. Returns true if they did
+    // (pairs of test particles are never evaluated, so not with test particles).
+    // Pairs of sleeping bodies are not candidates either (they are not collided).
+    bool compute(const GravityBodies& bodies,
+                 Vector2d* acc,
+                 double skin_dist,
+                 ScratchBuffer<CollisionPair>& candidates) {
+        return compute(bodies, acc, NULL, skin_dist, candidates);
+    }
+
+    // Same, also adding gravitational potential (J/kg, by massive bodies) of every body
+    // to potential[] in the same pass, if it's not NULL and solver computes it.
+    // Accelerations are the same bits either way.
+    virtual bool compute(const GravityBodies& bodies,
+                         Vector2d* acc,
+                         double* potential,
+                         double skin_dist,
+                         ScratchBuffer<CollisionPair>& candidates) = 0;
+};
+
+// Symmetric direct sum: each unordered pair is evaluated once and applied to both bodies.
+// Bodies are split into tiles; tile pairs are scheduled in rounds (round-robin tournament),
+// so within a round no tile is used twice and workers never write the same accelerations.
+// Every acceleration gets its contributions in fixed order, independently of workers number.
+// Kernels are templated on scalar type: double or float with double accumulators.
+// Test particles are not in tiles: separate stream kernel evaluates them against massive
+// bodies in chunks, so cost is O(N_massive^2 + N_massive * N_test) instead of O(N^2).
+class SymmetricGravitySolver : public GravitySolver
+{
+    WorkerPool& _pool;
+    ScratchArena _scratch;                                             // Float copies of bodies
+    std::vector<ScratchArena*> _worker_scratch;                        // Per worker memory
+    std::vector<ScratchBuffer<CollisionPair> > _worker_candidates;     // Collected by every worker
+
+    struct Job;
+    template <class T, Physics::SofteningType S, bool Potential>
+    static void tile_pair_task(void* arg, unsigned int task_idx, unsigned int worker_idx);
+    template <class T, Physics::SofteningType S, bool Potential>
+    static void test_particles_task(void* arg, unsigned int task_idx, unsigned int worker_idx);
+    template <class T, bool Potential>
+    static void select_tasks(Physics::SofteningType softening, wTaskFunc& tile_pair, wTaskFunc& test_particles);
+
+public:
+    SymmetricGravitySolver(WorkerPool& pool);
+    virtual ~SymmetricGravitySolver();
+
+    using GravitySolver::compute;
+    virtual bool compute(const GravityBodies& bodies,
+                         Vector2d* acc,
+                         double* potential,
+                         double skin_dist,
+                         ScratchBuffer<CollisionPair>& candidates);
+};
+
+// One-sided direct sum, blocked for caches: every task takes block of targets, whose
+// positions and sums stay in L2, and sweeps it by blocks of sources fitting L1 (next
+// sources block is prefetched meanwhile). So every source is loaded from memory once per
+// targets block rather than once per target. Double precision only; every target sums
+// sources in their order, so results don't depend on workers number.
+class TiledGravitySolver : public GravitySolver
+{
+    WorkerPool& _pool;
+    std::vector<ScratchArena*> _worker_scratch;                        // Per worker memory
+    std::vector<ScratchBuffer<CollisionPair> > _worker_candidates;     // Collected by every worker
+
+    struct Job;
+    template <Physics::SofteningType S, bool Potential>
+    static void targets_block_task(void* arg, unsigned int task_idx, unsigned int worker_idx);
+
+public:
+    TiledGravitySolver(WorkerPool& pool);
+    virtual ~TiledGravitySolver();
+
+    using GravitySolver::compute;
+    virtual bool compute(const GravityBodies& bodies,
+                         Vector2d* acc,
+                         double* potential,
+                         double skin_dist,
+                         ScratchBuffer<CollisionPair>& candidates);
+};
+
+#endif /* defined(__simple_space__gravity__) */
@@ -0,0 +1,160 @@
+//
+//  input_journal.h
+//  simple-space
+//
+
+#ifndef __simple_space__input_journal__
+#define __simple_space__input_journal__
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+#include <stdio.h>  // FILE
+#include <string>
+#include <vector>
+
+#include "planet.h"
+#include "particle_belt.h"
+#include "scene_generator.h"
+#include "scene_file.h"
+
+// Journal of inputs: engine is deterministic (same binary, any workers number), so
+// session is reproduced by replaying its scene changes at the same steps, starting
+// from scene it began with. Scenes (the initial one and loaded ones) are copied to
+// <journal>.<n>.ssc files; everything else is a few bytes per event.
+//
+// File: JournalFileHeader, then events: varint step difference from previous event,
+// byte type and type specific payload. Every event is flushed to file right away,
+// so journal of crashed session is complete up to the crash.
+#define JOURNAL_FILE_MAGIC     "SSJOURN"
+#define JOURNAL_FILE_VERSION   2   // 1: state hash without engine's per-body state and belt velocities
+#define JOURNAL_CHECK_INTERVAL 256 // Steps between state hashes, replay stops at first mismatch
+
+struct JournalFileHeader {
+    char magic[8];          // JOURNAL_FILE_MAGIC
+    uint32_t version;
+    uint32_t workers_num;   // Of recording session, for information (results don't depend on it)
+    double time_step_ms;
+    uint32_t check_interval;
+    uint32_t reserved;
+};
+
+enum JournalEventType {
+    // Scene changes
+    JOURNAL_ADD_PLANET,          // id, planet
+    JOURNAL_REMOVE_PLANET,       // id
+    JOURNAL_MODIFY_PLANET,       // planet
+    JOURNAL_REMOVE_ALL,
+    JOURNAL_ADD_SCENE,           // scene, id (first one)
+    JOURNAL_ADD_SCENE_PARTICLES, // scene
+    JOURNAL_ADD_BELT_PARTICLES,  // pos, vel
+    JOURNAL_REMOVE_BELT,
+    JOURNAL_SETTINGS,            // settings (config, solver, softening, precision)
+    JOURNAL_LOAD_SCENE,          // value: number of scene copy, state is restored from it
+    // Verification
+    JOURNAL_CHECK,               // value: state hash after step
+    JOURNAL_END,                 // Last step of session
+    // Front end (engine doesn't depend on them)
+    JOURNAL_MODEL_SPEED,         // value: steps per frame
+    JOURNAL_PAUSE,
+    JOURNAL_RESUME,
+    JOURNAL_SINGLE_STEP,
+    // Undo history (scene changes, appended to keep codes of older journals)
+    JOURNAL_SAVE_UNDO_POINT,
+    JOURNAL_UNDO,                // Of state saved by journaled event, others are restored by JOURNAL_LOAD_SCENE
+    JOURNAL_REDO
+};
+
+struct JournalEvent {
+    uint64_t step; // Steps made before event
+    JournalEventType type;
+    unsigned int id;
+    int64_t value;
+    Planet planet;
+    SceneParams scene;
+    SceneEngineState settings;
+    std::vector<Vector2d> pos;
+    std::vector<Vector2d> vel;
+};
+
+enum JournalStatus {
+    JOURNAL_OK,
+    JOURNAL_IO_ERROR,         // Can't open or write journal or scene copy
+    JOURNAL_BAD_FORMAT,       // Not a journal or corrupted
+    JOURNAL_DIVERGED          // State hash differs from recorded one
+};
+
+const char* journal_status_str(JournalStatus status);
+
+struct JournalReplayStats {
+    unsigned long events;   // Applied, front end ones included
+    unsigned long checks;   // State hashes matched
+    uint64_t diverged_step; // Step of mismatched hash (JOURNAL_DIVERGED)
+};
+
+// Hash of every field of bodies and belt particles the next step depends on (colors
+// aren't hashed); journals of older version are checked with hash of their version
+uint64_t journal_state_hash(const std::vector<Planet>& planets, const ParticleBelt& belt,
+                            uint32_t version = JOURNAL_FILE_VERSION);
+
+// Called by simulation with scene locked
+class JournalWriter
+{
+    FILE* _file;
+    std::string _path;
+    unsigned int _scenes_num; // Scene copies made
+    uint64_t _last_step;
+    std::vector<unsigned char> _event;
+
+    void begin(uint64_t step, JournalEventType type);
+    bool write(); // Of _event
+
+    JournalWriter(const JournalWriter&);            // Not copyable
+    JournalWriter& operator=(const JournalWriter&);
+
+public:
+    JournalWriter() : _file(NULL), _scenes_num(0), _last_step(0) {}
+    ~JournalWriter();
+
+    // Initial scene is copied as scene #0
+    JournalStatus start(const char* path, unsigned int workers_num, double time_step_ms, uint64_t step,
+                        const std::vector<Planet>& planets, const ParticleBelt& belt, const SceneEngineState& engine);
+    void stop(uint64_t step); // Writes JOURNAL_END
+    bool is_recording() const {return _file != NULL;}
+
+    void add_planet(uint64_t step, unsigned int id, const Planet& pl);
+    void remove_planet(uint64_t step, unsigned int id);
+    void modify_planet(uint64_t step, const Planet& pl);
+    void add_scene(uint64_t step, const SceneParams& params, unsigned int first_id);
+    void add_scene_particles(uint64_t step, const SceneParams& params);
+    void add_belt_particles(uint64_t step, const std::vector<Vector2d>& pos, const std::vector<Vector2d>& vel);
+    void settings(uint64_t step, const SceneEngineState& engine);
+    JournalStatus load_scene(uint64_t step, const std::vector<Planet>& planets, const ParticleBelt& belt,
+                             const SceneEngineState& engine);
+    void check(uint64_t step, uint64_t state_hash);
+    void simple(uint64_t step, JournalEventType type, int64_t value = 0); // Events without payload besides value
+
+    static std::string scene_copy_path(const std::string& path, unsigned int number);
+};
+
+class JournalReader
+{
+    JournalFileHeader _header;
+    uint64_t _last_step;
+    std::vector<unsigned char> _data; // Whole journal (small)
+    size_t _pos;
+
+    JournalReader(const JournalReader&);            // Not copyable
+    JournalReader& operator=(const JournalReader&);
+
+public:
+    JournalReader() : _last_step(0), _pos(0) {}
+    ~JournalReader() {}
+
+    JournalStatus open(const char* path);
+    const JournalFileHeader& header() const {return _header;}
+
+    // False at the end; truncated last event (crash while writing) is ignored
+    bool next_event(JournalEvent& event);
+};
+
+#endif /* defined(__simple_space__input_journal__) */
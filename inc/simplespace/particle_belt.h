@@ -0,0 +1,63 @@
+//
+//  particle_belt.h
+//  simple-space
+//
+
+#ifndef __simple_space__particle_belt__
+#define __simple_space__particle_belt__
+
+#include <stddef.h> // size_t
+#include <vector>
+
+#include "physics.h"
+#include "WorkerPool.h"
+using Physics::Vector2d;
+
+#define BELT_CHUNK_SIZE  4096 // Particles per task of belt kernel
+
+// Massive bodies moving belt particles (positions at step beginning)
+struct BeltSources {
+    size_t count;
+    const double* x;
+    const double* y;
+    const double* gm;    // G * mass
+    const double* soft2; // Squared softening length
+};
+
+// Lightweight particles for debris and asteroid belts: position and velocity only
+// (no id, color or radius). They are kept in own contiguous arrays (SoA) and advanced
+// by SIMD kernel (see simd_pack.h, two particles per instruction) in parallel chunks.
+// Particles feel gravity of massive bodies only: they neither attract nor collide
+// with anything (borders included), so cost is O(N_particles * N_sources) per step.
+class ParticleBelt
+{
+    std::vector<double> _x;
+    std::vector<double> _y;
+    std::vector<double> _vx;
+    std::vector<double> _vy;
+
+    struct Job;
+    static void advance_task(void* arg, unsigned int task_idx, unsigned int worker_idx);
+
+public:
+    void add(const Vector2d& pos, const Vector2d& vel);
+    void reserve(size_t count);
+    void resize(size_t count); // New particles are zeroed, to be filled in place
+    void clear();
+    size_t size() const {return _x.size();}
+
+    const double* x() const {return _x.data();}
+    const double* y() const {return _y.data();}
+    const double* vx() const {return _vx.data();}
+    const double* vy() const {return _vy.data();}
+    double* x() {return _x.data();}
+    double* y() {return _y.data();}
+    double* vx() {return _vx.data();}
+    double* vy() {return _vy.data();}
+
+    // Moves all particles by one step (constant acceleration over it, like planets).
+    // Every particle sums sources in their order, so results don't depend on workers number.
+    void advance(WorkerPool& pool, const BeltSources& sources, double time_step_s);
+};
+
+#endif /* defined(__simple_space__particle_belt__) */
@@ -11,6 +11,7 @@
 
 #include <iostream>
 #include <math.h>
+#include "phys_templates.h"
 using std::pair;
 using std::string;
 
@@ -58,11 +59,54 @@ namespace Physics {
     pair<double, double> DistAngleFromPos(const double& x0, const double& y0, const double& x1, const double& y1);
     pair<double, double> DistAngleFromPos(const Vector2d& pos0, const Vector2d& pos1);
 
-    // Gravity acceleration, m/s^2
+    // Gravity acceleration, m/s^2 (throws DevByZero for zero distance)
     double GravAcc(const double& massKg, const double& distM);
     // Gravity force, N
     double GravForce(const double& mass1Kg, const double& mass2Kg, const double& distM);
 
+    // Softening of gravity at small distances
+    enum SofteningType {
+        SOFTENING_NONE,     // Pure Newtonian 1/r^2
+        SOFTENING_PLUMMER,  // 1/(r^2 + eps^2), eps - softening length
+        SOFTENING_SPLINE    // Cubic spline kernel of radius 2.8 * eps, exactly Newtonian beyond it
+    };
+
+    // Softened 1/r^3 by squared distance and softening length (eps):
+    // acceleration produced by mass M at offset (dx, dy) is CONST_G * M * InvDist3 * (dx, dy).
+    // Finite (zero) for coinciding bodies. Written with selects instead of branches, so
+    // loops using them are vectorized by compiler (see phys_templates.h).
+    inline double NewtonInvDist3(const double& dist2) {return phys_templates::NewtonInvDist3(dist2);}
+    inline double PlummerInvDist3(const double& dist2, const double& eps) {return phys_templates::PlummerInvDist3(dist2, eps);}
+    inline double SplineInvDist3(const double& dist2, const double& eps) {return phys_templates::SplineInvDist3(dist2, eps);}
+
+    // Same for any scalar type T (float kernels)
+    template <class T>
+    inline T SoftenedInvDist3(const T& dist2, const T& eps, SofteningType type)
+    {
+        switch (type) {
+            case SOFTENING_PLUMMER: return phys_templates::PlummerInvDist3(dist2, eps);
+            case SOFTENING_SPLINE:  return phys_templates::SplineInvDist3(dist2, eps);
+            default:                return phys_templates::NewtonInvDist3(dist2);
+        }
+    }
+
+    // Softened 1/r of the same kernels: potential of mass M is -CONST_G * M * InvDist
+    template <class T>
+    inline T SoftenedInvDist(const T& dist2, const T& eps, SofteningType type)
+    {
+        switch (type) {
+            case SOFTENING_PLUMMER: return phys_templates::PlummerInvDist(dist2, eps);
+            case SOFTENING_SPLINE:  return phys_templates::SplineInvDist(dist2, eps);
+            default:                return phys_templates::NewtonInvDist(dist2);
+        }
+    }
+
+    // Softened gravity acceleration, m/s^2 (never throws)
+    inline double SoftenedGravAcc(const double& massKg, const double& distM, const double& epsM, SofteningType type)
+    {
+        return double(CONST_G) * massKg * distM * SoftenedInvDist3(distM * distM, epsM, type);
+    }
+
     // Movement with constant acceleration
     void MoveWithConstAcc(Vector2d& pos,
                           Vector2d& vel,
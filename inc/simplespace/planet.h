@@ -56,14 +56,19 @@ struct Planet {
            double Mass_Kg = 0,
            double Rad_M = 0,
            Color_RGB Color = Color_RGB(),
-           unsigned int Id = 0)
+           unsigned int Id = 0,
+           double Softening_M = 0)
     : id(Id),
       pos(Pos),
       prev_pos(Pos),
       vel(Vel),
       mass_kg(Mass_Kg),
       rad_m(Rad_M),
-      color(Color) {}
+      softening_m(Softening_M),
+      color(Color),
+      test_particle(false),
+      sleeping(false),
+      rest_steps(0) {}
 
     unsigned int id;
     Vector2d pos;
@@ -71,7 +76,19 @@ struct Planet {
     Vector2d vel;
     double mass_kg;
     double rad_m;
+    double softening_m; // Own gravity softening length, used if bigger than global one
     Color_RGB color;
+    bool test_particle; // Feels gravity of massive bodies, but exerts none (for light bodies)
+
+    // Deactivation of bodies at rest (managed by engine)
+    bool sleeping;
+    unsigned int rest_steps; // Steps in a row body was at rest
+    Vector2d rest_acc;       // Acceleration of previous step (awake) or when fell asleep
+
+    void wake_up() {
+        sleeping = false;
+        rest_steps = 0;
+    }
 
 void reset_parameters() {
         pos = Vector2d();
@@ -79,7 +96,10 @@ void reset_parameters() {
         vel = Vector2d();
         mass_kg = 0;
         rad_m = 0;
+        softening_m = 0;
         color = Color_RGB(1.0f, 1.0f, 1.0f);
+        test_particle = false;
+        wake_up();
     }
 };
 
@@ -0,0 +1,74 @@
+//
+//  pm_gravity.h
+//  simple-space
+//
+
+#ifndef __simple_space__pm_gravity__
+#define __simple_space__pm_gravity__
+
+#include <stddef.h> // size_t
+#include <vector>
+#include <complex>
+
+#include "gravity.h"
+#include "WorkerPool.h"
+
+#define PM_GRID_SIZE       256 // Mesh nodes per side (power of 2)
+#define PM_DEPOSIT_CHUNKS  8   // Bodies chunks deposited into separate grids (fixed, so sums don't depend on workers number)
+
+// Particle-mesh solver for big dense scenes, O(N + M^2 log M) per step:
+// - masses of massive bodies are deposited onto mesh over the domain by cloud-in-cell (CIC) weights;
+// - field is convolution of density with Green's function of point mass (1/r^2 force),
+//   made by FFT on mesh zero padded to twice the size (isolated, not periodic, boundaries);
+// - accelerations are interpolated back to all bodies (test particles too) with the same CIC weights.
+// Force is softened on mesh cell scale, bodies outside domain neither attract nor get attracted.
+// Collision candidates are not collected (engine finds contacts by sweep and prune, O(N log N)),
+// potential is not computed.
+class PMGravitySolver : public GravitySolver
+{
+    typedef std::complex<double> Complex;
+
+    WorkerPool& _pool;
+    const size_t _grid_size;  // N
+    const size_t _fft_size;   // 2N
+
+    // Mesh geometry: node (i, j) is at (_left + i * _cell, _bottom + j * _cell)
+    double _left;
+    double _bottom;
+    double _cell;
+    double _kernel_cell; // Cell size of current kernel transform (0 - not made yet)
+
+    std::vector<double> _chunk_density;    // PM_DEPOSIT_CHUNKS grids of N x N masses
+    std::vector<Complex> _mesh;            // 2N x 2N: density, then field (ax + i * ay)
+    std::vector<Complex> _kernel;          // Transform of Green's function (Kx + i * Ky), normalized
+    std::vector<Complex> _twiddles;        // exp(-2 * Pi * i * k / 2N)
+    std::vector<size_t> _bit_reverse;
+    std::vector<Complex> _columns;         // Column buffer of every worker
+
+    struct Job;
+    static void deposit_task(void* arg, unsigned int task_idx, unsigned int worker_idx);
+    static void reduce_task(void* arg, unsigned int task_idx, unsigned int worker_idx);
+    static void fft_rows_task(void* arg, unsigned int task_idx, unsigned int worker_idx);
+    static void fft_columns_task(void* arg, unsigned int task_idx, unsigned int worker_idx);
+    static void multiply_task(void* arg, unsigned int task_idx, unsigned int worker_idx);
+    static void interpolate_task(void* arg, unsigned int task_idx, unsigned int worker_idx);
+
+    void fft_1d(Complex* data, bool inverse) const;
+    void fft_2d(Job& job, bool inverse, size_t rows_used);
+    void prepare_kernel();
+
+public:
+    PMGravitySolver(WorkerPool& pool, size_t grid_size = PM_GRID_SIZE);
+
+    // Square mesh covering the box (longer side defines cell size)
+    void set_domain(double left, double bottom, double right, double top);
+
+    using GravitySolver::compute;
+    virtual bool compute(const GravityBodies& bodies,
+                         Vector2d* acc,
+                         double* potential,
+                         double skin_dist,
+                         ScratchBuffer<CollisionPair>& candidates);
+};
+
+#endif /* defined(__simple_space__pm_gravity__) */
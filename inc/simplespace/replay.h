@@ -0,0 +1,87 @@
+//
+//  replay.h
+//  simple-space
+//
+
+#ifndef __simple_space__replay__
+#define __simple_space__replay__
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+#include <vector>
+#include <memory>   // std::shared_ptr
+#include <atomic>
+
+#include "trajectory.h"
+
+extern "C"
+{
+    #include "osWrappers.h"
+}
+
+#define REPLAY_PREFETCH_BLOCKS 3           // Blocks decoded ahead of playhead (one behind it is kept too)
+#define REPLAY_CACHE_BYTES     (256 << 20) // Decoded frames kept, blocks farthest from playhead go first
+
+// Decoded block of trajectory file
+struct ReplayBlock {
+    size_t index;
+    size_t bytes; // Of decoded frames
+    std::vector<TrajectoryFrame> frames;
+};
+
+struct ReplayStats {
+    unsigned long hits;       // Frames found decoded
+    unsigned long misses;     // Blocks decoded by caller
+    unsigned long prefetched; // Blocks decoded in background
+};
+
+// Plays trajectory file at any step. Seek is an index lookup; frames come from cache
+// of decoded blocks, which own thread fills ahead of playhead, so caller decodes
+// (at most one block) only when it jumps far away.
+class TrajectoryPlayer
+{
+    TrajectoryReader _reader;          // Of caller, on cache miss
+    TrajectoryReader _prefetch_reader; // Of prefetch thread
+
+    wMutex _cache_mutex;
+    std::vector<std::shared_ptr<const ReplayBlock> > _cache;
+    size_t _cache_bytes;
+
+    std::atomic<size_t> _playhead_block;
+    wThread _prefetcher;
+    wEvent _wake;
+    std::atomic<bool> _stopping;
+    bool _open;
+
+    std::atomic<unsigned long> _hits;
+    std::atomic<unsigned long> _misses;
+    std::atomic<unsigned long> _prefetched;
+
+    std::shared_ptr<const ReplayBlock> find_cached(size_t block);
+    bool insert(const std::shared_ptr<const ReplayBlock>& block); // False if evicted right away
+    static std::shared_ptr<const ReplayBlock> decode(TrajectoryReader& reader, size_t block);
+    static int prefetch_loop(void* arg);
+
+    TrajectoryPlayer(const TrajectoryPlayer&);            // Not copyable
+    TrajectoryPlayer& operator=(const TrajectoryPlayer&);
+
+public:
+    TrajectoryPlayer();
+    ~TrajectoryPlayer(); // Closes
+
+    bool open(const char* path); // False if not trajectory file
+    void close();
+    bool is_open() const {return _open;}
+
+    uint64_t first_step() const {return _reader.first_step();}
+    uint64_t last_step() const {return _reader.last_step();}
+    uint64_t frames_count() const {return _reader.frames_count();}
+
+    // Latest frame at or before step (first one if step is before it), NULL if there
+    // are no frames. Frame is valid while holder is kept. Called by one thread.
+    const TrajectoryFrame* frame_at(uint64_t step, std::shared_ptr<const ReplayBlock>& holder);
+
+    ReplayStats stats() const;
+};
+
+#endif /* defined(__simple_space__replay__) */
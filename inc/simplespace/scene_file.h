@@ -0,0 +1,171 @@
+//
+//  scene_file.h
+//  simple-space
+//
+
+#ifndef __simple_space__scene_file__
+#define __simple_space__scene_file__
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t, uint64_t
+#include <vector>
+
+#include "planet.h"
+#include "particle_belt.h"
+#include "WorkerPool.h"
+
+extern "C"
+{
+    #include "osWrappers.h"
+}
+
+// Files are little-endian and mapped as is, so only little-endian hosts may read them
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+    #error "Scene files need little-endian host"
+#endif
+
+// Binary scene file:
+//   SceneFileHeader, SceneFileColumn[columns_num], then column data.
+// Every column is a plain array (SoA) of one field, starting at 64 bytes aligned offset,
+// so it can be used right from the mapped file. Columns have own checksums, header
+// has one for itself and columns table. Readers skip unknown column types, so new
+// columns may be added without version change; version grows on incompatible changes.
+#define SCENE_FILE_MAGIC     "SSSCENE"
+#define SCENE_FILE_VERSION   1
+#define SCENE_FILE_ALIGNMENT 64
+
+enum SceneColumnType {
+    SCENE_COL_ID,        // uint32_t
+    SCENE_COL_POS_X,     // double
+    SCENE_COL_POS_Y,
+    SCENE_COL_VEL_X,
+    SCENE_COL_VEL_Y,
+    SCENE_COL_MASS,
+    SCENE_COL_RAD,
+    SCENE_COL_SOFTENING,
+    SCENE_COL_COLOR,     // float[3]: R, G, B
+    SCENE_COL_FLAGS,     // uint8_t: SCENE_FLAG_*
+    SCENE_COL_BELT_X,    // double, belt particles
+    SCENE_COL_BELT_Y,
+    SCENE_COL_BELT_VX,
+    SCENE_COL_BELT_VY,
+    // Optional: engine state for exact resume (checkpoints), defaults if absent
+    SCENE_COL_PREV_POS_X, // double
+    SCENE_COL_PREV_POS_Y,
+    SCENE_COL_REST_ACC_X,
+    SCENE_COL_REST_ACC_Y,
+    SCENE_COL_REST_STEPS, // uint32_t
+    SCENE_COL_ENGINE,     // SceneEngineState, 0 or 1 element
+    SCENE_COLUMNS_NUM
+};
+
+#define SCENE_FLAG_TEST_PARTICLE 0x01
+#define SCENE_FLAG_SLEEPING      0x02
+
+// Engine settings and counters needed to continue simulation bit-exactly
+struct SceneEngineState {
+    uint64_t steps_count;
+    uint64_t reorders_count;
+    double time_step_ms;
+    double collision_skin;
+    double softening_length_m;
+    double coef_res;
+    double border_friction;
+    double left_border;
+    double right_border;
+    double top_border;
+    double bottom_border;
+    double global_top_mass;
+    double global_right_mass;
+    double sleep_velocity;
+    double sleep_acc_change;
+    uint32_t sleep_steps;
+    uint32_t steps_since_locality_check;
+    uint32_t next_planet_id;
+    uint8_t gravity_enabled;
+    uint8_t borders_enabled;
+    uint8_t sleep_enabled;
+    uint8_t collision_mode;    // CollisionMode
+    uint8_t gravity_solver;    // GravitySolverType
+    uint8_t gravity_precision; // GravityPrecision
+    uint8_t softening_type;    // Physics::SofteningType
+    uint8_t reserved[5];
+};
+
+struct SceneFileHeader {
+    char magic[8];            // SCENE_FILE_MAGIC
+    uint32_t version;
+    uint32_t columns_num;
+    uint64_t planets_count;
+    uint64_t belt_count;
+    uint64_t file_size;
+    uint64_t header_checksum; // Of header (with this field zeroed) and columns table
+};
+
+struct SceneFileColumn {
+    uint32_t type;      // SceneColumnType
+    uint32_t elem_size; // Bytes per element
+    uint64_t offset;    // From file beginning
+    uint64_t count;
+    uint64_t checksum;  // Of data bytes
+};
+
+enum SceneFileStatus {
+    SCENE_FILE_OK,
+    SCENE_FILE_IO_ERROR,     // Can't open, map or write
+    SCENE_FILE_BAD_FORMAT,   // Not a scene file, truncated or inconsistent
+    SCENE_FILE_BAD_VERSION,  // Written by newer version
+    SCENE_FILE_BAD_CHECKSUM  // Corrupted
+};
+
+const char* scene_file_status_str(SceneFileStatus status);
+
+// 64-bit checksum of bytes (word-wise, several GB/s)
+uint64_t scene_checksum(const void* data, size_t size);
+
+// Writes planets and belt particles, and engine state if given. File is written next
+// to path and renamed at the end, so existing file is replaced only by complete one.
+SceneFileStatus write_scene_file(const char* path, const std::vector<Planet>& planets, const ParticleBelt& belt,
+                                 const SceneEngineState* engine = NULL);
+// Same file as memory image (reuses its capacity), for writers that may neither
+// allocate nor use stdio, like forked child of multithreaded process
+void make_scene_file_image(const std::vector<Planet>& planets, const ParticleBelt& belt, const SceneEngineState* engine,
+                           std::vector<unsigned char>& image);
+
+// Read-only view of mapped scene file. Nothing is parsed per body: open() validates
+// header and columns table (and checksums, in parallel by column if pool is given),
+// then columns are read straight from mapping.
+class SceneFile
+{
+    wMappedFile _map;
+    const SceneFileHeader* _header;
+    const SceneFileColumn* _columns[SCENE_COLUMNS_NUM]; // NULL if absent
+
+    struct Job;
+    static void verify_task(void* arg, unsigned int task_idx, unsigned int worker_idx);
+    static void read_planets_task(void* arg, unsigned int task_idx, unsigned int worker_idx);
+
+    SceneFile(const SceneFile&);            // Not copyable
+    SceneFile& operator=(const SceneFile&);
+
+public:
+    SceneFile();
+    ~SceneFile();
+
+    SceneFileStatus open(const char* path, WorkerPool* pool = NULL, bool verify_checksums = true);
+    void close();
+
+    size_t planets_count() const {return _header ? static_cast<size_t>(_header->planets_count) : 0;}
+    size_t belt_count() const {return _header ? static_cast<size_t>(_header->belt_count) : 0;}
+
+    // Column data in mapping, NULL if there's no such column. Valid until close()
+    const void* column(SceneColumnType type) const;
+    const SceneEngineState* engine_state() const; // NULL if not saved
+
+    // Planets storage is AoS, so bodies are gathered from columns (in parallel chunks)
+    void read_planets(WorkerPool& pool, Planet* out) const;
+    // Replaces belt particles with ones from file
+    void read_belt(ParticleBelt& belt) const;
+};
+
+#endif /* defined(__simple_space__scene_file__) */
@@ -0,0 +1,89 @@
+//
+//  scene_generator.h
+//  simple-space
+//
+
+#ifndef __simple_space__scene_generator__
+#define __simple_space__scene_generator__
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+
+#include "planet.h"
+#include "particle_belt.h"
+#include "WorkerPool.h"
+
+#define SCENE_CHUNK_SIZE  8192 // Bodies per generator task
+
+enum SceneKind {
+    SCENE_DISK,         // Rotating disk around central mass (uniform surface density)
+    SCENE_PLUMMER,      // Self-gravitating cluster, projected Plummer profile, isotropic velocities
+    SCENE_BELT,         // Thin ring of circular orbits around central mass
+    SCENE_RANDOM_FIELD  // Uniform in box, random velocities
+};
+
+struct SceneParams {
+    SceneParams()
+    : kind(SCENE_DISK),
+      count(1000),
+      seed(1),
+      central_mass_kg(1e30),
+      inner_rad_m(1e7),
+      outer_rad_m(4e7),
+      scale_rad_m(1e7),
+      left(-8e7),
+      right(8e7),
+      bottom(-5e7),
+      top(5e7),
+      max_speed(1e6),
+      body_mass_kg(1e20),
+      body_rad_m(1e5),
+      test_particles(false) {}
+
+    SceneKind kind;
+    size_t count;
+    uint64_t seed;
+
+    Vector2d center;        // Disk, Plummer, belt
+    Vector2d center_vel;
+    double central_mass_kg; // Disk and belt orbit it (it's not generated); total mass of Plummer cluster
+    double inner_rad_m;     // Disk and belt
+    double outer_rad_m;
+    double scale_rad_m;     // Plummer
+    double left;            // Random field box
+    double right;
+    double bottom;
+    double top;
+    double max_speed;       // Random field
+
+    double body_mass_kg;    // Every body (Plummer ones get central_mass_kg / count)
+    double body_rad_m;
+    bool test_particles;
+};
+
+// Counter-based random numbers: every value is a hash of (seed, stream, counter), so
+// streams (one per body) are independent and give the same numbers on any thread.
+class SceneRandom
+{
+    uint64_t _key;
+    uint64_t _counter;
+
+public:
+    SceneRandom(uint64_t seed, uint64_t stream);
+
+    uint64_t next_u64();
+    double uniform();  // [0, 1)
+    double gaussian(); // Standard normal
+};
+
+// Body idx of scene: pure function of params and idx
+Planet generate_scene_body(const SceneParams& params, size_t idx);
+
+// Writes params.count bodies into out[] in parallel, ids are first_id, first_id + 1...
+// Output doesn't depend on workers number.
+void generate_scene(WorkerPool& pool, const SceneParams& params, Planet* out, unsigned int first_id);
+
+// Same scene as belt particles (positions and velocities only), appended to belt
+void generate_scene(WorkerPool& pool, const SceneParams& params, ParticleBelt& belt);
+
+#endif /* defined(__simple_space__scene_generator__) */
@@ -0,0 +1,102 @@
+//
+//  scratch_arena.h
+//  simple-space
+//
+
+#ifndef __simple_space__scratch_arena__
+#define __simple_space__scratch_arena__
+
+#include <stddef.h> // size_t
+#include <string.h> // memcpy()
+#include <vector>
+
+// Monotonic allocator for temporary per-step buffers.
+// Memory is only released as a whole by reset(). If one step needed more than one
+// block, reset() merges them into a single block of summary size, so after a few
+// steps all allocations are served from one block without touching the heap.
+class ScratchArena
+{
+    struct Block {
+        Block(char* Data = NULL, size_t Size = 0, bool Mapped = false)
+        : data(Data), size(Size), mapped(Mapped) {}
+
+        char* data;
+        size_t size;
+        bool mapped; // Allocated by mmap() (huge pages) rather than malloc()
+    };
+
+    std::vector<Block> _blocks;
+    size_t _current;   // Block being filled
+    size_t _offset;    // Fill offset inside current block
+    size_t _used;      // Bytes handed out since last reset
+    size_t _peak_used;
+    bool _use_huge_pages;
+
+    Block allocate_block(size_t size);
+    void free_block(const Block& block);
+
+    ScratchArena(const ScratchArena&);            // Not copyable
+    ScratchArena& operator=(const ScratchArena&);
+
+public:
+    ScratchArena(size_t initial_size = 1 << 20, bool use_huge_pages = false);
+    ~ScratchArena();
+
+    void* allocate(size_t bytes, size_t alignment = 64);
+
+    // Uninitialized storage for count objects of trivial type T
+    template <class T>
+    T* allocate_array(size_t count) {
+        return static_cast<T*>(allocate(count * sizeof(T), (alignof(T) > 64) ? alignof(T) : 64));
+    }
+
+    void reset();
+
+    size_t get_capacity() const;
+    size_t get_used() const {return _used;}
+    size_t get_peak_used() const {return _peak_used;}
+};
+
+// Growable array of trivial type T living in ScratchArena (valid until arena reset)
+template <class T>
+class ScratchBuffer
+{
+    ScratchArena* _arena;
+    T* _data;
+    size_t _size;
+    size_t _capacity;
+
+public:
+    ScratchBuffer() : _arena(NULL), _data(NULL), _size(0), _capacity(0) {}
+    ScratchBuffer(ScratchArena& arena, size_t initial_capacity) {
+        init(arena, initial_capacity);
+    }
+
+    // (Re)binds buffer to arena, previous content is dropped
+    void init(ScratchArena& arena, size_t initial_capacity) {
+        _arena = &arena;
+        _capacity = (initial_capacity > 0) ? initial_capacity : 1;
+        _data = arena.allocate_array<T>(_capacity);
+        _size = 0;
+    }
+
+    void push_back(const T& value) {
+        if (_size == _capacity) {
+            // Old storage is just abandoned till arena reset
+            T* data = _arena->allocate_array<T>(_capacity * 2);
+            memcpy(data, _data, _size * sizeof(T));
+            _data = data;
+            _capacity *= 2;
+        }
+        _data[_size++] = value;
+    }
+
+    T& operator[](size_t i) {return _data[i];}
+    const T& operator[](size_t i) const {return _data[i];}
+    T* data() {return _data;}
+    const T* data() const {return _data;}
+    size_t size() const {return _size;}
+    void clear() {_size = 0;}
+};
+
+#endif /* defined(__simple_space__scratch_arena__) */
@@ -0,0 +1,85 @@
+//
+//  simd_pack.h
+//  simple-space
+//
+
+#ifndef __simple_space__simd_pack__
+#define __simple_space__simd_pack__
+
+#include <stddef.h> // size_t
+#include <math.h>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#elif defined(__aarch64__)
+    #include <arm_neon.h>
+#endif
+
+// Packs of doubles processed by one instruction. Kernels are written once against
+// this interface and instantiated for Double2 (SSE2 / NEON) and Double1 (tails,
+// other platforms). Operations are IEEE ones of the same order for every width,
+// so all of them give the same bits.
+struct Double1 {
+    static const size_t width = 1;
+    double v;
+
+    Double1(double V) : v(V) {}
+    static Double1 load(const double* p) {return Double1(*p);}
+    void store(double* p) const {*p = v;}
+};
+inline Double1 operator+(Double1 a, Double1 b) {return a.v + b.v;}
+inline Double1 operator-(Double1 a, Double1 b) {return a.v - b.v;}
+inline Double1 operator*(Double1 a, Double1 b) {return a.v * b.v;}
+inline Double1 sqrt(Double1 a) {return ::sqrt(a.v);}
+inline Double1 max(Double1 a, Double1 b) {return (a.v > b.v) ? a.v : b.v;}
+// a / b for positive b, 0 otherwise (coinciding bodies without softening)
+inline Double1 div_positive(Double1 a, Double1 b) {return (b.v > 0) ? a.v / b.v : 0.0;}
+// Bit per lane: a < b
+inline unsigned int less_mask(Double1 a, Double1 b) {return (a.v < b.v) ? 1 : 0;}
+
+#if defined(__SSE2__)
+struct Double2 {
+    static const size_t width = 2;
+    __m128d v;
+
+    Double2(__m128d V) : v(V) {}
+    Double2(double a) : v(_mm_set1_pd(a)) {}
+    static Double2 load(const double* p) {return _mm_loadu_pd(p);}
+    void store(double* p) const {_mm_storeu_pd(p, v);}
+};
+inline Double2 operator+(Double2 a, Double2 b) {return _mm_add_pd(a.v, b.v);}
+inline Double2 operator-(Double2 a, Double2 b) {return _mm_sub_pd(a.v, b.v);}
+inline Double2 operator*(Double2 a, Double2 b) {return _mm_mul_pd(a.v, b.v);}
+inline Double2 sqrt(Double2 a) {return _mm_sqrt_pd(a.v);}
+inline Double2 max(Double2 a, Double2 b) {return _mm_max_pd(a.v, b.v);}
+inline Double2 div_positive(Double2 a, Double2 b) {
+    return _mm_and_pd(_mm_div_pd(a.v, b.v), _mm_cmpgt_pd(b.v, _mm_setzero_pd()));
+}
+inline unsigned int less_mask(Double2 a, Double2 b) {return static_cast<unsigned int>(_mm_movemask_pd(_mm_cmplt_pd(a.v, b.v)));}
+#elif defined(__aarch64__)
+struct Double2 {
+    static const size_t width = 2;
+    float64x2_t v;
+
+    Double2(float64x2_t V) : v(V) {}
+    Double2(double a) : v(vdupq_n_f64(a)) {}
+    static Double2 load(const double* p) {return vld1q_f64(p);}
+    void store(double* p) const {vst1q_f64(p, v);}
+};
+inline Double2 operator+(Double2 a, Double2 b) {return vaddq_f64(a.v, b.v);}
+inline Double2 operator-(Double2 a, Double2 b) {return vsubq_f64(a.v, b.v);}
+inline Double2 operator*(Double2 a, Double2 b) {return vmulq_f64(a.v, b.v);}
+inline Double2 sqrt(Double2 a) {return vsqrtq_f64(a.v);}
+inline Double2 max(Double2 a, Double2 b) {return vmaxq_f64(a.v, b.v);}
+inline Double2 div_positive(Double2 a, Double2 b) {
+    return vbslq_f64(vcgtq_f64(b.v, vdupq_n_f64(0)), vdivq_f64(a.v, b.v), vdupq_n_f64(0));
+}
+inline unsigned int less_mask(Double2 a, Double2 b) {
+    uint64x2_t less = vcltq_f64(a.v, b.v);
+    return static_cast<unsigned int>((vgetq_lane_u64(less, 0) & 1) | ((vgetq_lane_u64(less, 1) & 1) << 1));
+}
+#else
+typedef Double1 Double2; // No SIMD: scalar code
+#endif
+
+#endif /* defined(__simple_space__simd_pack__) */
@@ -11,6 +11,10 @@
 
 #include <iostream>
 #include <vector>
+#include <atomic>
+#include <memory> // std::shared_ptr
+#include <limits.h> // ULONG_MAX
+#include <algorithm> // std::min
 //#include <stdlib.h> // For rand()
 using std::cout;   // temp
 using std::endl;   // temp
@@ -34,52 +38,354 @@ extern "C"
 #include "mouse_and_keyboard.h"
 #include "planet.h"
 #include "physics.h"
+#include "command_queue.h"
+#include "scratch_arena.h"
+#include "gravity.h"
+#include "pm_gravity.h"
+#include "particle_belt.h"
+#include "scene_generator.h"
+#include "scene_file.h"
+#include "checkpoints.h"
+#include "trajectory.h"
+#include "input_journal.h"
+#include "undo_history.h"
+#include "diagnostics.h"
+#include "WorkerPool.h"
 using Physics::Vector2d;
 
-#define GRAVITY_ENABLED  1    // Gravity: 1-on; 0-off
-#define COEF_RES         0.7  // Coefficient of restitution [0..1] = [absolutely inelastic .. absolute elastic]
+enum CollisionMode {
+    COLLISION_MODE_BOUNCE, // Bodies bounce with coefficient of restitution
+    COLLISION_MODE_MERGE   // Perfectly inelastic: bodies merge into one (accretion)
+};
+
+// Engine settings, selected at startup. Features switched off here are compiled out
+// of the step kernels: move_one_step() runs specialization made for SpacePolicy below.
+struct SpaceConfig {
+    SpaceConfig()
+    : gravity_enabled(true),
+      collision_mode(COLLISION_MODE_BOUNCE),
+      coef_res(0.7),
+      borders_enabled(true),
+      border_friction(0.7),
+      left_border(-8e7),
+      right_border(8e7),
+      top_border(5e7),
+      bottom_border(-5e7),
+      global_top_mass(0),
+      global_right_mass(0),
+      sleep_enabled(false),
+      sleep_velocity(1e4),
+      sleep_acc_change(0.05),
+      sleep_steps(60) {}
+
+    bool gravity_enabled;
+    CollisionMode collision_mode;
+    double coef_res;        // Coefficient of restitution [0..1] = [absolutely inelastic .. absolute elastic]
+
+    bool borders_enabled;
+    double border_friction; // Friction of borders: 0..1
+    double left_border;
+    double right_border;
+    double top_border;
+    double bottom_border;
+
+    // External fields: masses attracting to top and right borders (put 1e32 for both to
+    // reproduce planets getting to the corner)
+    double global_top_mass;
+    double global_right_mass;
+
+    // Bodies at rest against borders are put to sleep: not integrated and not collided with
+    // each other. At rest means for sleep_steps in a row: touching border, speed below
+    // sleep_velocity (plus what one step of acceleration gives) and acceleration changed
+    // by less than sleep_acc_change (relative). Bodies wake on contact or on force change
+    // (checked every SLEEP_FORCE_CHECK_INTERVAL steps, pairs of sleeping bodies cost nothing
+    // in between).
+    bool sleep_enabled;
+    double sleep_velocity;   // m/s
+    double sleep_acc_change;
+    unsigned int sleep_steps;
+
+    bool external_fields_enabled() const {return (global_top_mass != 0) || (global_right_mass != 0);}
+};
+
+// Compile-time features of step kernels
+template <bool Gravity, bool Borders, bool ExternalFields, bool Sleeping>
+struct SpacePolicy {
+    static const bool gravity = Gravity;
+    static const bool borders = Borders;
+    static const bool external_fields = ExternalFields;
+    static const bool sleeping = Sleeping; // Only together with borders
+};
+
+#define GRAVITY_SOFTENING         Physics::SOFTENING_NONE // Default softening: NONE, PLUMMER or SPLINE
+#define GRAVITY_SOFTENING_LENGTH  0                       // Default global softening length, m
+
+#define FUSED_TILE_SIZE  64 // Planets per tile of fused gravity/movement sweep (tile pair fits L1)
+
+#define COLLISIONS_PARALLEL_MIN_BATCH  64 // Smaller batches of independent contacts are resolved by one thread
 
-#define BORDERS_ENABLED  1    // Borders: 1-on; 0-off
-#define BORDER_FRICTION  0.7  // Friction of borders: 0..1
-#define LEFT_BORDER     -8e7
-#define RIGHT_BORDER     8e7
-#define TOP_BORDER       5e7
-#define BOTTOM_BORDER   -5e7
+#define SLEEP_FORCE_CHECK_INTERVAL 8 // Steps between force checks of sleeping bodies (sources only in between)
 
-#define GLOBAL_TOP_MASS    0 //1e30 // put 1e32 for both to reprocuce crash whenplnets get to the corner
-#define GLOBAL_RIGHT_MASS  0 //1e29    // temp, for physics check
+#define LOCALITY_CHECK_INTERVAL   64    // Steps between checks of bodies storage order
+#define MORTON_REORDER_MIN_BODIES 1024  // Smaller scenes fit caches in any order
+#define MORTON_REORDER_THRESHOLD  0.2   // Share of neighbours out of Morton order that triggers reordering
+
+#define LOADED_PLANET_ID_MAX  (1u << 26) // Ids in scene files are rejected from here on (id lookup map has entry per id)
+
+#define SCRATCH_ARENA_SIZE        (1 << 20) // Initial size of per-step temporary memory, bytes
+#define SCRATCH_ARENA_HUGE_PAGES  0         // Back per-step temporary memory by huge pages: 1-on; 0-off
+
+// Read-only copy of planets, published by simulation after every change.
+// Readers keep it alive by holding shared_ptr, so they never wait for running step.
+struct PlanetsSnapshot {
+    PlanetsSnapshot() : belt_count(0), belt_version(0), version(0) {}
+
+    std::vector<Planet> planets;
+    // Belt particles positions for rendering: x0, y0, x1, y1... (NULL if there are none).
+    // Steps refresh them only after renderer has drawn previous ones, until then snapshots
+    // share the same buffer; use SimpleSpace::get_belt_points() for current positions.
+    std::shared_ptr<const std::vector<float> > belt_points;
+    size_t belt_count;            // Current, even when belt_points lag behind
+    unsigned long belt_version;   // Of belt_points
+    SpaceDiagnostics diagnostics; // Latest measured (if switched on)
+    unsigned long version;
+};
 
 class SimpleSpace
 {
+    SpaceConfig config;
+
+    // Step kernel specialized for current config (one of pre-instantiated SpacePolicy ones)
+    typedef void (SimpleSpace::*StepFunc)();
+    StepFunc step_func;
+    static StepFunc select_step_func(const SpaceConfig& config);
+
     void move_apart_bodies(Planet& p1, Planet& p2);
     void resolve_body_collision(Planet& pla, Planet& plb);
+    void merge_bodies(Planet& into, const Planet& from);
     void check_and_resolve_border_collision(Planet& pl);
+    bool is_touching_border(const Planet& pl) const;
+    void update_rest_state(Planet& pl, const Vector2d& acc); // Puts body to sleep after resting long enough
+
+    // Bodies storage is periodically sorted along Morton (Z-order) curve of positions,
+    // so that bodies close in space are close in memory. Ids stay with bodies; remap
+    // from id to index is kept by every storage change (and verified on use).
+    std::vector<unsigned int> id_to_index;
+    std::vector<Planet> reorder_buffer;
+    unsigned int steps_since_locality_check;
+    unsigned long reorders_count;
+    unsigned long steps_count;
+    size_t find_planet_index(unsigned int id); // planets.size() if not found
+    void update_id_map(size_t begin);          // For planets [begin, end)
+    void check_locality_and_reorder();
+
+    // Must be called with movement_step_mutex locked
+    void do_add_planet(const Planet& pl, const unsigned int& id);
+    void do_remove_planet(const unsigned int& id);
+    void do_modify_planet(const Planet& pl);
+    void do_apply_pending_commands();
+    void do_remove_all_objects();
+    void do_add_belt_particles(const std::vector<Vector2d>& pos, const std::vector<Vector2d>& vel);
+    void do_add_scene(const SceneParams& params, unsigned int first_id);
 
-    wMutex movement_step_mutex;
+    mutable wMutex movement_step_mutex; // Locked by const readers of engine state too
     double time_step_ms;
 
+    CommandQueue pending_commands;
+    std::atomic<unsigned int> next_planet_id;
+
+    // Temporary buffers of engine phases, released at the beginning of every step
+    ScratchArena scratch;
+
+    // Max distance planets are expected to move in one step (adapted every step);
+    // pairs closer than rad_sum + 2 * skin are collision candidates
+    double collision_skin;
+
+    WorkerPool worker_pool;
+    GravitySolverType gravity_solver_type;
+    std::unique_ptr<GravitySolver> symmetric_solver;
+    std::unique_ptr<GravitySolver> tiled_solver;
+    std::unique_ptr<PMGravitySolver> pm_solver;
+
+    ParticleBelt belt;
+
+    // Everything besides bodies that next steps depend on, for exact resume
+    Checkpointer checkpointer;
+    SceneEngineState make_engine_state() const;
+    void apply_engine_state(const SceneEngineState& state); // State must be validated by load_scene_file()
+    SceneFileStatus load_scene_file(const char* path, bool restore_state);
+
+    TrajectoryRecorder recorder;
+
+    JournalWriter journal;
+    unsigned long journal_session; // Journals started so far: undo states captured by journaled events are tagged by it
+    void do_apply_journal_event(const JournalEvent& event);
+    void journal_settings(); // After settings change
+
+    // Planets from history_dirty_begin on (and belt, if flagged) may differ from latest
+    // captured or restored state; every change of objects made by engine marks itself.
+    // Changes made right in public planets aren't marked: they get into undo states only
+    // along with changes of engine (e.g. next step), or once find_planet_index() notices them.
+    UndoHistory history;
+    size_t history_dirty_begin;
+    bool history_belt_dirty;
+    void mark_planets_changed(size_t begin) {history_dirty_begin = std::min(history_dirty_begin, begin);}
+    void mark_belt_changed() {history_belt_dirty = true;}
+    std::shared_ptr<const UndoState> capture_history(unsigned long tag = 0);
+    void do_save_undo_point();
+    bool undo_or_redo(bool undo);
+    bool do_undo_or_redo(bool undo);
+
+    // Conserved quantities, measured every diagnostics_interval steps (0 - off); collisions
+    // losses are summed every step while on
+    unsigned long diagnostics_interval;
+    SpaceDiagnostics diagnostics;
+    double collision_loss_j;
+
+    Physics::SofteningType softening_type;
+    double softening_length_m; // Global one, planets may have bigger own
+    GravityPrecision gravity_precision; // Used by symmetric solver, others are always double
+    bool sleeping_forces_skipped;       // Current step doesn't compute forces of sleeping bodies
+
+    // Step and its phases, called with movement_step_mutex locked
+    template <class Policy> void step();
+    template <class Policy> void add_external_fields(size_t begin, size_t end, Vector2d* acc) const;
+    template <class Policy> double move_planets(size_t begin, size_t end, const Vector2d* acc); // Returns max shift
+    template <class Policy> bool reference_gravity_and_movement(Vector2d* acc, double* potential,
+                                                                ScratchBuffer<CollisionPair>& candidates, double& max_shift);
+    template <class Policy> void resolve_collisions(bool candidates_complete, const ScratchBuffer<CollisionPair>& candidates);
+    void resolve_contacts(const ScratchBuffer<CollisionPair>& contacts, char* collided); // Parallel by contact graph colors
+    void merge_contacts(const ScratchBuffer<CollisionPair>& contacts, char* collided);
+    template <class Policy> void advance_belt();
+    struct ContactsJob;
+    static void resolve_contacts_task(void* arg, unsigned int task_idx, unsigned int worker_idx);
+
+    // RCU-like publication: writer fills snapshot not referenced by anyone
+    // (use_count == 1, i.e. only pool holds it) and atomically swaps pointer.
+    // Old snapshot is reclaimed back to the pool after the last reader drops it.
+    std::shared_ptr<const PlanetsSnapshot> published_snapshot;
+    std::vector<std::shared_ptr<PlanetsSnapshot> > snapshots_pool;
+    unsigned long snapshot_version;
+    // Belt points buffers are pooled the same way; steps skip conversion of belt
+    // (8 bytes per particle) while renderer hasn't drawn the last published points
+    std::vector<std::shared_ptr<std::vector<float> > > belt_points_pool;
+    unsigned long belt_points_version;
+    mutable std::atomic<unsigned long> belt_points_drawn; // Version, set by draw_scene()
+    void publish_snapshot(bool lazy_belt = false); // Must be called with movement_step_mutex locked
+    void fill_belt_points(std::vector<float>& points) const;
+
     void draw_planet(const float& rad, const float& x, const float& y) const;
+    void draw_belt(const std::vector<float>& points, const float& scale) const;
 public:
-    SimpleSpace(int timestep_ms = 10);
+    SimpleSpace(int timestep_ms = 10, unsigned int workers_num = 0, const SpaceConfig& config = SpaceConfig()); // workers_num: 0 - by CPU cores
     ~SimpleSpace();
     void add_planet(const Planet& pl);
     void remove_planet(const unsigned int& id);
     void remove_all_objects();
+    // Result depends only on scene and changes made to it between steps: no clocks, and
+    // every parallel sum has fixed order (tasks split work by data, not by workers), so
+    // steps give the same bits with any workers number and input journal reproduces sessions
     void move_one_step();
 
+    // Non-blocking versions for UI: edits are queued and applied by
+    // simulation thread at the beginning of the next step
+    unsigned int post_add_planet(const Planet& pl);
+    void post_remove_planet(const unsigned int& id);
+    void post_remove_all_objects();
+    void post_modify_planet(const Planet& pl);
+    // Applies queued edits right away (e.g. when simulation is paused)
+    void apply_pending_commands();
+
+    // Belt particles: light debris moved by massive bodies (see ParticleBelt).
+    // Positions and velocities go in pairs, pos.size() == vel.size()
+    void add_belt_particles(const std::vector<Vector2d>& pos, const std::vector<Vector2d>& vel);
+    void remove_belt_particles();
+    unsigned long get_belt_particles_count() const;
+    void get_belt_points(std::vector<float>& points) const; // Current positions: x0, y0, x1, y1...
+
+    // Generated scenes (see scene_generator.h): bodies are made in parallel right in
+    // planets storage and get consecutive ids; overlaps are left to collision handling.
+    // Result depends only on params, not on workers number.
+    void add_scene(const SceneParams& params);
+    void add_scene_particles(const SceneParams& params); // Same, as belt particles
+
+    // Scene files (see scene_file.h): planets and belt particles. Loading replaces
+    // all objects; on error current scene is kept.
+    SceneFileStatus save_scene(const char* path);  // Engine state is saved too
+    SceneFileStatus load_scene(const char* path);
+    // Also restores engine state (config, solver, counters), so that simulation goes on
+    // bit-exactly as it went after checkpoint was made
+    SceneFileStatus restore_checkpoint(const char* path);
+
+    // Background checkpoints (see checkpoints.h), off by default
+    void set_checkpoints(const CheckpointConfig& checkpoints);
+    void wait_checkpoints();
+    CheckpointStats get_checkpoint_stats();
+
+    // Trajectory recording (see trajectory.h): frame every config.interval_steps steps
+    bool start_recording(const char* path, const TrajectoryConfig& config); // False if file can't be created
+    void stop_recording(); // Writes captured frames and closes file
+    TrajectoryStats get_recording_stats() const;
+
+    // Input journal (see input_journal.h): scene changes from now on, with current scene
+    // copied next to journal. Replay reproduces recorded session on this space up to
+    // until_step (or its end), stopping at first state mismatch.
+    JournalStatus start_journal(const char* path);
+    void stop_journal();
+    void journal_front_end_event(JournalEventType type, long value = 0); // Speed, pause, single step
+    JournalStatus replay_journal(const char* path, unsigned long until_step = ULONG_MAX,
+                                 JournalReplayStats* stats = NULL);
+
+    // Undo history (see undo_history.h) of bodies and belt particles: save_undo_point()
+    // is called before user edit (edits posted earlier are applied first, so they are
+    // part of saved state). Undo and redo return false if there's nothing to restore.
+    void save_undo_point();
+    bool undo();
+    bool redo();
+    bool can_undo();
+    bool can_redo();
+
     unsigned long get_planets_count() const;
     int get_model_time_step_ms() const;
-    std::pair<bool, unsigned int> find_planet_by_click(const Vector2d& click_pos);
-    std::vector<unsigned int> find_planets_by_selection(const Vector2d& sel_start_pos,
-                                                        const Vector2d& sel_end_pos);
+    unsigned long get_reorders_count() const; // Morton reorderings made so far
+    unsigned long get_steps_count() const;
 
-    std::vector<Planet> planets;
+    void set_config(const SpaceConfig& new_config);
+    const SpaceConfig& get_config() const;
+
+    void set_gravity_solver(GravitySolverType type);
+    GravitySolverType get_gravity_solver() const;
+
+    void set_softening(Physics::SofteningType type, double length_m);
+    Physics::SofteningType get_softening_type() const;
+    double get_softening_length() const;
+
+    // Diagnostics (see diagnostics.h) every interval_steps steps, 0 - off; results come
+    // with snapshot. Switching on starts collisions loss count over.
+    void set_diagnostics_interval(unsigned long interval_steps);
+    unsigned long get_diagnostics_interval() const;
+
+    // Float kernels for big scenes, where visual accuracy is enough
+    void set_gravity_precision(GravityPrecision precision);
+    GravityPrecision get_gravity_precision() const;
+
+    // Lock-free for readers: queries and rendering work on latest published snapshot
+    std::shared_ptr<const PlanetsSnapshot> get_snapshot() const;
+    std::pair<bool, unsigned int> find_planet_by_click(const Vector2d& click_pos) const;
+    // Found ids are written to found_id_list (cleared first), so caller may reuse its capacity
+    void find_planets_by_selection(const Vector2d& sel_start_pos,
+                                   const Vector2d& sel_end_pos,
+                                   std::vector<unsigned int>& found_id_list) const;
+
+    std::vector<Planet> planets; // Direct changes bypass undo history tracking (see history)
     const unsigned int planets_number_max; // std::numeric_limits<unsigned int>::max()
 
     void handle_mouse_move(const Mouse& mouse);
     void handle_mouse_key_event(const Mouse& mouse, MOUSE_KEY key, KEY_ACTION action);
     void handle_keyboard_key_event(char key, KEY_ACTION action);
     void draw_scene(const float& scale) const;
+    // Recorded frame instead of engine bodies (replay), bodies are points colored by id
+    void draw_scene(const TrajectoryFrame& frame, const float& scale) const;
 };
 
 #endif /* defined(__simple_space__simplespace__) */
@@ -0,0 +1,235 @@
+//
+//  trajectory.h
+//  simple-space
+//
+
+#ifndef __simple_space__trajectory__
+#define __simple_space__trajectory__
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t, uint64_t
+#include <stdio.h>  // FILE
+#include <vector>
+#include <atomic>
+
+#include "planet.h"
+
+extern "C"
+{
+    #include "osWrappers.h"
+}
+
+#ifndef TRAJECTORY_ZLIB
+#define TRAJECTORY_ZLIB         1          // Compress blocks with zlib (links -lz): 1-on; 0-off (set by Makefiles)
+#endif
+#define TRAJECTORY_BLOCK_FRAMES 64         // Frames per block at most; every block starts with keyframe
+#define TRAJECTORY_BLOCK_BYTES  (4 << 20)  // Encoded bytes per block at most (checked after frame)
+
+// Trajectory file:
+//   TrajectoryFileHeader, then blocks: TrajectoryBlockHeader and payload (zlib or raw).
+// Payload is a sequence of frames. Positions (and velocities) are quantized to
+// multiples of quantum and stored as zigzag varint differences from the same body in
+// previous frame of the block (first frame of block is keyframe: differences from 0),
+// so every block is decoded on its own and quantization error doesn't accumulate.
+// Frame: varint step, varint count, byte flags, [ids: varint zigzag differences
+// from previous id in frame, omitted if same as previous frame], x[], y[], [vx[], vy[]].
+// Version 2 added last step to block headers; version 1 files are still read.
+#define TRAJECTORY_FILE_MAGIC   "SSTRAJ"
+#define TRAJECTORY_FILE_VERSION 2
+
+#define TRAJECTORY_FIELD_VELOCITY 0x01 // Positions are always recorded
+
+struct TrajectoryFileHeader {
+    char magic[8];       // TRAJECTORY_FILE_MAGIC
+    uint32_t version;
+    uint32_t fields;     // TRAJECTORY_FIELD_*
+    double pos_quantum_m;
+    double vel_quantum;  // m/s
+};
+
+struct TrajectoryBlockHeader {
+    uint32_t method;      // TRAJECTORY_METHOD_*
+    uint32_t frames_num;
+    uint64_t first_step;
+    uint64_t last_step;
+    uint64_t raw_size;    // Encoded frames
+    uint64_t stored_size; // Payload in file
+    uint64_t checksum;    // Of encoded frames (scene_checksum())
+};
+
+#define TRAJECTORY_METHOD_RAW  0
+#define TRAJECTORY_METHOD_ZLIB 1
+
+// What to do with frame when writer is behind and ring is full
+enum TrajectoryPolicy {
+    TRAJECTORY_BLOCK,    // Step waits for free slot (no frame is lost)
+    TRAJECTORY_DROP,     // Frame is dropped
+    TRAJECTORY_DECIMATE  // Frame is dropped and interval doubles, back to normal once ring drains
+};
+
+struct TrajectoryConfig {
+    TrajectoryConfig()
+    : interval_steps(1),
+      fields(0),
+      pos_quantum_m(100),
+      vel_quantum(1),
+      ring_frames(8),
+      policy(TRAJECTORY_BLOCK) {}
+
+    unsigned long interval_steps; // Frame every K steps
+    uint32_t fields;              // TRAJECTORY_FIELD_*
+    double pos_quantum_m;         // Position resolution
+    double vel_quantum;           // Velocity resolution, m/s
+    size_t ring_frames;           // Frames buffered between step and writer
+    TrajectoryPolicy policy;
+};
+
+struct TrajectoryStats {
+    unsigned long frames_captured;
+    unsigned long frames_written;
+    unsigned long frames_dropped;
+    unsigned long steps_blocked; // Steps waited for writer (TRAJECTORY_BLOCK)
+    unsigned long blocks_written;
+    uint64_t bytes_encoded;      // Before compression
+    uint64_t bytes_stored;       // In file, headers included
+    unsigned long writer_busy_ms;
+    unsigned long elapsed_ms;    // Since recording start
+    bool failed;                 // Write error, file is incomplete
+};
+
+// Frame as recorded: bodies in storage order
+struct TrajectoryFrame {
+    uint64_t step;
+    std::vector<uint32_t> id;
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> vx; // Empty if velocities aren't recorded
+    std::vector<double> vy;
+};
+
+// Records frames of simulation into file. capture() is called by simulation
+// thread: it only copies fields into preallocated slot of single-producer /
+// single-consumer ring, the rest (encoding, compression, disk) is done by own
+// writer thread, so steps aren't stalled by disk unless policy asks for it.
+class TrajectoryRecorder
+{
+    TrajectoryConfig _config;
+    FILE* _file;
+    std::atomic<bool> _failed; // Write error, file is incomplete
+
+    // Ring: slots [tail, head) are filled, counters only grow
+    std::vector<TrajectoryFrame> _ring;
+    std::atomic<uint64_t> _head;
+    std::atomic<uint64_t> _tail;
+    unsigned long _stride; // Interval multiplier (TRAJECTORY_DECIMATE)
+
+    wThread _writer;
+    wEvent _data_event;  // Frame added or stop requested
+    wEvent _space_event; // Frame consumed
+    std::atomic<bool> _stopping;
+
+    // Writer state: previous frame of block (by id) and block being encoded
+    std::vector<uint32_t> _prev_id;
+    std::vector<int64_t> _prev_q[4];        // Quantized fields of previous frame, by id
+    std::vector<uint32_t> _prev_frame;      // Frame number (in block) id was last seen at, by id
+    uint32_t _block_frames;
+    uint64_t _block_first_step;
+    uint64_t _prev_step;
+    uint32_t _frames_encoded;
+    std::vector<unsigned char> _block;
+    std::vector<unsigned char> _compressed;
+
+    // Stats: written by one thread, read by any
+    std::atomic<unsigned long> _frames_captured;
+    std::atomic<unsigned long> _frames_written;
+    std::atomic<unsigned long> _frames_dropped;
+    std::atomic<unsigned long> _steps_blocked;
+    std::atomic<unsigned long> _blocks_written;
+    std::atomic<uint64_t> _bytes_encoded;
+    std::atomic<uint64_t> _bytes_stored;
+    std::atomic<unsigned long> _writer_busy_ms;
+    wTime _start_time;
+    unsigned long _elapsed_ms; // Of finished recording
+
+    static int writer_loop(void* arg);
+    void encode_frame(const TrajectoryFrame& frame);
+    void flush_block();
+
+    TrajectoryRecorder(const TrajectoryRecorder&);            // Not copyable
+    TrajectoryRecorder& operator=(const TrajectoryRecorder&);
+
+public:
+    TrajectoryRecorder();
+    ~TrajectoryRecorder(); // Stops
+
+    bool start(const char* path, const TrajectoryConfig& config); // False if file can't be created
+    void stop(); // Writes all captured frames and closes file
+    bool is_recording() const {return _file != NULL;}
+
+    bool is_due(unsigned long steps_count) const {
+        return (_file != NULL) && (steps_count % (_config.interval_steps * _stride) == 0);
+    }
+    void capture(unsigned long steps_count, const std::vector<Planet>& planets);
+
+    TrajectoryStats stats() const;
+};
+
+// Block of trajectory file, as found by reader
+struct TrajectoryBlockInfo {
+    uint64_t offset;      // Of block header in file
+    uint64_t first_step;  // Of keyframe
+    uint64_t last_step;
+    uint64_t first_frame; // Number of keyframe in file
+    uint32_t frames_num;
+};
+
+// Reader of trajectory files. Blocks are indexed on open (only block headers are
+// read), so any step is reached by index lookup and decoding of one block.
+// Version 1 files are decoded once on open instead, as their headers lack last step.
+// Truncated file (recording was interrupted) is read up to last complete block.
+class TrajectoryReader
+{
+    FILE* _file;
+    TrajectoryFileHeader _header;
+    std::vector<TrajectoryBlockInfo> _index;
+    std::vector<unsigned char> _block;
+    std::vector<unsigned char> _stored;
+    size_t _block_pos;
+    uint32_t _block_frames_left;
+    uint32_t _block_frame;
+    uint64_t _block_first_step;
+    uint64_t _prev_step;
+    uint32_t _frames_decoded;
+    std::vector<uint32_t> _prev_id;
+    std::vector<int64_t> _prev_q[4];
+    std::vector<uint32_t> _prev_frame;
+
+    uint64_t block_header_size() const; // In file of header's version
+    bool read_block_header(TrajectoryBlockHeader& header);
+    bool read_block();
+
+    TrajectoryReader(const TrajectoryReader&);            // Not copyable
+    TrajectoryReader& operator=(const TrajectoryReader&);
+
+public:
+    TrajectoryReader();
+    ~TrajectoryReader();
+
+    bool open(const char* path); // False if not trajectory file
+    void close();
+    const TrajectoryFileHeader& header() const {return _header;}
+
+    size_t blocks_count() const {return _index.size();}
+    const TrajectoryBlockInfo& block_info(size_t block) const {return _index[block];}
+    uint64_t frames_count() const;
+    uint64_t first_step() const; // 0 if there are no frames
+    uint64_t last_step() const;
+    size_t find_block(uint64_t step) const; // Block with frame of step (or closest before it), 0 if step is before all
+
+    // Next frame, false at the end or on corrupted block
+    bool next_frame(TrajectoryFrame& frame);
+    bool seek_block(size_t block); // next_frame() goes on from keyframe of block
+    bool read_block_frames(size_t block, std::vector<TrajectoryFrame>& frames); // All frames of block
+};
+
+#endif /* defined(__simple_space__trajectory__) */
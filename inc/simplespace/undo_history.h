@@ -0,0 +1,80 @@
+//
+//  undo_history.h
+//  simple-space
+//
+
+#ifndef __simple_space__undo_history__
+#define __simple_space__undo_history__
+
+#include <stddef.h> // size_t
+#include <vector>
+#include <deque>
+#include <memory>   // std::shared_ptr
+
+#include "planet.h"
+#include "particle_belt.h"
+
+#define UNDO_CHUNK_PLANETS 4096        // Planets per shared chunk
+#define UNDO_HISTORY_DEPTH 64          // Undo points kept, oldest go first
+#define UNDO_HISTORY_BYTES (512 << 20) // Memory of kept states (shared chunks counted once)
+
+typedef std::vector<Planet> UndoChunk;
+
+struct UndoBelt {
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> vx;
+    std::vector<double> vy;
+};
+
+// Immutable copy of scene objects. Planets are stored in chunks shared between states:
+// chunk that didn't change since previous state is referenced, not copied.
+struct UndoState {
+    unsigned long tag; // Given by caller of capture()
+    size_t planets_count;
+    std::vector<std::shared_ptr<const UndoChunk> > chunks;
+    std::shared_ptr<const UndoBelt> belt; // Shared too while belt doesn't change
+};
+
+// Undo/redo stacks of scene states. Capture costs O(chunks changed since previous
+// capture or restore): caller tells which planets may differ (all of them after
+// a step, tail from the first erased one after removal, etc.).
+class UndoHistory
+{
+    std::deque<std::shared_ptr<const UndoState> > _undo;
+    std::vector<std::shared_ptr<const UndoState> > _redo;
+    std::shared_ptr<const UndoState> _base; // Latest captured or restored state
+
+    void trim(); // To UNDO_HISTORY_DEPTH and UNDO_HISTORY_BYTES
+
+    UndoHistory(const UndoHistory&);            // Not copyable
+    UndoHistory& operator=(const UndoHistory&);
+
+public:
+    UndoHistory() {}
+    ~UndoHistory() {}
+
+    // Planets [0, dirty_begin) and belt (unless belt_dirty) must be the same as in
+    // latest captured or restored state
+    std::shared_ptr<const UndoState> capture(const std::vector<Planet>& planets, size_t dirty_begin,
+                                             const ParticleBelt& belt, bool belt_dirty, unsigned long tag = 0);
+
+    void push(const std::shared_ptr<const UndoState>& state); // New undo point, redo stack is dropped
+    bool can_undo() const {return !_undo.empty();}
+    bool can_redo() const {return !_redo.empty();}
+    const UndoState* next_undo() const {return _undo.empty() ? NULL : _undo.back().get();}
+    const UndoState* next_redo() const {return _redo.empty() ? NULL : _redo.back().get();}
+
+    // Current state goes to the opposite stack; returned state becomes base of next capture
+    std::shared_ptr<const UndoState> undo(const std::shared_ptr<const UndoState>& current);
+    std::shared_ptr<const UndoState> redo(const std::shared_ptr<const UndoState>& current);
+
+    void clear();
+    size_t undo_depth() const {return _undo.size();}
+    size_t redo_depth() const {return _redo.size();}
+    size_t bytes() const; // Of all kept states, shared chunks counted once
+
+    static void restore(const UndoState& state, std::vector<Planet>& planets, ParticleBelt& belt);
+};
+
+#endif /* defined(__simple_space__undo_history__) */
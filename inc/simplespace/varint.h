@@ -0,0 +1,48 @@
+//
+//  varint.h
+//  simple-space
+//
+
+#ifndef __simple_space__varint__
+#define __simple_space__varint__
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t, int64_t
+#include <vector>
+
+// LEB128 variable-length integers (7 bits per byte) for compact file formats;
+// signed values are zigzag-mapped first, so small negative ones stay short
+
+inline void put_varint(std::vector<unsigned char>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+inline void put_zigzag(std::vector<unsigned char>& out, int64_t value) {
+    put_varint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+// False if input ends before value does
+inline bool get_varint(const std::vector<unsigned char>& in, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (unsigned int shift = 0; (shift < 64) && (pos < in.size()); shift += 7) {
+        unsigned char byte = in[pos++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+inline bool get_zigzag(const std::vector<unsigned char>& in, size_t& pos, int64_t& value) {
+    uint64_t raw;
+    if (!get_varint(in, pos, raw))
+        return false;
+    value = static_cast<int64_t>(raw >> 1) ^ -static_cast<int64_t>(raw & 1);
+    return true;
+}
+
+#endif /* defined(__simple_space__varint__) */
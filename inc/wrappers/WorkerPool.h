@@ -0,0 +1,60 @@
+//
+//  WorkerPool.h
+//
+
+#ifndef _WORKER_POOL_H_
+#define _WORKER_POOL_H_
+
+#include <vector>
+#include <atomic>
+
+extern "C"
+{
+    #include "osWrappers.h"
+}
+
+// Task callback: taskIdx - index of task in [0, tasksNum), workerIdx - index of executing worker
+typedef void (*wTaskFunc)(void* arg, unsigned int taskIdx, unsigned int workerIdx);
+
+// Fixed set of threads executing parallel loops.
+// Tasks are distributed statically: worker w runs tasks w, w + workersNum, w + 2 * workersNum...
+// So for the same workers number every task is always done by the same worker, which
+// keeps per-worker partial results (and their reduction order) reproducible.
+class WorkerPool
+{
+    struct Worker
+    {
+        WorkerPool*  pPool;
+        unsigned int idx;
+        wThread      thread;
+        wEvent       startEvent;
+    };
+
+    unsigned int         mWorkersNum; // Including calling thread (worker #0)
+    std::vector<Worker>  mWorkers;
+    volatile bool        mIsRunning;
+
+    wTaskFunc            mTaskFunc;
+    void*                mTaskArg;
+    unsigned int         mTasksNum;
+    std::atomic<unsigned int> mBusyWorkers;
+    wEvent               mDoneEvent;
+    wMutex               mRunLock;
+
+    void runWorkerTasks(unsigned int workerIdx);
+    static int staticWrapper(void* arg);
+
+    WorkerPool(const WorkerPool&);            // Not copyable
+    WorkerPool& operator=(const WorkerPool&);
+
+public:
+    WorkerPool(unsigned int workersNum = 0); // 0 - by number of CPU cores
+    ~WorkerPool();
+
+    unsigned int workersNum() const;
+
+    // Calls taskFunc(arg, i, worker) for every i in [0, tasksNum), returns when all are done
+    void run(wTaskFunc taskFunc, void* arg, unsigned int tasksNum);
+};
+
+#endif /* defined(_WORKER_POOL_H_) */
@@ -11,6 +11,7 @@
 #include <stdint.h>  // uintptr_t
 #include <stdbool.h> // bool
 #include <assert.h>  // assert() defining NDEBUG will disable asserts in code
+#include <stdio.h>   // FILE
 
 #if defined(__APPLE__) || defined(__linux__)
 
@@ -18,6 +19,10 @@
     #include <time.h>    // nanosleep() clock_gettime()
     #include <pthread.h> // pthread
     #include <errno.h>   // ETIMEDOUT
+    #include <unistd.h>  // sysconf()
+    #include <fcntl.h>     // open()
+    #include <sys/mman.h>  // mmap()
+    #include <sys/stat.h>  // fstat()
 
     #if defined(__APPLE__)
     #include <mach/clock.h> // clock_get_time()
@@ -33,6 +38,10 @@
         pthread_mutex_t mutex;
         bool            flag;
     } wEvent;
+    typedef struct {
+        const void* data;
+        size_t      size;
+    } wMappedFile;
 
     #define W_TIMEOUT_INITITE (~(0UL))
     #define W_TIMEOUT_EXPIRED ETIMEDOUT
@@ -49,6 +58,11 @@
     typedef CRITICAL_SECTION  wMutex;
     typedef HANDLE            wThread;
     typedef HANDLE            wEvent;
+    typedef struct {
+        const void* data;
+        size_t      size;
+        HANDLE      mapping;
+    } wMappedFile;
 
     #define W_TIMEOUT_INITITE INFINITE
     #define W_TIMEOUT_EXPIRED WAIT_TIMEOUT
@@ -92,6 +106,8 @@ typedef int (*wThreadFunc)(void* arg);
 int  wThreadCreate(wThread* thread, wThreadFunc func, void* arg, bool joinable);
 void wThreadJoin(wThread thread, int* p_retval);
 
+unsigned int wCpuCoresNum(); // Number of online logical CPUs (at least 1)
+
 // Events
 
 void wEventInit   (wEvent* event);
@@ -100,4 +116,14 @@ int  wEventWait   (wEvent* event, unsigned long timeoutMs);
 void wEventSignal (wEvent* event);
 void wEventReset  (wEvent* event);
 
+// Memory-mapped files
+
+bool wMapFile  (const char* path, wMappedFile* file); // Read-only, whole file; false on error or empty file
+void wUnmapFile(wMappedFile* file);
+
+// Files larger than 2 GB (plain fseek() takes long, 32-bit on some platforms)
+
+bool    wFileSeek(FILE* file, int64_t offset, int origin); // origin: SEEK_SET, SEEK_CUR or SEEK_END
+int64_t wFileTell(FILE* file);                              // -1 on error
+
 #endif // _OS_WRAPPERS_H_
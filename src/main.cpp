@@ -41,11 +41,12 @@ using std::endl;
 //#include <ft2build.h>
 //#include FT_FREETYPE_H
 
-#include <stdlib.h> // rand()
+#include <stdlib.h> // rand(), strtoul()
 #include <time.h>
 
 #include "controls.h"
 #include "simplespace.h"
+#include "replay.h"
 #include "planet.h"
 #include "physics.h"
 #include "Timer.h"
@@ -100,7 +101,12 @@ bool rad_modifier_key_down = false;
 const double default_planet_mass = 1e29;
 const double default_planet_rad = 2e6;
 
+const unsigned int belt_particles_num = 1 << 20; // Asteroid belt toggled by 'b' key
+uint64_t belt_seed = 1; // Each new belt gets next seed
+std::string scene_file_path = "scene.ssc"; // Saved by 's' key, loaded by 'l' key or --load-scene
+
 Planet next_planet;
+std::vector<unsigned int> selected_ids; // Reused by box selection
 
 std::stringstream ss;
 std::string str;
@@ -119,6 +125,9 @@ std::unique_ptr<ControlsManager> pControlsLeft(new ControlsManager(notify_to_upd
 std::unique_ptr<ControlsManager> pControlsRight(new ControlsManager(notify_to_update_menu2));
 std::unique_ptr<FpsCounter> pFpsCounter(new FpsCounter);
 std::unique_ptr<Stopwatch> pStopwatch(new Stopwatch(false));
+std::unique_ptr<TrajectoryPlayer> pReplay; // Set by --replay: scene comes from trajectory file, engine isn't stepped
+uint64_t replay_step = 0;                  // Playhead
+unsigned long diagnostics_interval = 10;   // Steps between diagnostics toggled by 'e' key (or set by --diagnostics)
 
 // Temp stopwatch to count time of rendring frame
 //std::unique_ptr<Stopwatch> pStopwatch_render(new Stopwatch(false));
@@ -161,8 +170,14 @@ Color_RGB getRandomColor();
 void onTimer(int next_timer_tick) {
 
     pStopwatch->start();
-    for (int i = 0; i < model_speed; ++i)
-        pSimpleSpace->move_one_step();
+    if (pReplay) {
+        replay_step += model_speed;
+        if (replay_step > pReplay->last_step())
+            replay_step = pReplay->last_step();
+    } else {
+        for (int i = 0; i < model_speed; ++i)
+            pSimpleSpace->move_one_step();
+    }
     pStopwatch->stop();
     need_to_render_scene = true;
     glutPostRedisplay();
@@ -186,6 +201,7 @@ void check_need_to_render_bools(int next_timer_tick) {
 void start_simulation() {
     if (!simulation_on) {
         simulation_on = true;
+        pSimpleSpace->journal_front_end_event(JOURNAL_RESUME);
         glutTimerFunc(1000/frame_rate, onTimer, 1000/frame_rate);
     }
 }
@@ -193,11 +209,14 @@ void start_simulation() {
 void stop_simulation() {
     if (simulation_on) {
         simulation_on = false; // This stops timer cycling
+        pSimpleSpace->journal_front_end_event(JOURNAL_PAUSE);
     }
 }
 
 void exit() {
     glutDestroyWindow(main_window_id);
+    pSimpleSpace->stop_recording(); // Flushes trajectory file
+    pSimpleSpace->stop_journal();
     cout << "Exiting by user choice" << endl;
     exit(0);
 }
@@ -210,14 +229,23 @@ void restart_simulation() {
         need_to_resume = true;
     }
 
-    pSimpleSpace->remove_all_objects();
+    pSimpleSpace->save_undo_point();
+    pSimpleSpace->post_remove_all_objects();
 
     double dist = 4e7;
-    pSimpleSpace->add_planet(Planet(Vector2d(0, 0), Vector2d(0, 0), 1e30, 3e6, getRandomColor()));
-    pSimpleSpace->add_planet(Planet(Vector2d( dist/4,   0), Vector2d(0,   -2e6), 1e15, 1e6, getRandomColor()));
-    pSimpleSpace->add_planet(Planet(Vector2d(-dist/4,   0), Vector2d(0,    2e6), 1e15, 1e6, getRandomColor()));
-    pSimpleSpace->add_planet(Planet(Vector2d(0,  dist/1.5), Vector2d(-1.5e6, 0), 1e15, 1e6, getRandomColor()));
-    pSimpleSpace->add_planet(Planet(Vector2d(0, -dist/1.5), Vector2d( 1.5e6, 0), 1e15, 1e6, getRandomColor()));
+    pSimpleSpace->post_add_planet(Planet(Vector2d(0, 0), Vector2d(0, 0), 1e30, 3e6, getRandomColor()));
+
+    // Light bodies: their gravity is negligible next to the star's one
+    Planet satellites[] = {
+        Planet(Vector2d( dist/4,   0), Vector2d(0,   -2e6), 1e15, 1e6, getRandomColor()),
+        Planet(Vector2d(-dist/4,   0), Vector2d(0,    2e6), 1e15, 1e6, getRandomColor()),
+        Planet(Vector2d(0,  dist/1.5), Vector2d(-1.5e6, 0), 1e15, 1e6, getRandomColor()),
+        Planet(Vector2d(0, -dist/1.5), Vector2d( 1.5e6, 0), 1e15, 1e6, getRandomColor())
+    };
+    for (size_t i = 0; i < sizeof(satellites) / sizeof(satellites[0]); ++i) {
+        satellites[i].test_particle = true;
+        pSimpleSpace->post_add_planet(satellites[i]);
+    }
 
     if (need_to_resume) {
         simulation_on = true;
@@ -228,7 +256,62 @@ void restart_simulation() {
 }
 
 void remove_all_objects() {
-    pSimpleSpace->remove_all_objects();
+    pSimpleSpace->save_undo_point();
+    pSimpleSpace->post_remove_all_objects();
+}
+
+// Ring of particles on circular orbits around the heaviest planet
+void add_asteroid_belt() {
+    std::shared_ptr<const PlanetsSnapshot> snapshot = pSimpleSpace->get_snapshot();
+    const Planet* center = NULL;
+    for (size_t i = 0; i < snapshot->planets.size(); ++i) {
+        if (!center || snapshot->planets[i].mass_kg > center->mass_kg)
+            center = &snapshot->planets[i];
+    }
+    if (!center) {
+        cout << "No planet to put asteroid belt around" << endl;
+        return;
+    }
+
+    SceneParams params;
+    params.kind = SCENE_BELT;
+    params.count = belt_particles_num;
+    params.seed = belt_seed++;
+    params.center = center->pos;
+    params.center_vel = center->vel;
+    params.central_mass_kg = center->mass_kg;
+    params.inner_rad_m = 2e7;
+    params.outer_rad_m = 3.5e7;
+    pSimpleSpace->save_undo_point();
+    pSimpleSpace->add_scene_particles(params);
+    cout << "Asteroid belt: " << belt_particles_num << " particles" << endl;
+}
+
+void save_scene() {
+    SceneFileStatus status = pSimpleSpace->save_scene(scene_file_path.c_str());
+    cout << "Save scene to " << scene_file_path << ": " << scene_file_status_str(status) << endl;
+}
+
+bool load_scene() {
+    pSimpleSpace->save_undo_point();
+    SceneFileStatus status = pSimpleSpace->load_scene(scene_file_path.c_str());
+    cout << "Load scene from " << scene_file_path << ": " << scene_file_status_str(status) << endl;
+    return status == SCENE_FILE_OK;
+}
+
+// Replay playhead jumps, e.g. to percent of recorded run
+void replay_seek(uint64_t step) {
+    if (!pReplay)
+        return;
+    replay_step = (step < pReplay->first_step()) ? pReplay->first_step() : step;
+    if (replay_step > pReplay->last_step())
+        replay_step = pReplay->last_step();
+    need_to_render_scene = true;
+}
+
+void replay_seek_percent(int percent) {
+    if (pReplay)
+        replay_seek(pReplay->first_step() + (pReplay->last_step() - pReplay->first_step()) * percent / 100);
 }
 
 void zoom_in() {
@@ -251,6 +334,7 @@ void zoom_out() {
 
 void move_one_step() {
     if (!simulation_on) {
+        pSimpleSpace->journal_front_end_event(JOURNAL_SINGLE_STEP);
         pSimpleSpace->move_one_step();
         cout << "Moved for one step" << endl;
     } else {
@@ -258,6 +342,21 @@ void move_one_step() {
     }
 }
 
+// Energy (total, kinetic, potential), its drift, momentum, angular momentum and collision loss
+std::string diagnostics_str(const SpaceDiagnostics& diagnostics) {
+    std::ostringstream line;
+    line.precision(4);
+    line << "step " << diagnostics.step << ": E " << diagnostics.total_j() <<
+            " J (K " << diagnostics.kinetic_j << ", U ";
+    if (diagnostics.potential_valid)
+        line << diagnostics.potential_j;
+    else
+        line << "n/a";
+    line << "), drift " << diagnostics.drift() << ", P (" << diagnostics.momentum.x << ", " << diagnostics.momentum.y <<
+            ") kg*m/s, L " << diagnostics.angular_momentum << " kg*m^2/s, collisions took " << diagnostics.collision_loss_j << " J";
+    return line.str();
+}
+
 void render_window() {
 
     //pStopWatch_render->start();
@@ -343,7 +442,18 @@ void render_window() {
         glPushMatrix();
         glTranslated(x_center_offset, y_center_offset, 0.0);
 
-        pSimpleSpace->draw_scene(model_scale);
+        // No steps are running to apply queued edits while simulation is paused
+        if (!simulation_on)
+            pSimpleSpace->apply_pending_commands();
+
+        if (pReplay) {
+            std::shared_ptr<const ReplayBlock> holder;
+            const TrajectoryFrame* frame = pReplay->frame_at(replay_step, holder);
+            if (frame)
+                pSimpleSpace->draw_scene(*frame, model_scale);
+        } else {
+            pSimpleSpace->draw_scene(model_scale);
+        }
 
         if (mouse.left_key.is_down && is_over_scene(mouse.left_key.down_x)) {
             draw_planet(next_planet.rad_m / model_scale,
@@ -412,15 +522,16 @@ void render_window() {
             glEnd();
         }
 
-        #if (BORDERS_ENABLED > 0)
-        glColor3f(1.0f, 1.0f, 1.0f);
-        glBegin(GL_LINE_LOOP);
-        glVertex2d(RIGHT_BORDER/double(model_scale), TOP_BORDER/double(model_scale));
-        glVertex2d(LEFT_BORDER/double(model_scale), TOP_BORDER/double(model_scale));
-        glVertex2d(LEFT_BORDER/double(model_scale), BOTTOM_BORDER/double(model_scale));
-        glVertex2d(RIGHT_BORDER/double(model_scale), BOTTOM_BORDER/double(model_scale));
-        glEnd();
-        #endif
+        const SpaceConfig& config = pSimpleSpace->get_config();
+        if (config.borders_enabled) {
+            glColor3f(1.0f, 1.0f, 1.0f);
+            glBegin(GL_LINE_LOOP);
+            glVertex2d(config.right_border/double(model_scale), config.top_border/double(model_scale));
+            glVertex2d(config.left_border/double(model_scale), config.top_border/double(model_scale));
+            glVertex2d(config.left_border/double(model_scale), config.bottom_border/double(model_scale));
+            glVertex2d(config.right_border/double(model_scale), config.bottom_border/double(model_scale));
+            glEnd();
+        }
 
         glPopMatrix();
 
@@ -434,6 +545,25 @@ void render_window() {
         ss.clear();
         ss.str(std::string());
 
+        if (pReplay) {
+            ss << "Replay: step " << replay_step << " of " << pReplay->last_step() << " (0-9 - seek, [/] - step back/forward)";
+            render_bitmap_string_2d(ss.str().c_str(),
+                                    menu1_width + 10,
+                                    30,
+                                    GLUT_BITMAP_HELVETICA_12,
+                                    Color_RGBA(0.9f, 0.9f, 0.9f, 1.0f));
+            ss.clear();
+            ss.str(std::string());
+        } else if (pSimpleSpace->get_diagnostics_interval() > 0) {
+            std::shared_ptr<const PlanetsSnapshot> snapshot = pSimpleSpace->get_snapshot();
+            if (snapshot->diagnostics.valid)
+                render_bitmap_string_2d(diagnostics_str(snapshot->diagnostics).c_str(),
+                                        menu1_width + 10,
+                                        30,
+                                        GLUT_BITMAP_HELVETICA_12,
+                                        Color_RGBA(0.9f, 0.9f, 0.9f, 1.0f));
+        }
+
         render_bitmap_string_2d("add/remove planets - mouse left/right keys",
                                 window_width - 900,
                                 window_height - 35,
@@ -572,6 +702,7 @@ void handleNormalKeysDown(unsigned char key, int x, int y) {
         case ',':
             if (model_speed > 1) {
                 model_speed /= 10;
+                pSimpleSpace->journal_front_end_event(JOURNAL_MODEL_SPEED, model_speed);
                 cout << "model speed: " << model_speed << " (" << frame_rate * model_speed * pSimpleSpace->planets.size() << " calcs per second)" << endl;
             }
             break;
@@ -579,9 +710,84 @@ void handleNormalKeysDown(unsigned char key, int x, int y) {
         case '.':
             if (!(model_speed * pSimpleSpace->get_model_time_step_ms() > 100000)) {
                 model_speed *= 10;
+                pSimpleSpace->journal_front_end_event(JOURNAL_MODEL_SPEED, model_speed);
                 cout << "model speed: " << model_speed << " (" << frame_rate * model_speed * pSimpleSpace->planets.size() << " calcs per second)" << endl;
             }
             break;
+
+        // Gravity solver
+        case 'g':
+            switch (pSimpleSpace->get_gravity_solver()) {
+                case GRAVITY_SOLVER_REFERENCE:
+                    cout << "Gravity solver: symmetric" << endl;
+                    pSimpleSpace->set_gravity_solver(GRAVITY_SOLVER_SYMMETRIC);
+                    break;
+                case GRAVITY_SOLVER_SYMMETRIC:
+                    cout << "Gravity solver: tiled (exact)" << endl;
+                    pSimpleSpace->set_gravity_solver(GRAVITY_SOLVER_TILED);
+                    break;
+                case GRAVITY_SOLVER_TILED:
+                    cout << "Gravity solver: particle-mesh" << endl;
+                    pSimpleSpace->set_gravity_solver(GRAVITY_SOLVER_PM);
+                    break;
+                case GRAVITY_SOLVER_PM:
+                    cout << "Gravity solver: reference" << endl;
+                    pSimpleSpace->set_gravity_solver(GRAVITY_SOLVER_REFERENCE);
+                    break;
+            }
+            break;
+
+        // Gravity precision (symmetric solver)
+        case 'p':
+            if (pSimpleSpace->get_gravity_precision() == GRAVITY_PRECISION_DOUBLE) {
+                cout << "Gravity precision: mixed (float/double)" << endl;
+                pSimpleSpace->set_gravity_precision(GRAVITY_PRECISION_MIXED);
+            } else {
+                cout << "Gravity precision: double" << endl;
+                pSimpleSpace->set_gravity_precision(GRAVITY_PRECISION_DOUBLE);
+            }
+            break;
+
+        // Asteroid belt
+        case 'b':
+            if (pSimpleSpace->get_belt_particles_count() > 0) {
+                cout << "Asteroid belt removed" << endl;
+                pSimpleSpace->save_undo_point();
+                pSimpleSpace->remove_belt_particles();
+            } else {
+                add_asteroid_belt();
+            }
+            break;
+
+        // Scene file
+        case 's':
+            save_scene();
+            break;
+        case 'l':
+            load_scene();
+            break;
+
+        // Energy and momentum diagnostics
+        case 'e':
+            if (pSimpleSpace->get_diagnostics_interval() > 0) {
+                cout << "Diagnostics off" << endl;
+                pSimpleSpace->set_diagnostics_interval(0);
+            } else {
+                cout << "Diagnostics every " << diagnostics_interval << " steps" << endl;
+                pSimpleSpace->set_diagnostics_interval(diagnostics_interval);
+            }
+            break;
+
+        // Undo/redo of scene edits
+        case 'z':
+        case 26: // Ctrl+Z
+            cout << (pSimpleSpace->undo() ? "Undo" : "Nothing to undo") << endl;
+            break;
+        case 'y':
+        case 25: // Ctrl+Y
+            cout << (pSimpleSpace->redo() ? "Redo" : "Nothing to redo") << endl;
+            break;
+
         case 'r':
         case 'R':
             rad_modifier_key_down = true;
@@ -590,6 +796,19 @@ void handleNormalKeysDown(unsigned char key, int x, int y) {
         case 'M':
             mass_modifier_key_down = true;
             break;
+
+        // Replay seeking
+        case '[':
+            if (pReplay)
+                replay_seek((replay_step > static_cast<uint64_t>(model_speed)) ? replay_step - model_speed : 0);
+            break;
+        case ']':
+            replay_seek(replay_step + model_speed);
+            break;
+        default:
+            if (key >= '0' && key <= '9')
+                replay_seek_percent((key - '0') * 10);
+            break;
     }
 
     notify_to_update_all();
@@ -727,7 +946,8 @@ void handleMouseKeypress(int button, int state, int x, int y) {
                     break;
                 case GLUT_UP: // Add prepared planet
                     if (is_over_scene(mouse.left_key.down_x)) {
-                        pSimpleSpace->add_planet(next_planet);
+                        pSimpleSpace->save_undo_point();
+                        pSimpleSpace->post_add_planet(next_planet);
                     }
                     break;
             }
@@ -743,7 +963,8 @@ void handleMouseKeypress(int button, int state, int x, int y) {
                                                             model_y_from_screen_y(mouse.y));
                         pair<bool, unsigned int> ret = pSimpleSpace->find_planet_by_click(clicked_model_pos);
                         if (ret.first) {
-                            pSimpleSpace->remove_planet(ret.second);
+                            pSimpleSpace->save_undo_point();
+                            pSimpleSpace->post_remove_planet(ret.second);
                         }
                     }
                     break;
@@ -758,9 +979,11 @@ void handleMouseKeypress(int button, int state, int x, int y) {
                                                               model_y_from_screen_y(mouse.right_key.down_y));
                         Physics::Vector2d sel_end_model_pos(model_x_from_screen_x(mouse.x),
                                                             model_y_from_screen_y(mouse.y));
-                        std::vector<unsigned int> id_list = pSimpleSpace->find_planets_by_selection(sel_start_model_pos, sel_end_model_pos);
-                        for (std::vector<unsigned int>::iterator it = id_list.begin(), it_end = id_list.end(); it != it_end; ++it) {
-                            pSimpleSpace->remove_planet(*it);
+                        pSimpleSpace->find_planets_by_selection(sel_start_model_pos, sel_end_model_pos, selected_ids);
+                        if (!selected_ids.empty())
+                            pSimpleSpace->save_undo_point(); // One for whole selection
+                        for (std::vector<unsigned int>::iterator it = selected_ids.begin(), it_end = selected_ids.end(); it != it_end; ++it) {
+                            pSimpleSpace->post_remove_planet(*it);
                         }
                     }
                     break;
@@ -867,6 +1090,117 @@ void initRendering() {
 
 
 // default changed to make glutInit() work
+// Engine settings from command line, e.g.: --no-gravity --merge --sleep --coef-res 0.9 --global-top-mass 1e30
+SpaceConfig parse_space_config(int argc, char * argv[]) {
+    SpaceConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool has_value = (i + 1 < argc);
+        if (arg == "--no-gravity") {
+            config.gravity_enabled = false;
+        } else if (arg == "--no-borders") {
+            config.borders_enabled = false;
+        } else if (arg == "--sleep") {
+            config.sleep_enabled = true;
+        } else if (arg == "--merge") {
+            config.collision_mode = COLLISION_MODE_MERGE;
+        } else if (arg == "--coef-res" && has_value) {
+            config.coef_res = atof(argv[++i]);
+        } else if (arg == "--border-friction" && has_value) {
+            config.border_friction = atof(argv[++i]);
+        } else if (arg == "--global-top-mass" && has_value) {
+            config.global_top_mass = atof(argv[++i]);
+        } else if (arg == "--global-right-mass" && has_value) {
+            config.global_right_mass = atof(argv[++i]);
+        }
+        // Other arguments are left for glutInit()
+    }
+    cout << "gravity: " << (config.gravity_enabled ? "on" : "off") <<
+            ", collisions: " << (config.collision_mode == COLLISION_MODE_MERGE ? "merge" : "bounce") <<
+            ", borders: " << (config.borders_enabled ? "on" : "off") <<
+            ", external fields: " << (config.external_fields_enabled() ? "on" : "off") << endl;
+    return config;
+}
+
+// Background checkpoints from command line, e.g.: --checkpoint-every 1000 --checkpoint-keep 3 --checkpoint-prefix run1
+CheckpointConfig parse_checkpoint_config(int argc, char * argv[]) {
+    CheckpointConfig checkpoints;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool has_value = (i + 1 < argc);
+        if (arg == "--checkpoint-every" && has_value) {
+            checkpoints.interval_steps = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--checkpoint-keep" && has_value) {
+            checkpoints.retention = static_cast<unsigned int>(strtoul(argv[++i], NULL, 10));
+        } else if (arg == "--checkpoint-prefix" && has_value) {
+            checkpoints.prefix = argv[++i];
+        }
+    }
+    if (checkpoints.interval_steps > 0)
+        cout << "checkpoints: every " << checkpoints.interval_steps << " steps, " << checkpoints.retention << " kept" << endl;
+    return checkpoints;
+}
+
+// Trajectory recording from command line, e.g.: --record run1.sst --record-every 10 --record-vel --record-policy drop
+// Returns false if no --record given
+bool parse_trajectory_config(int argc, char * argv[], std::string& path, TrajectoryConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool has_value = (i + 1 < argc);
+        if (arg == "--record" && has_value) {
+            path = argv[++i];
+        } else if (arg == "--record-every" && has_value) {
+            config.interval_steps = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--record-vel") {
+            config.fields |= TRAJECTORY_FIELD_VELOCITY;
+        } else if (arg == "--record-quantum" && has_value) {
+            config.pos_quantum_m = atof(argv[++i]);
+        } else if (arg == "--record-policy" && has_value) {
+            std::string policy(argv[++i]);
+            if (policy == "block")
+                config.policy = TRAJECTORY_BLOCK;
+            else if (policy == "drop")
+                config.policy = TRAJECTORY_DROP;
+            else if (policy == "decimate")
+                config.policy = TRAJECTORY_DECIMATE;
+            else
+                cout << "Unknown record policy: " << policy << endl;
+        }
+    }
+    return !path.empty();
+}
+
+// Generated initial scene from command line, e.g.: --scene plummer --scene-count 100000 --seed 7
+// Returns false if no --scene given
+bool parse_scene_params(int argc, char * argv[], SceneParams& params) {
+    bool has_scene = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool has_value = (i + 1 < argc);
+        if (arg == "--scene" && has_value) {
+            std::string kind(argv[++i]);
+            has_scene = true;
+            if (kind == "disk") {
+                params.kind = SCENE_DISK;
+            } else if (kind == "plummer") {
+                params.kind = SCENE_PLUMMER;
+            } else if (kind == "belt") {
+                params.kind = SCENE_BELT;
+            } else if (kind == "field") {
+                params.kind = SCENE_RANDOM_FIELD;
+            } else {
+                cout << "Unknown scene \"" << kind << "\" (disk, plummer, belt, field), using default scene" << endl;
+                has_scene = false;
+            }
+        } else if (arg == "--scene-count" && has_value) {
+            params.count = strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--seed" && has_value) {
+            params.seed = strtoull(argv[++i], NULL, 10);
+        }
+    }
+    return has_scene;
+}
+
 //int main(int argc, const char * argv[])
 int main(int argc, char * argv[])
 {
@@ -878,13 +1212,110 @@ int main(int argc, char * argv[])
     // Seed for random values
     srand(static_cast<unsigned int>(time(NULL)));
 
-    // SimpleSpace testing begin
-    double dist = 4e7;
-    pSimpleSpace->add_planet(Planet(Vector2d(0, 0), Vector2d(0, 0), 1e30, 3e6, getRandomColor()));
-    pSimpleSpace->add_planet(Planet(Vector2d( dist/4,   0), Vector2d(0,   -2e6), 1e15, 1e6, getRandomColor()));
-    pSimpleSpace->add_planet(Planet(Vector2d(-dist/4,   0), Vector2d(0,    2e6), 1e15, 1e6, getRandomColor()));
-    pSimpleSpace->add_planet(Planet(Vector2d(0,  dist/1.5), Vector2d(-1.5e6, 0), 1e15, 1e6, getRandomColor()));
-    pSimpleSpace->add_planet(Planet(Vector2d(0, -dist/1.5), Vector2d( 1.5e6, 0), 1e15, 1e6, getRandomColor()));
+    pSimpleSpace->set_config(parse_space_config(argc, argv));
+    pSimpleSpace->set_checkpoints(parse_checkpoint_config(argc, argv));
+
+    // Scene file from command line replaces any other scene, checkpoint also restores engine state
+    bool loaded = false;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--load-scene") {
+            scene_file_path = argv[i + 1];
+            loaded = load_scene();
+        } else if (std::string(argv[i]) == "--restore") {
+            SceneFileStatus status = pSimpleSpace->restore_checkpoint(argv[i + 1]);
+            cout << "Restore from " << argv[i + 1] << ": " << scene_file_status_str(status) << endl;
+            loaded = (status == SCENE_FILE_OK);
+        }
+    }
+
+    SceneParams scene;
+    if (loaded) {
+        cout << "Scene: " << pSimpleSpace->get_planets_count() << " bodies from file" << endl;
+    } else if (parse_scene_params(argc, argv, scene)) {
+        // Disk and belt orbit central planet, which isn't part of generated scene
+        if (scene.kind == SCENE_DISK || scene.kind == SCENE_BELT)
+            pSimpleSpace->add_planet(Planet(scene.center, scene.center_vel, scene.central_mass_kg, 3e6, getRandomColor()));
+        pSimpleSpace->add_scene(scene);
+        cout << "Scene: " << scene.count << " bodies, seed " << scene.seed << endl;
+    } else {
+        // SimpleSpace testing begin
+        double dist = 4e7;
+        pSimpleSpace->add_planet(Planet(Vector2d(0, 0), Vector2d(0, 0), 1e30, 3e6, getRandomColor()));
+        pSimpleSpace->add_planet(Planet(Vector2d( dist/4,   0), Vector2d(0,   -2e6), 1e15, 1e6, getRandomColor()));
+        pSimpleSpace->add_planet(Planet(Vector2d(-dist/4,   0), Vector2d(0,    2e6), 1e15, 1e6, getRandomColor()));
+        pSimpleSpace->add_planet(Planet(Vector2d(0,  dist/1.5), Vector2d(-1.5e6, 0), 1e15, 1e6, getRandomColor()));
+        pSimpleSpace->add_planet(Planet(Vector2d(0, -dist/1.5), Vector2d( 1.5e6, 0), 1e15, 1e6, getRandomColor()));
+    }
+
+    // Input journal: recorded session is reproduced first, new journal starts from what's there
+    unsigned long replay_until = ULONG_MAX;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--replay-until")
+            replay_until = strtoul(argv[i + 1], NULL, 10);
+    }
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--replay-journal") {
+            JournalReplayStats stats;
+            JournalStatus status = pSimpleSpace->replay_journal(argv[i + 1], replay_until, &stats);
+            cout << "Journal " << argv[i + 1] << " replayed to step " << pSimpleSpace->get_steps_count() << ": " <<
+                    journal_status_str(status) << " (" << stats.events << " events, " << stats.checks << " checks)" << endl;
+        }
+    }
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--journal") {
+            JournalStatus status = pSimpleSpace->start_journal(argv[i + 1]);
+            cout << "Journal " << argv[i + 1] << ": " << journal_status_str(status) << endl;
+        }
+    }
+
+    // Replay shows recorded trajectory instead of simulation
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--replay") {
+            pReplay.reset(new TrajectoryPlayer);
+            if (pReplay->open(argv[i + 1])) {
+                replay_step = pReplay->first_step();
+                cout << "Replay of " << argv[i + 1] << ": " << pReplay->frames_count() << " frames, steps " <<
+                        pReplay->first_step() << "-" << pReplay->last_step() << endl;
+            } else {
+                cout << "Replay of " << argv[i + 1] << ": not a trajectory file" << endl;
+                pReplay.reset();
+            }
+        }
+    }
+
+    std::string trajectory_path;
+    TrajectoryConfig trajectory;
+    if (parse_trajectory_config(argc, argv, trajectory_path, trajectory)) {
+        bool ok = pSimpleSpace->start_recording(trajectory_path.c_str(), trajectory);
+        cout << "Recording to " << trajectory_path << ": " << (ok ? "started" : "failed") << endl;
+    }
+
+    // Diagnostics: shown on screen, or printed by headless run of given steps number
+    unsigned long headless_steps = 0;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--diagnostics") {
+            diagnostics_interval = strtoul(argv[i + 1], NULL, 10);
+            pSimpleSpace->set_diagnostics_interval(diagnostics_interval);
+        } else if (std::string(argv[i]) == "--headless") {
+            headless_steps = strtoul(argv[i + 1], NULL, 10);
+        }
+    }
+    if (headless_steps > 0) {
+        if (pSimpleSpace->get_diagnostics_interval() == 0)
+            pSimpleSpace->set_diagnostics_interval(100);
+        unsigned long printed_step = ULONG_MAX;
+        for (unsigned long k = 0; k < headless_steps; ++k) {
+            pSimpleSpace->move_one_step();
+            std::shared_ptr<const PlanetsSnapshot> snapshot = pSimpleSpace->get_snapshot();
+            if (snapshot->diagnostics.valid && (snapshot->diagnostics.step != printed_step)) {
+                printed_step = snapshot->diagnostics.step;
+                cout << diagnostics_str(snapshot->diagnostics) << endl;
+            }
+        }
+        pSimpleSpace->stop_recording();
+        pSimpleSpace->stop_journal();
+        return 0;
+    }
 
     pControlsLeft->add_button_boolean(20, 20,           // x, y
                                       160, 30,           // w, h
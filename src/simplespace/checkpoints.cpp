@@ -0,0 +1,128 @@
+//
+//  checkpoints.cpp
+//  simple-space
+//
+
+#include "checkpoints.h"
+
+#include <stdio.h> // snprintf(), remove()
+
+#if defined(__APPLE__) || defined(__linux__)
+    #include <unistd.h>   // fork(), write(), close(), _exit()
+    #include <fcntl.h>    // open()
+    #include <sys/wait.h> // waitpid()
+    #include <errno.h>    // EINTR
+    #define CHECKPOINTS_FORK 1
+#else
+    #define CHECKPOINTS_FORK 0
+#endif
+
+#if CHECKPOINTS_FORK
+// Runs in forked child: other threads of parent (workers, UI) don't exist there and may
+// have held malloc or stdio locks at fork(), so only async-signal-safe calls are made
+static bool write_image(const char* tmp_path, const char* path, const unsigned char* data, size_t size) {
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    bool ok = true;
+    while (ok && size > 0) {
+        ssize_t ret = write(fd, data, size);
+        if (ret > 0) {
+            data += ret;
+            size -= static_cast<size_t>(ret);
+        } else {
+            ok = (ret < 0) && (errno == EINTR);
+        }
+    }
+    ok = (close(fd) == 0) && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return false;
+    }
+    return true;
+}
+#endif
+
+Checkpointer::~Checkpointer() {
+    wait();
+}
+
+void Checkpointer::configure(const CheckpointConfig& config) {
+    _config = config;
+}
+
+void Checkpointer::finish(const std::string& path, bool ok) {
+    if (!ok) {
+        ++_stats.failed;
+        return;
+    }
+    ++_stats.written;
+    _stats.last_path = path;
+    _kept.push_back(path);
+    while (_kept.size() > _config.retention) {
+        remove(_kept.front().c_str());
+        _kept.pop_front();
+    }
+}
+
+void Checkpointer::start(unsigned long steps_count, const std::vector<Planet>& planets, const ParticleBelt& belt,
+                         const SceneEngineState& engine) {
+    if (!_writers.empty()) {
+        ++_stats.skipped; // Disk is slower than checkpoints interval
+        return;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "_%09lu.ssc", steps_count);
+    std::string path = _config.prefix + name;
+    ++_stats.started;
+
+#if CHECKPOINTS_FORK
+    // Scene is serialized before fork(), so that child neither allocates nor uses stdio;
+    // simulation pauses for this copy (no disk access) and fork() itself
+    make_scene_file_image(planets, belt, &engine, _image);
+    const std::string tmp_path = path + ".tmp";
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Child leaves with _exit(): no destructors, as there are no pool threads to join here
+        _exit(write_image(tmp_path.c_str(), path.c_str(), _image.data(), _image.size()) ? 0 : 1);
+    }
+    if (pid > 0) {
+        Writer writer;
+        writer.pid = pid;
+        writer.path = path;
+        _writers.push_back(writer);
+        return;
+    }
+    // No fork: written in place
+#endif
+    finish(path, write_scene_file(path.c_str(), planets, belt, &engine) == SCENE_FILE_OK);
+}
+
+void Checkpointer::poll() {
+#if CHECKPOINTS_FORK
+    for (size_t i = 0; i < _writers.size(); ) {
+        int status = 0;
+        pid_t ret = waitpid(static_cast<pid_t>(_writers[i].pid), &status, WNOHANG);
+        if (ret == 0) {
+            ++i; // Still writing
+            continue;
+        }
+        finish(_writers[i].path, (ret > 0) && WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+        _writers.erase(_writers.begin() + i);
+    }
+#endif
+}
+
+void Checkpointer::wait() {
+#if CHECKPOINTS_FORK
+    for (size_t i = 0; i < _writers.size(); ++i) {
+        int status = 0;
+        pid_t ret;
+        do {
+            ret = waitpid(static_cast<pid_t>(_writers[i].pid), &status, 0);
+        } while ((ret < 0) && (errno == EINTR));
+        finish(_writers[i].path, (ret > 0) && WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+    }
+    _writers.clear();
+#endif
+}
@@ -0,0 +1,41 @@
+//
+//  command_queue.cpp
+//  simple-space
+//
+
+#include "command_queue.h"
+
+CommandQueue::CommandQueue() : _head(&_stub), _tail(&_stub) {}
+
+CommandQueue::~CommandQueue() {
+    SpaceCommand cmd;
+    while (pop(cmd)) {}
+    if (_tail != &_stub)
+        delete _tail;
+}
+
+void CommandQueue::push(const SpaceCommand& cmd) {
+    Node* node = new Node(cmd);
+    // Publish node as new head, then link previous head to it.
+    // Between these two steps consumer just sees queue shorter by one node.
+    Node* prev = _head.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+}
+
+bool CommandQueue::pop(SpaceCommand& cmd) {
+    Node* tail = _tail;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (next == NULL)
+        return false;
+
+    // Consumed node becomes new tail (dummy), previous tail is released
+    cmd = next->cmd;
+    _tail = next;
+    if (tail != &_stub)
+        delete tail;
+    return true;
+}
+
+bool CommandQueue::empty() const {
+    return _tail->next.load(std::memory_order_acquire) == NULL;
+}
@@ -0,0 +1,116 @@
+//
+//  diagnostics.cpp
+//  simple-space
+//
+
+#include "diagnostics.h"
+#include <algorithm>
+#include <string.h> // memset()
+
+#if REPRODUCIBLE_SUMS
+// Neumaier's compensated sum: rounding error of every addition is kept in c,
+// so error of total doesn't grow with terms number
+struct DiagnosticsSum {
+    double sum;
+    double c;
+
+    void add(double value) {
+        const double t = sum + value;
+        c += (fabs(sum) >= fabs(value)) ? (sum - t) + value : (value - t) + sum;
+        sum = t;
+    }
+    void add(const DiagnosticsSum& other) {
+        add(other.sum);
+        c += other.c;
+    }
+    double value() const {return sum + c;}
+};
+#else
+struct DiagnosticsSum {
+    double sum;
+    double c; // Unused
+
+    void add(double value) {sum += value;}
+    void add(const DiagnosticsSum& other) {sum += other.sum;}
+    double value() const {return sum;}
+};
+#endif
+
+struct DiagnosticsSums {
+    DiagnosticsSum kinetic;
+    DiagnosticsSum potential;
+    DiagnosticsSum px;
+    DiagnosticsSum py;
+    DiagnosticsSum angular;
+
+    void add(const DiagnosticsSums& other) {
+        kinetic.add(other.kinetic);
+        potential.add(other.potential);
+        px.add(other.px);
+        py.add(other.py);
+        angular.add(other.angular);
+    }
+};
+
+struct DiagnosticsJob {
+    const Planet* planets;
+    size_t count;
+    const double* potential; // NULL - motion sums
+    DiagnosticsSums* chunks;
+};
+
+static void diagnostics_task(void* arg, unsigned int task_idx, unsigned int worker_idx) {
+    DiagnosticsJob& job = *static_cast<DiagnosticsJob*>(arg);
+    const size_t begin = task_idx * size_t(DIAGNOSTICS_CHUNK);
+    const size_t end = std::min(begin + DIAGNOSTICS_CHUNK, job.count);
+    DiagnosticsSums sums;
+    memset(&sums, 0, sizeof(sums));
+    for (size_t i = begin; i < end; ++i) {
+        const Planet& pl = job.planets[i];
+        if (job.potential) {
+            sums.potential.add((pl.test_particle ? 1.0 : 0.5) * pl.mass_kg * job.potential[i]);
+        } else {
+            sums.kinetic.add(0.5 * pl.mass_kg * (pl.vel.x * pl.vel.x + pl.vel.y * pl.vel.y));
+            sums.px.add(pl.mass_kg * pl.vel.x);
+            sums.py.add(pl.mass_kg * pl.vel.y);
+            sums.angular.add(pl.mass_kg * (pl.pos.x * pl.vel.y - pl.pos.y * pl.vel.x));
+        }
+    }
+    job.chunks[task_idx] = sums;
+}
+
+static DiagnosticsSums sum_chunks(WorkerPool& pool, const std::vector<Planet>& planets, const double* potential) {
+    const size_t chunks_count = (planets.size() + DIAGNOSTICS_CHUNK - 1) / DIAGNOSTICS_CHUNK;
+    std::vector<DiagnosticsSums> chunks(std::max<size_t>(chunks_count, 1));
+    memset(chunks.data(), 0, sizeof(DiagnosticsSums));
+    DiagnosticsJob job;
+    job.planets = planets.data();
+    job.count = planets.size();
+    job.potential = potential;
+    job.chunks = chunks.data();
+    pool.run(diagnostics_task, &job, static_cast<unsigned int>(chunks_count));
+
+#if REPRODUCIBLE_SUMS
+    // Pairwise tree over chunks, shape depends on chunks number only
+    for (size_t stride = 1; stride < chunks_count; stride *= 2) {
+        for (size_t c = 0; c + stride < chunks_count; c += 2 * stride)
+            chunks[c].add(chunks[c + stride]);
+    }
+#else
+    for (size_t c = 1; c < chunks_count; ++c)
+        chunks[0].add(chunks[c]);
+#endif
+    return chunks[0];
+}
+
+void measure_motion(WorkerPool& pool, const std::vector<Planet>& planets, SpaceDiagnostics& diagnostics) {
+    DiagnosticsSums total = sum_chunks(pool, planets, NULL);
+    diagnostics.bodies = planets.size();
+    diagnostics.kinetic_j = total.kinetic.value();
+    diagnostics.momentum = Vector2d(total.px.value(), total.py.value());
+    diagnostics.angular_momentum = total.angular.value();
+}
+
+double measure_potential_energy(WorkerPool& pool, const std::vector<Planet>& planets, const double* potential) {
+    return sum_chunks(pool, planets, potential).potential.value();
+}
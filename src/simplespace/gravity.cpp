@@ -0,0 +1,516 @@
+//
+//  gravity.cpp
+//  simple-space
+//
+
+#include "gravity.h"
+
+#include <algorithm> // std::sort
+
+#include "simd_pack.h"
+
+#define SYMMETRIC_TILE_SIZE     128 // Bodies per tile: two tiles of x, y, mass, rad fit L1
+#define TEST_PARTICLES_CHUNK    512 // Test particles per stream task (their accumulators stay in L1)
+#define TILED_TARGETS_BLOCK     1024 // Targets per task: x, y, rad, soft and sums (48 KB) stay in L2
+#define TILED_SOURCES_BLOCK     256  // Sources per block: x, y, mass, rad, soft (10 KB) stay in L1
+
+#if defined(__GNUC__)
+    #define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+    #define PREFETCH(addr) ((void)0)
+#endif
+
+// Bodies arrays in kernel scalar type (double ones are used in place, float ones are copies)
+template <class T>
+struct KernelBodies {
+    const T* x;
+    const T* y;
+    const T* mass;
+    const T* rad;
+    const T* soft;
+};
+
+struct SymmetricGravitySolver::Job {
+    SymmetricGravitySolver* solver;
+    size_t count;
+    size_t massive_count;
+    size_t sleeping_count;
+    const void* kernel_bodies; // KernelBodies<T> of task scalar type
+    Physics::SofteningType softening;
+    Vector2d* acc;
+    double* potential;
+    double skin_dist;
+    size_t tiles_count;  // Real tiles
+    size_t slots_count;  // Tiles rounded up to even number (last one may be dummy)
+    size_t round;        // Round of tournament; round == slots_count - 1 means diagonal tiles
+};
+
+SymmetricGravitySolver::SymmetricGravitySolver(WorkerPool& pool) : _pool(pool), _scratch(64 * 1024) {
+    for (unsigned int i = 0; i < _pool.workersNum(); ++i)
+        _worker_scratch.push_back(new ScratchArena(64 * 1024));
+    _worker_candidates.resize(_worker_scratch.size());
+}
+
+SymmetricGravitySolver::~SymmetricGravitySolver() {
+    for (size_t i = 0; i < _worker_scratch.size(); ++i)
+        delete _worker_scratch[i];
+}
+
+// Accumulates interactions of tiles [ia, ia_end) x [jb, jb_end); same tiles mean diagonal one.
+// Pairs of sleeping bodies [0, sleeping_count) are skipped (ia <= jb, so it's a loop bound).
+// Pair terms are computed in scalar type T, sums are accumulated in double.
+// Inner loop has no branches except collision candidates check (rarely taken).
+// Potential (diagnostics steps only) is compile-time option, so other steps don't pay for it.
+template <class T, Physics::SofteningType S, bool Potential>
+static void symmetric_tile_pair(const KernelBodies<T>& bodies, Vector2d* acc, double* potential, T skin_dist,
+                                size_t ia, size_t ia_end, size_t jb, size_t jb_end, size_t sleeping_count,
+                                ScratchBuffer<CollisionPair>& candidates) {
+    const bool diagonal = (ia == jb);
+    for (size_t i = ia; i < ia_end; ++i) {
+        const T xi = bodies.x[i];
+        const T yi = bodies.y[i];
+        const T mi = bodies.mass[i];
+        const T ri = bodies.rad[i];
+        const T si = bodies.soft[i];
+        double axi = 0;
+        double ayi = 0;
+        double poti = 0;
+        size_t j_begin = diagonal ? i + 1 : jb;
+        if (i < sleeping_count)
+            j_begin = std::max(j_begin, sleeping_count);
+        for (size_t j = j_begin; j < jb_end; ++j) {
+            T dx = bodies.x[j] - xi;
+            T dy = bodies.y[j] - yi;
+            T dist2 = dx * dx + dy * dy;
+            // G / r^3 (softened), same direction vector (dx, dy) serves both bodies.
+            // Softening type is template parameter, so its switch is resolved at compile time
+            T g = T(CONST_G) * Physics::SoftenedInvDist3<T>(dist2, std::max(si, bodies.soft[j]), S);
+            T gmj = g * bodies.mass[j];
+            T gmi = g * mi;
+            axi += gmj * dx;
+            ayi += gmj * dy;
+            acc[j].x -= gmi * dx;
+            acc[j].y -= gmi * dy;
+            if (Potential) {
+                T psi = T(CONST_G) * Physics::SoftenedInvDist<T>(dist2, std::max(si, bodies.soft[j]), S);
+                poti -= psi * bodies.mass[j];
+                potential[j] -= psi * mi;
+            }
+
+            T reach = ri + bodies.rad[j] + skin_dist;
+            if (dist2 < reach * reach)
+                candidates.push_back((i < j) ? CollisionPair(i, j) : CollisionPair(j, i));
+        }
+        acc[i].x += axi;
+        acc[i].y += ayi;
+        if (Potential)
+            potential[i] += poti;
+    }
+}
+
+// Accumulates gravity of sources [0, sources_count) on test particles [begin, end).
+// Sources are outer loop and particles stream in inner one: its iterations are independent
+// (no reduction, no branches, no writes to sources), so compiler vectorizes it.
+template <class T, Physics::SofteningType S, bool Potential>
+static void test_particles_stream(const KernelBodies<T>& bodies, size_t sources_count,
+                                  size_t begin, size_t end, double* ax, double* ay, double* pot) {
+    const size_t count = end - begin;
+    const T* x = bodies.x + begin;
+    const T* y = bodies.y + begin;
+    const T* soft = bodies.soft + begin;
+    for (size_t j = 0; j < sources_count; ++j) {
+        const T xj = bodies.x[j];
+        const T yj = bodies.y[j];
+        const T gmj = T(CONST_G) * bodies.mass[j];
+        const T sj = bodies.soft[j];
+        for (size_t i = 0; i < count; ++i) {
+            T dx = xj - x[i];
+            T dy = yj - y[i];
+            T g = gmj * Physics::SoftenedInvDist3<T>(dx * dx + dy * dy, std::max(soft[i], sj), S);
+            ax[i] += g * dx;
+            ay[i] += g * dy;
+            if (Potential)
+                pot[i] -= gmj * Physics::SoftenedInvDist<T>(dx * dx + dy * dy, std::max(soft[i], sj), S);
+        }
+    }
+}
+
+template <class T, Physics::SofteningType S, bool Potential>
+void SymmetricGravitySolver::test_particles_task(void* arg, unsigned int task_idx, unsigned int worker_idx) {
+    Job& job = *static_cast<Job*>(arg);
+    const size_t begin = job.massive_count + task_idx * TEST_PARTICLES_CHUNK;
+    const size_t end = std::min(begin + TEST_PARTICLES_CHUNK, job.count);
+
+    double ax[TEST_PARTICLES_CHUNK] = {0};
+    double ay[TEST_PARTICLES_CHUNK] = {0};
+    double pot[Potential ? TEST_PARTICLES_CHUNK : 1] = {0};
+    test_particles_stream<T, S, Potential>(*static_cast<const KernelBodies<T>*>(job.kernel_bodies), job.massive_count,
+                                           begin, end, ax, ay, pot);
+    for (size_t i = begin; i < end; ++i) {
+        job.acc[i].x += ax[i - begin];
+        job.acc[i].y += ay[i - begin];
+        if (Potential)
+            job.potential[i] += pot[i - begin];
+    }
+}
+
+template <class T, Physics::SofteningType S, bool Potential>
+void SymmetricGravitySolver::tile_pair_task(void* arg, unsigned int task_idx, unsigned int worker_idx) {
+    Job& job = *static_cast<Job*>(arg);
+    const size_t n = job.massive_count;
+    ScratchBuffer<CollisionPair>& candidates = job.solver->_worker_candidates[worker_idx];
+
+    size_t tile_a, tile_b;
+    if (job.round == job.slots_count - 1) {
+        tile_a = tile_b = task_idx;
+    } else {
+        // Circle method: slot (slots - 1) is fixed, others rotate by round
+        const size_t rotating = job.slots_count - 1;
+        if (task_idx == 0) {
+            tile_a = job.slots_count - 1;
+            tile_b = job.round;
+        } else {
+            tile_a = (job.round + task_idx) % rotating;
+            tile_b = (job.round + rotating - task_idx) % rotating;
+        }
+        if ((tile_a >= job.tiles_count) || (tile_b >= job.tiles_count))
+            return; // Pair with dummy tile
+        if (tile_a > tile_b)
+            std::swap(tile_a, tile_b);
+    }
+
+    size_t ia = tile_a * SYMMETRIC_TILE_SIZE;
+    size_t jb = tile_b * SYMMETRIC_TILE_SIZE;
+    symmetric_tile_pair<T, S, Potential>(*static_cast<const KernelBodies<T>*>(job.kernel_bodies), job.acc, job.potential, T(job.skin_dist),
+                                         ia, std::min(ia + SYMMETRIC_TILE_SIZE, n),
+                                         jb, std::min(jb + SYMMETRIC_TILE_SIZE, n),
+                                         job.sleeping_count, candidates);
+}
+
+template <class T, bool Potential>
+void SymmetricGravitySolver::select_tasks(Physics::SofteningType softening, wTaskFunc& tile_pair, wTaskFunc& test_particles) {
+    switch (softening) {
+        case Physics::SOFTENING_PLUMMER:
+            tile_pair = SymmetricGravitySolver::tile_pair_task<T, Physics::SOFTENING_PLUMMER, Potential>;
+            test_particles = SymmetricGravitySolver::test_particles_task<T, Physics::SOFTENING_PLUMMER, Potential>;
+            break;
+        case Physics::SOFTENING_SPLINE:
+            tile_pair = SymmetricGravitySolver::tile_pair_task<T, Physics::SOFTENING_SPLINE, Potential>;
+            test_particles = SymmetricGravitySolver::test_particles_task<T, Physics::SOFTENING_SPLINE, Potential>;
+            break;
+        default:
+            tile_pair = SymmetricGravitySolver::tile_pair_task<T, Physics::SOFTENING_NONE, Potential>;
+            test_particles = SymmetricGravitySolver::test_particles_task<T, Physics::SOFTENING_NONE, Potential>;
+            break;
+    }
+}
+
+bool SymmetricGravitySolver::compute(const GravityBodies& bodies,
+                                     Vector2d* acc,
+                                     double* potential,
+                                     double skin_dist,
+                                     ScratchBuffer<CollisionPair>& candidates) {
+    if (bodies.count < 2)
+        return true;
+
+    for (size_t w = 0; w < _worker_scratch.size(); ++w) {
+        _worker_scratch[w]->reset();
+        _worker_candidates[w].init(*_worker_scratch[w], 256);
+    }
+
+    Job job;
+    job.solver = this;
+    job.count = bodies.count;
+    job.massive_count = bodies.massive_count;
+    job.sleeping_count = bodies.sleeping_count;
+    job.softening = bodies.softening;
+    job.acc = acc;
+    job.potential = potential;
+    job.skin_dist = skin_dist;
+    job.tiles_count = (bodies.massive_count + SYMMETRIC_TILE_SIZE - 1) / SYMMETRIC_TILE_SIZE;
+    job.slots_count = job.tiles_count + (job.tiles_count % 2);
+
+    wTaskFunc task, stream_task;
+    KernelBodies<double> bodies_double;
+    KernelBodies<float> bodies_float;
+    if (bodies.precision == GRAVITY_PRECISION_MIXED) {
+        // Float copies, taken relative to bounding box center, so that float keeps
+        // as much of the distances resolution as it can
+        _scratch.reset();
+        double min_x = bodies.x[0], max_x = bodies.x[0], min_y = bodies.y[0], max_y = bodies.y[0];
+        for (size_t i = 1; i < bodies.count; ++i) {
+            min_x = std::min(min_x, bodies.x[i]);
+            max_x = std::max(max_x, bodies.x[i]);
+            min_y = std::min(min_y, bodies.y[i]);
+            max_y = std::max(max_y, bodies.y[i]);
+        }
+        const double center_x = (min_x + max_x) / 2;
+        const double center_y = (min_y + max_y) / 2;
+        float* x = _scratch.allocate_array<float>(bodies.count);
+        float* y = _scratch.allocate_array<float>(bodies.count);
+        float* mass = _scratch.allocate_array<float>(bodies.count);
+        float* rad = _scratch.allocate_array<float>(bodies.count);
+        float* soft = _scratch.allocate_array<float>(bodies.count);
+        for (size_t i = 0; i < bodies.count; ++i) {
+            x[i] = static_cast<float>(bodies.x[i] - center_x);
+            y[i] = static_cast<float>(bodies.y[i] - center_y);
+            mass[i] = static_cast<float>(bodies.mass[i]);
+            rad[i] = static_cast<float>(bodies.rad[i]);
+            soft[i] = static_cast<float>(bodies.soft[i]);
+        }
+        bodies_float.x = x;
+        bodies_float.y = y;
+        bodies_float.mass = mass;
+        bodies_float.rad = rad;
+        bodies_float.soft = soft;
+        job.kernel_bodies = &bodies_float;
+        if (potential)
+            select_tasks<float, true>(bodies.softening, task, stream_task);
+        else
+            select_tasks<float, false>(bodies.softening, task, stream_task);
+    } else {
+        bodies_double.x = bodies.x;
+        bodies_double.y = bodies.y;
+        bodies_double.mass = bodies.mass;
+        bodies_double.rad = bodies.rad;
+        bodies_double.soft = bodies.soft;
+        job.kernel_bodies = &bodies_double;
+        if (potential)
+            select_tasks<double, true>(bodies.softening, task, stream_task);
+        else
+            select_tasks<double, false>(bodies.softening, task, stream_task);
+    }
+
+    // Off-diagonal rounds, then one round of diagonal tiles; pool.run() is a barrier between them
+    for (job.round = 0; job.round + 1 < job.slots_count; ++job.round)
+        _pool.run(task, &job, static_cast<unsigned int>(job.slots_count / 2));
+    _pool.run(task, &job, static_cast<unsigned int>(job.tiles_count));
+
+    const size_t test_count = bodies.count - bodies.massive_count;
+    _pool.run(stream_task, &job, static_cast<unsigned int>((test_count + TEST_PARTICLES_CHUNK - 1) / TEST_PARTICLES_CHUNK));
+
+    // Merge candidates in fixed (sorted) order, independent of which worker found them
+    for (size_t w = 0; w < _worker_candidates.size(); ++w) {
+        for (size_t k = 0; k < _worker_candidates[w].size(); ++k)
+            candidates.push_back(_worker_candidates[w][k]);
+    }
+    std::sort(candidates.data(), candidates.data() + candidates.size());
+    return (test_count == 0);
+}
+
+struct TiledGravitySolver::Job {
+    TiledGravitySolver* solver;
+    const GravityBodies* bodies;
+    Vector2d* acc;
+    double* potential;
+    double skin_dist;
+};
+
+TiledGravitySolver::TiledGravitySolver(WorkerPool& pool) : _pool(pool) {
+    for (unsigned int i = 0; i < _pool.workersNum(); ++i)
+        _worker_scratch.push_back(new ScratchArena(64 * 1024));
+    _worker_candidates.resize(_worker_scratch.size());
+}
+
+TiledGravitySolver::~TiledGravitySolver() {
+    for (size_t i = 0; i < _worker_scratch.size(); ++i)
+        delete _worker_scratch[i];
+}
+
+// Prefetches all arrays of sources block (one cache line of each per 8 doubles)
+static inline void prefetch_sources(const GravityBodies& bodies, size_t begin, size_t end) {
+    for (size_t j = begin; j < end; j += 8) {
+        PREFETCH(bodies.x + j);
+        PREFETCH(bodies.y + j);
+        PREFETCH(bodies.mass + j);
+        PREFETCH(bodies.rad + j);
+        PREFETCH(bodies.soft + j);
+    }
+}
+
+// Targets [ib, ib_end) against sources [jb, jb_end), targets by packs of V::width.
+// Newton's (eps = 0) and Plummer softening only; pair terms are computed the same way by
+// every pack width. Target itself (if in block) adds exact zero: dx = dy = 0 and kernel is finite.
+// Sleeping bodies are not targets, so their pairs with awake ones are candidates by source side.
+// Its softened potential isn't zero, so that lane is cleared (potential steps only).
+// Returns end of processed targets (pack width multiple).
+template <class V, bool Plummer, bool Potential>
+static size_t tiled_block_packed(const GravityBodies& bodies, size_t ib, size_t ib_end, size_t jb, size_t jb_end,
+                                 double skin_dist, double* ax, double* ay, double* pot,
+                                 ScratchBuffer<CollisionPair>& candidates) {
+    size_t i = ib;
+    for (; i + V::width <= ib_end; i += V::width) {
+        const V xi = V::load(bodies.x + i);
+        const V yi = V::load(bodies.y + i);
+        const V ri = V::load(bodies.rad + i);
+        const V si = V::load(bodies.soft + i);
+        V axi(0.0);
+        V ayi(0.0);
+        V poti(0.0);
+        for (size_t j = jb; j < jb_end; ++j) {
+            V dx = V(bodies.x[j]) - xi;
+            V dy = V(bodies.y[j]) - yi;
+            V dist2 = dx * dx + dy * dy;
+            V soft2 = dist2;
+            if (Plummer) {
+                V eps = max(si, V(bodies.soft[j]));
+                soft2 = dist2 + eps * eps;
+            }
+            V gmj = div_positive(V(CONST_G * bodies.mass[j]), soft2 * sqrt(soft2));
+            axi = axi + gmj * dx;
+            ayi = ayi + gmj * dy;
+            if (Potential) {
+                V psi = div_positive(V(CONST_G * bodies.mass[j]), sqrt(soft2));
+                if ((j >= i) && (j < i + V::width)) {
+                    double lanes[V::width];
+                    psi.store(lanes);
+                    lanes[j - i] = 0;
+                    psi = V::load(lanes);
+                }
+                poti = poti - psi;
+            }
+
+            V reach = ri + V(bodies.rad[j] + skin_dist);
+            unsigned int close = less_mask(dist2, reach * reach);
+            if (close) {
+                for (size_t l = 0; l < V::width; ++l) {
+                    if ((close & (1u << l)) && ((j > i + l) || (j < bodies.sleeping_count)))
+                        candidates.push_back(CollisionPair(std::min(i + l, j), std::max(i + l, j)));
+                }
+            }
+        }
+        (V::load(ax + (i - ib)) + axi).store(ax + (i - ib));
+        (V::load(ay + (i - ib)) + ayi).store(ay + (i - ib));
+        if (Potential)
+            (V::load(pot + (i - ib)) + poti).store(pot + (i - ib));
+    }
+    return i;
+}
+
+// Same for any softening (spline one has branches and is not packed)
+template <Physics::SofteningType S, bool Potential>
+static void tiled_block_scalar(const GravityBodies& bodies, size_t ib, size_t ib_end, size_t jb, size_t jb_end,
+                               double skin_dist, double* ax, double* ay, double* pot,
+                               ScratchBuffer<CollisionPair>& candidates) {
+    for (size_t i = ib; i < ib_end; ++i) {
+        const double xi = bodies.x[i];
+        const double yi = bodies.y[i];
+        const double ri = bodies.rad[i];
+        const double si = bodies.soft[i];
+        double axi = 0;
+        double ayi = 0;
+        double poti = 0;
+        for (size_t j = jb; j < jb_end; ++j) {
+            double dx = bodies.x[j] - xi;
+            double dy = bodies.y[j] - yi;
+            double dist2 = dx * dx + dy * dy;
+            double gmj = CONST_G * Physics::SoftenedInvDist3<double>(dist2, std::max(si, bodies.soft[j]), S) * bodies.mass[j];
+            axi += gmj * dx;
+            ayi += gmj * dy;
+            if (Potential && (j != i))
+                poti -= CONST_G * Physics::SoftenedInvDist<double>(dist2, std::max(si, bodies.soft[j]), S) * bodies.mass[j];
+
+            double reach = ri + bodies.rad[j] + skin_dist;
+            if ((dist2 < reach * reach) && ((j > i) || (j < bodies.sleeping_count)))
+                candidates.push_back(CollisionPair(std::min(i, j), std::max(i, j)));
+        }
+        ax[i - ib] += axi;
+        ay[i - ib] += ayi;
+        if (Potential)
+            pot[i - ib] += poti;
+    }
+}
+
+template <Physics::SofteningType S, bool Potential>
+void TiledGravitySolver::targets_block_task(void* arg, unsigned int task_idx, unsigned int worker_idx) {
+    Job& job = *static_cast<Job*>(arg);
+    const GravityBodies& bodies = *job.bodies;
+    ScratchBuffer<CollisionPair>& candidates = job.solver->_worker_candidates[worker_idx];
+    const size_t ib = bodies.sleeping_count + task_idx * TILED_TARGETS_BLOCK;
+    const size_t ib_end = std::min(ib + TILED_TARGETS_BLOCK, bodies.count);
+    const size_t sources_count = bodies.massive_count;
+
+    double* ax = job.solver->_worker_scratch[worker_idx]->allocate_array<double>(TILED_TARGETS_BLOCK);
+    double* ay = job.solver->_worker_scratch[worker_idx]->allocate_array<double>(TILED_TARGETS_BLOCK);
+    std::fill(ax, ax + (ib_end - ib), 0.0);
+    std::fill(ay, ay + (ib_end - ib), 0.0);
+    double* pot = NULL;
+    if (Potential) {
+        pot = job.solver->_worker_scratch[worker_idx]->allocate_array<double>(TILED_TARGETS_BLOCK);
+        std::fill(pot, pot + (ib_end - ib), 0.0);
+    }
+
+    prefetch_sources(bodies, 0, std::min(size_t(TILED_SOURCES_BLOCK), sources_count));
+    for (size_t jb = 0; jb < sources_count; jb += TILED_SOURCES_BLOCK) {
+        const size_t jb_end = std::min(jb + TILED_SOURCES_BLOCK, sources_count);
+        prefetch_sources(bodies, jb_end, std::min(jb_end + TILED_SOURCES_BLOCK, sources_count));
+
+        if (S == Physics::SOFTENING_SPLINE) {
+            tiled_block_scalar<S, Potential>(bodies, ib, ib_end, jb, jb_end, job.skin_dist, ax, ay, pot, candidates);
+        } else {
+            const bool plummer = (S == Physics::SOFTENING_PLUMMER);
+            size_t tail = plummer ? tiled_block_packed<Double2, true, Potential>(bodies, ib, ib_end, jb, jb_end, job.skin_dist, ax, ay, pot, candidates)
+                                  : tiled_block_packed<Double2, false, Potential>(bodies, ib, ib_end, jb, jb_end, job.skin_dist, ax, ay, pot, candidates);
+            double* ax_tail = ax + (tail - ib);
+            double* ay_tail = ay + (tail - ib);
+            double* pot_tail = Potential ? pot + (tail - ib) : NULL;
+            if (plummer)
+                tiled_block_packed<Double1, true, Potential>(bodies, tail, ib_end, jb, jb_end, job.skin_dist, ax_tail, ay_tail, pot_tail, candidates);
+            else
+                tiled_block_packed<Double1, false, Potential>(bodies, tail, ib_end, jb, jb_end, job.skin_dist, ax_tail, ay_tail, pot_tail, candidates);
+        }
+    }
+
+    for (size_t i = ib; i < ib_end; ++i) {
+        job.acc[i].x += ax[i - ib];
+        job.acc[i].y += ay[i - ib];
+        if (Potential)
+            job.potential[i] += pot[i - ib];
+    }
+}
+
+bool TiledGravitySolver::compute(const GravityBodies& bodies,
+                                 Vector2d* acc,
+                                 double* potential,
+                                 double skin_dist,
+                                 ScratchBuffer<CollisionPair>& candidates) {
+    if (bodies.count < 2)
+        return true;
+
+    for (size_t w = 0; w < _worker_scratch.size(); ++w) {
+        _worker_scratch[w]->reset();
+        _worker_candidates[w].init(*_worker_scratch[w], 256);
+    }
+
+    Job job;
+    job.solver = this;
+    job.bodies = &bodies;
+    job.acc = acc;
+    job.potential = potential;
+    job.skin_dist = skin_dist;
+
+    wTaskFunc task;
+    if (potential) {
+        switch (bodies.softening) {
+            case Physics::SOFTENING_PLUMMER: task = TiledGravitySolver::targets_block_task<Physics::SOFTENING_PLUMMER, true>; break;
+            case Physics::SOFTENING_SPLINE:  task = TiledGravitySolver::targets_block_task<Physics::SOFTENING_SPLINE, true>;  break;
+            default:                         task = TiledGravitySolver::targets_block_task<Physics::SOFTENING_NONE, true>;    break;
+        }
+    } else {
+        switch (bodies.softening) {
+            case Physics::SOFTENING_PLUMMER: task = TiledGravitySolver::targets_block_task<Physics::SOFTENING_PLUMMER, false>; break;
+            case Physics::SOFTENING_SPLINE:  task = TiledGravitySolver::targets_block_task<Physics::SOFTENING_SPLINE, false>;  break;
+            default:                         task = TiledGravitySolver::targets_block_task<Physics::SOFTENING_NONE, false>;    break;
+        }
+    }
+    const size_t targets_count = bodies.count - bodies.sleeping_count;
+    _pool.run(task, &job, static_cast<unsigned int>((targets_count + TILED_TARGETS_BLOCK - 1) / TILED_TARGETS_BLOCK));
+
+    // Merge candidates in fixed (sorted) order, independent of which worker found them
+    for (size_t w = 0; w < _worker_candidates.size(); ++w) {
+        for (size_t k = 0; k < _worker_candidates[w].size(); ++k)
+            candidates.push_back(_worker_candidates[w][k]);
+    }
+    std::sort(candidates.data(), candidates.data() + candidates.size());
+    return (bodies.massive_count == bodies.count);
+}
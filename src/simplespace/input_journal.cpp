@@ -0,0 +1,404 @@
+//
+//  input_journal.cpp
+//  simple-space
+//
+
+#include "input_journal.h"
+#include "varint.h"
+
+#include <string.h> // memcpy(), memcmp(), memset(), strncpy()
+
+#define JOURNAL_PLANET_TEST_PARTICLE 0x01
+#define JOURNAL_PLANET_SLEEPING      0x02
+
+const char* journal_status_str(JournalStatus status) {
+    switch (status) {
+        case JOURNAL_OK:               return "ok";
+        case JOURNAL_IO_ERROR:         return "i/o error";
+        case JOURNAL_BAD_FORMAT:       return "bad format";
+        case JOURNAL_DIVERGED:         return "diverged from recorded session";
+    }
+    return "unknown";
+}
+
+static inline uint64_t hash_mix(uint64_t hash, uint64_t value) {
+    hash ^= value;
+    hash *= 0x100000001B3ULL; // FNV-1a prime, word at a time
+    return hash ^ (hash >> 29);
+}
+
+static inline uint64_t double_bits(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+uint64_t journal_state_hash(const std::vector<Planet>& planets, const ParticleBelt& belt, uint32_t version) {
+    // Fields one by one: padding bytes of Planet aren't part of state
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < planets.size(); ++i) {
+        const Planet& pl = planets[i];
+        hash = hash_mix(hash, pl.id);
+        hash = hash_mix(hash, double_bits(pl.pos.x));
+        hash = hash_mix(hash, double_bits(pl.pos.y));
+        hash = hash_mix(hash, double_bits(pl.vel.x));
+        hash = hash_mix(hash, double_bits(pl.vel.y));
+        hash = hash_mix(hash, double_bits(pl.mass_kg));
+        if (version < 2)
+            continue;
+        hash = hash_mix(hash, double_bits(pl.prev_pos.x));
+        hash = hash_mix(hash, double_bits(pl.prev_pos.y));
+        hash = hash_mix(hash, double_bits(pl.rad_m));
+        hash = hash_mix(hash, double_bits(pl.softening_m));
+        hash = hash_mix(hash, (pl.test_particle ? 1 : 0) | (pl.sleeping ? 2 : 0));
+        hash = hash_mix(hash, pl.rest_steps);
+        hash = hash_mix(hash, double_bits(pl.rest_acc.x));
+        hash = hash_mix(hash, double_bits(pl.rest_acc.y));
+    }
+    for (size_t i = 0; i < belt.size(); ++i) {
+        hash = hash_mix(hash, double_bits(belt.x()[i]));
+        hash = hash_mix(hash, double_bits(belt.y()[i]));
+        if (version < 2)
+            continue;
+        hash = hash_mix(hash, double_bits(belt.vx()[i]));
+        hash = hash_mix(hash, double_bits(belt.vy()[i]));
+    }
+    return hash;
+}
+
+// Doubles and state structures are stored as is (little-endian hosts, see scene_file.h)
+static inline void put_raw(std::vector<unsigned char>& out, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+static inline void put_double(std::vector<unsigned char>& out, double value) {
+    put_raw(out, &value, sizeof(value));
+}
+
+static inline bool get_raw(const std::vector<unsigned char>& in, size_t& pos, void* data, size_t size) {
+    if (in.size() - pos < size)
+        return false;
+    memcpy(data, in.data() + pos, size);
+    pos += size;
+    return true;
+}
+
+static inline bool get_double(const std::vector<unsigned char>& in, size_t& pos, double& value) {
+    return get_raw(in, pos, &value, sizeof(value));
+}
+
+static void put_planet(std::vector<unsigned char>& out, const Planet& pl) {
+    put_varint(out, pl.id);
+    put_double(out, pl.pos.x);
+    put_double(out, pl.pos.y);
+    put_double(out, pl.prev_pos.x);
+    put_double(out, pl.prev_pos.y);
+    put_double(out, pl.vel.x);
+    put_double(out, pl.vel.y);
+    put_double(out, pl.mass_kg);
+    put_double(out, pl.rad_m);
+    put_double(out, pl.softening_m);
+    put_double(out, pl.rest_acc.x);
+    put_double(out, pl.rest_acc.y);
+    put_raw(out, &pl.color.R, sizeof(float));
+    put_raw(out, &pl.color.G, sizeof(float));
+    put_raw(out, &pl.color.B, sizeof(float));
+    out.push_back((pl.test_particle ? JOURNAL_PLANET_TEST_PARTICLE : 0) | (pl.sleeping ? JOURNAL_PLANET_SLEEPING : 0));
+    put_varint(out, pl.rest_steps);
+}
+
+static bool get_planet(const std::vector<unsigned char>& in, size_t& pos, Planet& pl) {
+    uint64_t id, rest_steps;
+    unsigned char flags;
+    if (!get_varint(in, pos, id) ||
+        !get_double(in, pos, pl.pos.x) || !get_double(in, pos, pl.pos.y) ||
+        !get_double(in, pos, pl.prev_pos.x) || !get_double(in, pos, pl.prev_pos.y) ||
+        !get_double(in, pos, pl.vel.x) || !get_double(in, pos, pl.vel.y) ||
+        !get_double(in, pos, pl.mass_kg) || !get_double(in, pos, pl.rad_m) || !get_double(in, pos, pl.softening_m) ||
+        !get_double(in, pos, pl.rest_acc.x) || !get_double(in, pos, pl.rest_acc.y) ||
+        !get_raw(in, pos, &pl.color.R, sizeof(float)) ||
+        !get_raw(in, pos, &pl.color.G, sizeof(float)) ||
+        !get_raw(in, pos, &pl.color.B, sizeof(float)) ||
+        !get_raw(in, pos, &flags, 1) ||
+        !get_varint(in, pos, rest_steps))
+        return false;
+    pl.id = static_cast<unsigned int>(id);
+    pl.test_particle = (flags & JOURNAL_PLANET_TEST_PARTICLE) != 0;
+    pl.sleeping = (flags & JOURNAL_PLANET_SLEEPING) != 0;
+    pl.rest_steps = static_cast<unsigned int>(rest_steps);
+    return true;
+}
+
+static void put_scene(std::vector<unsigned char>& out, const SceneParams& params) {
+    out.push_back(static_cast<unsigned char>(params.kind));
+    put_varint(out, params.count);
+    put_varint(out, params.seed);
+    const double values[15] = {params.center.x, params.center.y, params.center_vel.x, params.center_vel.y,
+                               params.central_mass_kg, params.inner_rad_m, params.outer_rad_m, params.scale_rad_m,
+                               params.left, params.right, params.bottom, params.top, params.max_speed,
+                               params.body_mass_kg, params.body_rad_m};
+    put_raw(out, values, sizeof(values));
+    out.push_back(params.test_particles ? 1 : 0);
+}
+
+static bool get_scene(const std::vector<unsigned char>& in, size_t& pos, SceneParams& params) {
+    unsigned char kind, test_particles;
+    uint64_t count, seed;
+    double values[15];
+    if (!get_raw(in, pos, &kind, 1) || !get_varint(in, pos, count) || !get_varint(in, pos, seed) ||
+        !get_raw(in, pos, values, sizeof(values)) || !get_raw(in, pos, &test_particles, 1) ||
+        (kind > SCENE_RANDOM_FIELD))
+        return false;
+    params.kind = static_cast<SceneKind>(kind);
+    params.count = static_cast<size_t>(count);
+    params.seed = seed;
+    params.center = Vector2d(values[0], values[1]);
+    params.center_vel = Vector2d(values[2], values[3]);
+    params.central_mass_kg = values[4];
+    params.inner_rad_m = values[5];
+    params.outer_rad_m = values[6];
+    params.scale_rad_m = values[7];
+    params.left = values[8];
+    params.right = values[9];
+    params.bottom = values[10];
+    params.top = values[11];
+    params.max_speed = values[12];
+    params.body_mass_kg = values[13];
+    params.body_rad_m = values[14];
+    params.test_particles = (test_particles != 0);
+    return true;
+}
+
+JournalWriter::~JournalWriter() {
+    if (_file != NULL)
+        fclose(_file); // No end mark: read as interrupted session
+}
+
+std::string JournalWriter::scene_copy_path(const std::string& path, unsigned int number) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%u.ssc", number);
+    return path + suffix;
+}
+
+JournalStatus JournalWriter::start(const char* path, unsigned int workers_num, double time_step_ms, uint64_t step,
+                                   const std::vector<Planet>& planets, const ParticleBelt& belt,
+                                   const SceneEngineState& engine) {
+    if (_file != NULL)
+        stop(step);
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+        return JOURNAL_IO_ERROR;
+    JournalFileHeader header;
+    memset(&header, 0, sizeof(header));
+    strncpy(header.magic, JOURNAL_FILE_MAGIC, sizeof(header.magic));
+    header.version = JOURNAL_FILE_VERSION;
+    header.workers_num = workers_num;
+    header.time_step_ms = time_step_ms;
+    header.check_interval = JOURNAL_CHECK_INTERVAL;
+    if ((fwrite(&header, sizeof(header), 1, file) != 1) || (fflush(file) != 0)) {
+        fclose(file);
+        return JOURNAL_IO_ERROR;
+    }
+
+    _file = file;
+    _path = path;
+    _scenes_num = 0;
+    _last_step = 0;
+    JournalStatus status = load_scene(step, planets, belt, engine);
+    if (status != JOURNAL_OK) {
+        fclose(_file);
+        _file = NULL;
+    }
+    return status;
+}
+
+void JournalWriter::stop(uint64_t step) {
+    if (_file == NULL)
+        return;
+    simple(step, JOURNAL_END);
+    fclose(_file);
+    _file = NULL;
+}
+
+void JournalWriter::begin(uint64_t step, JournalEventType type) {
+    _event.clear();
+    put_varint(_event, step - _last_step);
+    _event.push_back(static_cast<unsigned char>(type));
+    _last_step = step;
+}
+
+bool JournalWriter::write() {
+    // Flushed per event: session may end with a crash, which is what journal is for
+    return (fwrite(_event.data(), 1, _event.size(), _file) == _event.size()) && (fflush(_file) == 0);
+}
+
+void JournalWriter::add_planet(uint64_t step, unsigned int id, const Planet& pl) {
+    begin(step, JOURNAL_ADD_PLANET);
+    put_varint(_event, id);
+    put_planet(_event, pl);
+    write();
+}
+
+void JournalWriter::remove_planet(uint64_t step, unsigned int id) {
+    begin(step, JOURNAL_REMOVE_PLANET);
+    put_varint(_event, id);
+    write();
+}
+
+void JournalWriter::modify_planet(uint64_t step, const Planet& pl) {
+    begin(step, JOURNAL_MODIFY_PLANET);
+    put_planet(_event, pl);
+    write();
+}
+
+void JournalWriter::add_scene(uint64_t step, const SceneParams& params, unsigned int first_id) {
+    begin(step, JOURNAL_ADD_SCENE);
+    put_varint(_event, first_id);
+    put_scene(_event, params);
+    write();
+}
+
+void JournalWriter::add_scene_particles(uint64_t step, const SceneParams& params) {
+    begin(step, JOURNAL_ADD_SCENE_PARTICLES);
+    put_scene(_event, params);
+    write();
+}
+
+void JournalWriter::add_belt_particles(uint64_t step, const std::vector<Vector2d>& pos, const std::vector<Vector2d>& vel) {
+    begin(step, JOURNAL_ADD_BELT_PARTICLES);
+    put_varint(_event, pos.size());
+    for (size_t i = 0; i < pos.size(); ++i) {
+        put_double(_event, pos[i].x);
+        put_double(_event, pos[i].y);
+        put_double(_event, vel[i].x);
+        put_double(_event, vel[i].y);
+    }
+    write();
+}
+
+void JournalWriter::settings(uint64_t step, const SceneEngineState& engine) {
+    begin(step, JOURNAL_SETTINGS);
+    put_raw(_event, &engine, sizeof(engine));
+    write();
+}
+
+JournalStatus JournalWriter::load_scene(uint64_t step, const std::vector<Planet>& planets, const ParticleBelt& belt,
+                                        const SceneEngineState& engine) {
+    unsigned int number = _scenes_num++;
+    if (write_scene_file(scene_copy_path(_path, number).c_str(), planets, belt, &engine) != SCENE_FILE_OK)
+        return JOURNAL_IO_ERROR;
+    begin(step, JOURNAL_LOAD_SCENE);
+    put_varint(_event, number);
+    return write() ? JOURNAL_OK : JOURNAL_IO_ERROR;
+}
+
+void JournalWriter::check(uint64_t step, uint64_t state_hash) {
+    begin(step, JOURNAL_CHECK);
+    put_raw(_event, &state_hash, sizeof(state_hash));
+    write();
+}
+
+void JournalWriter::simple(uint64_t step, JournalEventType type, int64_t value) {
+    begin(step, type);
+    put_zigzag(_event, value);
+    write();
+}
+
+JournalStatus JournalReader::open(const char* path) {
+    _data.clear();
+    _pos = 0;
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return JOURNAL_IO_ERROR;
+    bool ok = (fread(&_header, sizeof(_header), 1, file) == 1);
+    unsigned char buffer[1 << 16];
+    size_t size;
+    while (ok && ((size = fread(buffer, 1, sizeof(buffer), file)) > 0))
+        _data.insert(_data.end(), buffer, buffer + size);
+    fclose(file);
+
+    if (!ok || (memcmp(_header.magic, JOURNAL_FILE_MAGIC, sizeof(JOURNAL_FILE_MAGIC)) != 0) ||
+        (_header.version < 1) || (_header.version > JOURNAL_FILE_VERSION))
+        return JOURNAL_BAD_FORMAT;
+    _last_step = 0;
+    return JOURNAL_OK;
+}
+
+bool JournalReader::next_event(JournalEvent& event) {
+    uint64_t step_delta, id, count;
+    unsigned char type;
+    size_t pos = _pos;
+    if (!get_varint(_data, pos, step_delta) || !get_raw(_data, pos, &type, 1))
+        return false;
+
+    event.type = static_cast<JournalEventType>(type);
+    event.step = _last_step + step_delta;
+    event.id = 0;
+    event.value = 0;
+    bool ok = true;
+    switch (event.type) {
+        case JOURNAL_ADD_PLANET:
+            ok = get_varint(_data, pos, id) && get_planet(_data, pos, event.planet);
+            event.id = static_cast<unsigned int>(id);
+            break;
+        case JOURNAL_REMOVE_PLANET:
+            ok = get_varint(_data, pos, id);
+            event.id = static_cast<unsigned int>(id);
+            break;
+        case JOURNAL_MODIFY_PLANET:
+            ok = get_planet(_data, pos, event.planet);
+            event.id = event.planet.id;
+            break;
+        case JOURNAL_ADD_SCENE:
+            ok = get_varint(_data, pos, id) && get_scene(_data, pos, event.scene);
+            event.id = static_cast<unsigned int>(id);
+            break;
+        case JOURNAL_ADD_SCENE_PARTICLES:
+            ok = get_scene(_data, pos, event.scene);
+            break;
+        case JOURNAL_ADD_BELT_PARTICLES:
+            ok = get_varint(_data, pos, count) && (count <= (_data.size() - pos) / (4 * sizeof(double)));
+            event.pos.resize(ok ? count : 0);
+            event.vel.resize(ok ? count : 0);
+            for (size_t i = 0; ok && (i < count); ++i) {
+                ok = get_double(_data, pos, event.pos[i].x) && get_double(_data, pos, event.pos[i].y) &&
+                     get_double(_data, pos, event.vel[i].x) && get_double(_data, pos, event.vel[i].y);
+            }
+            break;
+        case JOURNAL_SETTINGS:
+            ok = get_raw(_data, pos, &event.settings, sizeof(event.settings));
+            break;
+        case JOURNAL_LOAD_SCENE:
+            ok = get_varint(_data, pos, id);
+            event.value = static_cast<int64_t>(id);
+            break;
+        case JOURNAL_CHECK: {
+            uint64_t hash = 0;
+            ok = get_raw(_data, pos, &hash, sizeof(hash));
+            event.value = static_cast<int64_t>(hash);
+            break;
+        }
+        case JOURNAL_REMOVE_ALL:
+        case JOURNAL_REMOVE_BELT:
+        case JOURNAL_END:
+        case JOURNAL_MODEL_SPEED:
+        case JOURNAL_PAUSE:
+        case JOURNAL_RESUME:
+        case JOURNAL_SINGLE_STEP:
+        case JOURNAL_SAVE_UNDO_POINT:
+        case JOURNAL_UNDO:
+        case JOURNAL_REDO:
+            ok = get_zigzag(_data, pos, event.value);
+            break;
+        default:
+            ok = false;
+            break;
+    }
+    if (!ok)
+        return false;
+    _pos = pos;
+    _last_step = event.step;
+    return true;
+}
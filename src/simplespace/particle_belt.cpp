@@ -0,0 +1,97 @@
+//
+//  particle_belt.cpp
+//  simple-space
+//
+
+#include "particle_belt.h"
+
+#include <algorithm> // std::min()
+
+#include "simd_pack.h"
+
+struct ParticleBelt::Job {
+    ParticleBelt* belt;
+    const BeltSources* sources;
+    double dt;
+};
+
+// Advances particles [begin, begin + count * V::width). Particle state stays in registers
+// while all sources (few, in L1) are summed; movement is the same as Physics::MoveWithConstAcc()
+template <class V>
+static size_t advance_particles(double* x, double* y, double* vx, double* vy, size_t begin, size_t end,
+                                const BeltSources& sources, double dt) {
+    const V time(dt);
+    const V half_time2(dt * dt * 0.5);
+    size_t i = begin;
+    for (; i + V::width <= end; i += V::width) {
+        V px = V::load(x + i);
+        V py = V::load(y + i);
+        V ax(0.0);
+        V ay(0.0);
+        for (size_t j = 0; j < sources.count; ++j) {
+            V dx = V(sources.x[j]) - px;
+            V dy = V(sources.y[j]) - py;
+            V soft2 = dx * dx + dy * dy + V(sources.soft2[j]);
+            V g = div_positive(V(sources.gm[j]), soft2 * sqrt(soft2)); // G * m / r^3 (Plummer)
+            ax = ax + g * dx;
+            ay = ay + g * dy;
+        }
+        V pvx = V::load(vx + i);
+        V pvy = V::load(vy + i);
+        (px + pvx * time + ax * half_time2).store(x + i);
+        (py + pvy * time + ay * half_time2).store(y + i);
+        (pvx + ax * time).store(vx + i);
+        (pvy + ay * time).store(vy + i);
+    }
+    return i;
+}
+
+void ParticleBelt::advance_task(void* arg, unsigned int task_idx, unsigned int worker_idx) {
+    Job& job = *static_cast<Job*>(arg);
+    ParticleBelt& belt = *job.belt;
+    const size_t begin = task_idx * BELT_CHUNK_SIZE;
+    const size_t end = std::min(begin + BELT_CHUNK_SIZE, belt.size());
+
+    double* x = belt._x.data();
+    double* y = belt._y.data();
+    double* vx = belt._vx.data();
+    double* vy = belt._vy.data();
+    size_t tail = advance_particles<Double2>(x, y, vx, vy, begin, end, *job.sources, job.dt);
+    advance_particles<Double1>(x, y, vx, vy, tail, end, *job.sources, job.dt);
+}
+
+void ParticleBelt::add(const Vector2d& pos, const Vector2d& vel) {
+    _x.push_back(pos.x);
+    _y.push_back(pos.y);
+    _vx.push_back(vel.x);
+    _vy.push_back(vel.y);
+}
+
+void ParticleBelt::reserve(size_t count) {
+    _x.reserve(count);
+    _y.reserve(count);
+    _vx.reserve(count);
+    _vy.reserve(count);
+}
+
+void ParticleBelt::resize(size_t count) {
+    _x.resize(count);
+    _y.resize(count);
+    _vx.resize(count);
+    _vy.resize(count);
+}
+
+void ParticleBelt::clear() {
+    _x.clear();
+    _y.clear();
+    _vx.clear();
+    _vy.clear();
+}
+
+void ParticleBelt::advance(WorkerPool& pool, const BeltSources& sources, double time_step_s) {
+    Job job;
+    job.belt = this;
+    job.sources = &sources;
+    job.dt = time_step_s;
+    pool.run(ParticleBelt::advance_task, &job, static_cast<unsigned int>((size() + BELT_CHUNK_SIZE - 1) / BELT_CHUNK_SIZE));
+}
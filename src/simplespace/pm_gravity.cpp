@@ -0,0 +1,251 @@
+//
+//  pm_gravity.cpp
+//  simple-space
+//
+
+#include "pm_gravity.h"
+
+#include <math.h>
+#include <algorithm> // std::min(), std::max()
+
+struct PMGravitySolver::Job {
+    PMGravitySolver* solver;
+    const GravityBodies* bodies;
+    Vector2d* acc;
+    size_t deposit_chunk_size;  // Massive bodies per deposit chunk
+    size_t chunk_size;          // Bodies per interpolation chunk
+    bool inverse;        // FFT direction
+};
+
+PMGravitySolver::PMGravitySolver(WorkerPool& pool, size_t grid_size) :
+    _pool(pool),
+    _grid_size(grid_size),
+    _fft_size(grid_size * 2),
+    _left(0),
+    _bottom(0),
+    _cell(1),
+    _kernel_cell(0),
+    _chunk_density(PM_DEPOSIT_CHUNKS * grid_size * grid_size),
+    _mesh(_fft_size * _fft_size),
+    _kernel(_fft_size * _fft_size),
+    _twiddles(_fft_size / 2),
+    _bit_reverse(_fft_size),
+    _columns(_pool.workersNum() * _fft_size) {
+    for (size_t k = 0; k < _fft_size / 2; ++k)
+        _twiddles[k] = std::polar(1.0, -2.0 * M_PI * double(k) / double(_fft_size));
+
+    size_t bits = 0;
+    while ((size_t(1) << bits) < _fft_size)
+        ++bits;
+    for (size_t i = 0; i < _fft_size; ++i) {
+        size_t rev = 0;
+        for (size_t b = 0; b < bits; ++b)
+            rev |= ((i >> b) & 1) << (bits - 1 - b);
+        _bit_reverse[i] = rev;
+    }
+}
+
+void PMGravitySolver::set_domain(double left, double bottom, double right, double top) {
+    _left = left;
+    _bottom = bottom;
+    _cell = std::max(right - left, top - bottom) / double(_grid_size - 1);
+}
+
+// Iterative radix-2 Cooley-Tukey transform of _fft_size points (inverse one is not normalized)
+void PMGravitySolver::fft_1d(Complex* data, bool inverse) const {
+    const size_t n = _fft_size;
+    for (size_t i = 0; i < n; ++i) {
+        if (i < _bit_reverse[i])
+            std::swap(data[i], data[_bit_reverse[i]]);
+    }
+    for (size_t len = 2; len <= n; len <<= 1) {
+        const size_t half = len / 2;
+        const size_t step = n / len;
+        for (size_t i = 0; i < n; i += len) {
+            for (size_t k = 0; k < half; ++k) {
+                Complex w = inverse ? std::conj(_twiddles[k * step]) : _twiddles[k * step];
+                Complex u = data[i + k];
+                Complex v = data[i + k + half] * w;
+                data[i + k] = u + v;
+                data[i + k + half] = u - v;
+            }
+        }
+    }
+}
+
+void PMGravitySolver::fft_rows_task(void* arg, unsigned int task_idx, unsigned int worker_idx) {
+    Job& job = *static_cast<Job*>(arg);
+    PMGravitySolver& s = *job.solver;
+    s.fft_1d(&s._mesh[task_idx * s._fft_size], job.inverse);
+}
+
+void PMGravitySolver::fft_columns_task(void* arg, unsigned int task_idx, unsigned int worker_idx) {
+    Job& job = *static_cast<Job*>(arg);
+    PMGravitySolver& s = *job.solver;
+    const size_t n = s._fft_size;
+    Complex* column = &s._columns[worker_idx * n];
+    for (size_t r = 0; r < n; ++r)
+        column[r] = s._mesh[r * n + task_idx];
+    s.fft_1d(column, job.inverse);
+    for (size_t r = 0; r < n; ++r)
+        s._mesh[r * n + task_idx] = column[r];
+}
+
+// Rows beyond rows_used are zero on forward transform input / not needed on inverse output
+void PMGravitySolver::fft_2d(Job& job, bool inverse, size_t rows_used) {
+    job.inverse = inverse;
+    if (!inverse)
+        _pool.run(PMGravitySolver::fft_rows_task, &job, static_cast<unsigned int>(rows_used));
+    _pool.run(PMGravitySolver::fft_columns_task, &job, static_cast<unsigned int>(_fft_size));
+    if (inverse)
+        _pool.run(PMGravitySolver::fft_rows_task, &job, static_cast<unsigned int>(rows_used));
+}
+
+void PMGravitySolver::prepare_kernel() {
+    // Acceleration at node p from unit mass at node q is K(p - q) = -G * d / |d|^3, d = p - q.
+    // Offsets up to N - 1 cells either way are stored in wrapped order; x goes to real part,
+    // y to imaginary one, so single inverse transform gives both components.
+    const size_t n = _fft_size;
+    for (size_t v = 0; v < n; ++v) {
+        for (size_t u = 0; u < n; ++u) {
+            Complex k(0, 0);
+            if ((u != _grid_size) && (v != _grid_size)) {
+                double dx = (u < _grid_size ? double(u) : double(u) - double(n)) * _cell;
+                double dy = (v < _grid_size ? double(v) : double(v) - double(n)) * _cell;
+                // Softened on cell scale: mesh does not resolve closer distances anyway
+                double g = CONST_G * Physics::PlummerInvDist3(dx * dx + dy * dy, _cell);
+                k = Complex(-g * dx, -g * dy);
+            }
+            _mesh[v * n + u] = k;
+        }
+    }
+
+    Job job;
+    job.solver = this;
+    fft_2d(job, false, n);
+
+    // Normalization of inverse transform is folded into kernel
+    const double norm = 1.0 / (double(n) * double(n));
+    for (size_t i = 0; i < _mesh.size(); ++i)
+        _kernel[i] = _mesh[i] * norm;
+    _kernel_cell = _cell;
+}
+
+// Cloud-in-cell: index of lower node along axis and weight of the upper one
+static inline long cic_node(double pos, double origin, double cell, double& upper_weight) {
+    double f = (pos - origin) / cell;
+    double node = floor(f);
+    upper_weight = f - node;
+    return static_cast<long>(node);
+}
+
+void PMGravitySolver::deposit_task(void* arg, unsigned int task_idx, unsigned int worker_idx) {
+    Job& job = *static_cast<Job*>(arg);
+    PMGravitySolver& s = *job.solver;
+    const long n = static_cast<long>(s._grid_size);
+    double* density = &s._chunk_density[task_idx * s._grid_size * s._grid_size];
+    std::fill(density, density + s._grid_size * s._grid_size, 0.0);
+
+    // Only massive bodies are sources
+    const size_t begin = task_idx * job.deposit_chunk_size;
+    const size_t end = std::min(begin + job.deposit_chunk_size, job.bodies->massive_count);
+    for (size_t b = begin; b < end; ++b) {
+        double wx, wy;
+        long ix = cic_node(job.bodies->x[b], s._left, s._cell, wx);
+        long iy = cic_node(job.bodies->y[b], s._bottom, s._cell, wy);
+        const double m = job.bodies->mass[b];
+        const double w[2][2] = {{(1 - wx) * (1 - wy), wx * (1 - wy)},
+                                {(1 - wx) * wy,       wx * wy}};
+        for (long dy = 0; dy < 2; ++dy) {
+            for (long dx = 0; dx < 2; ++dx) {
+                long x = ix + dx;
+                long y = iy + dy;
+                if ((x >= 0) && (x < n) && (y >= 0) && (y < n))
+                    density[y * n + x] += m * w[dy][dx];
+            }
+        }
+    }
+}
+
+void PMGravitySolver::reduce_task(void* arg, unsigned int task_idx, unsigned int worker_idx) {
+    Job& job = *static_cast<Job*>(arg);
+    PMGravitySolver& s = *job.solver;
+    const size_t n = s._grid_size;
+    Complex* row = &s._mesh[task_idx * s._fft_size];
+    std::fill(row, row + s._fft_size, Complex(0, 0));
+    if (task_idx >= n)
+        return; // Padding
+
+    // Chunks are summed in fixed order
+    for (size_t x = 0; x < n; ++x) {
+        double sum = 0;
+        for (size_t c = 0; c < PM_DEPOSIT_CHUNKS; ++c)
+            sum += s._chunk_density[(c * n + task_idx) * n + x];
+        row[x] = Complex(sum, 0);
+    }
+}
+
+void PMGravitySolver::multiply_task(void* arg, unsigned int task_idx, unsigned int worker_idx) {
+    Job& job = *static_cast<Job*>(arg);
+    PMGravitySolver& s = *job.solver;
+    Complex* row = &s._mesh[task_idx * s._fft_size];
+    const Complex* kernel_row = &s._kernel[task_idx * s._fft_size];
+    for (size_t k = 0; k < s._fft_size; ++k)
+        row[k] *= kernel_row[k];
+}
+
+void PMGravitySolver::interpolate_task(void* arg, unsigned int task_idx, unsigned int worker_idx) {
+    Job& job = *static_cast<Job*>(arg);
+    PMGravitySolver& s = *job.solver;
+    const long n = static_cast<long>(s._grid_size);
+    const size_t m = s._fft_size;
+
+    const size_t begin = task_idx * job.chunk_size;
+    const size_t end = std::min(begin + job.chunk_size, job.bodies->count);
+    for (size_t b = begin; b < end; ++b) {
+        double wx, wy;
+        long ix = cic_node(job.bodies->x[b], s._left, s._cell, wx);
+        long iy = cic_node(job.bodies->y[b], s._bottom, s._cell, wy);
+        const double w[2][2] = {{(1 - wx) * (1 - wy), wx * (1 - wy)},
+                                {(1 - wx) * wy,       wx * wy}};
+        Complex field(0, 0);
+        for (long dy = 0; dy < 2; ++dy) {
+            for (long dx = 0; dx < 2; ++dx) {
+                long x = ix + dx;
+                long y = iy + dy;
+                if ((x >= 0) && (x < n) && (y >= 0) && (y < n))
+                    field += s._mesh[y * m + x] * w[dy][dx];
+            }
+        }
+        job.acc[b].x += field.real();
+        job.acc[b].y += field.imag();
+    }
+}
+
+bool PMGravitySolver::compute(const GravityBodies& bodies,
+                              Vector2d* acc,
+                              double* potential,
+                              double skin_dist,
+                              ScratchBuffer<CollisionPair>& candidates) {
+    if (bodies.count < 2)
+        return false;
+
+    if (_kernel_cell != _cell)
+        prepare_kernel();
+
+    Job job;
+    job.solver = this;
+    job.bodies = &bodies;
+    job.acc = acc;
+    job.deposit_chunk_size = (bodies.massive_count + PM_DEPOSIT_CHUNKS - 1) / PM_DEPOSIT_CHUNKS;
+    job.chunk_size = (bodies.count + PM_DEPOSIT_CHUNKS - 1) / PM_DEPOSIT_CHUNKS;
+
+    _pool.run(PMGravitySolver::deposit_task, &job, PM_DEPOSIT_CHUNKS);
+    _pool.run(PMGravitySolver::reduce_task, &job, static_cast<unsigned int>(_fft_size));
+    fft_2d(job, false, _grid_size);
+    _pool.run(PMGravitySolver::multiply_task, &job, static_cast<unsigned int>(_fft_size));
+    fft_2d(job, true, _grid_size);
+    _pool.run(PMGravitySolver::interpolate_task, &job, PM_DEPOSIT_CHUNKS);
+
+    return false;
+}
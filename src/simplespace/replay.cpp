@@ -0,0 +1,185 @@
+//
+//  replay.cpp
+//  simple-space
+//
+
+#include "replay.h"
+
+static size_t block_distance(size_t block, size_t playhead) {
+    return (block > playhead) ? block - playhead : playhead - block;
+}
+
+TrajectoryPlayer::TrajectoryPlayer() :
+    _cache_bytes(0),
+    _playhead_block(0),
+    _stopping(false),
+    _open(false),
+    _hits(0),
+    _misses(0),
+    _prefetched(0) {
+    wMutexInit(&_cache_mutex);
+}
+
+TrajectoryPlayer::~TrajectoryPlayer() {
+    close();
+    wMutexDestroy(&_cache_mutex);
+}
+
+bool TrajectoryPlayer::open(const char* path) {
+    close();
+    if (!_reader.open(path) || !_prefetch_reader.open(path)) {
+        _reader.close();
+        return false;
+    }
+    _playhead_block = 0;
+    _stopping = false;
+    _hits = 0;
+    _misses = 0;
+    _prefetched = 0;
+    _open = true;
+    wEventInit(&_wake);
+    wThreadCreate(&_prefetcher, prefetch_loop, this, true);
+    wEventSignal(&_wake); // Start of file is decoded before it's asked for
+    return true;
+}
+
+void TrajectoryPlayer::close() {
+    if (!_open)
+        return;
+    _stopping = true;
+    wEventSignal(&_wake);
+    wThreadJoin(_prefetcher, NULL);
+    wEventDestroy(&_wake);
+    _reader.close();
+    _prefetch_reader.close();
+    _cache.clear();
+    _cache_bytes = 0;
+    _open = false;
+}
+
+std::shared_ptr<const ReplayBlock> TrajectoryPlayer::find_cached(size_t block) {
+    std::shared_ptr<const ReplayBlock> found;
+    wMutexLock(&_cache_mutex);
+    for (size_t i = 0; i < _cache.size(); ++i) {
+        if (_cache[i]->index == block) {
+            found = _cache[i];
+            break;
+        }
+    }
+    wMutexUnlock(&_cache_mutex);
+    return found;
+}
+
+bool TrajectoryPlayer::insert(const std::shared_ptr<const ReplayBlock>& block) {
+    bool kept = true;
+    wMutexLock(&_cache_mutex);
+    for (size_t i = 0; i < _cache.size(); ++i) {
+        if (_cache[i]->index == block->index) {
+            wMutexUnlock(&_cache_mutex);
+            return true; // Decoded by other thread meanwhile
+        }
+    }
+    _cache.push_back(block);
+    _cache_bytes += block->bytes;
+
+    const size_t playhead = _playhead_block;
+    while ((_cache_bytes > REPLAY_CACHE_BYTES) && (_cache.size() > 1)) {
+        size_t farthest = 0;
+        for (size_t i = 1; i < _cache.size(); ++i) {
+            if (block_distance(_cache[i]->index, playhead) > block_distance(_cache[farthest]->index, playhead))
+                farthest = i;
+        }
+        if (_cache[farthest]->index == playhead)
+            break; // Playhead block stays, whatever its size
+        if (_cache[farthest] == block)
+            kept = false;
+        _cache_bytes -= _cache[farthest]->bytes;
+        _cache.erase(_cache.begin() + farthest);
+    }
+    wMutexUnlock(&_cache_mutex);
+    return kept;
+}
+
+std::shared_ptr<const ReplayBlock> TrajectoryPlayer::decode(TrajectoryReader& reader, size_t block) {
+    std::shared_ptr<ReplayBlock> decoded(new ReplayBlock);
+    decoded->index = block;
+    decoded->bytes = 0;
+    if (!reader.read_block_frames(block, decoded->frames))
+        return std::shared_ptr<const ReplayBlock>(); // Corrupted
+    for (size_t i = 0; i < decoded->frames.size(); ++i) {
+        const TrajectoryFrame& frame = decoded->frames[i];
+        decoded->bytes += sizeof(frame) + frame.id.size() * sizeof(uint32_t) +
+                          (frame.x.size() + frame.y.size() + frame.vx.size() + frame.vy.size()) * sizeof(double);
+    }
+    return decoded;
+}
+
+int TrajectoryPlayer::prefetch_loop(void* arg) {
+    TrajectoryPlayer& player = *static_cast<TrajectoryPlayer*>(arg);
+    const size_t blocks_count = player._prefetch_reader.blocks_count();
+
+    while (!player._stopping) {
+        wEventWait(&player._wake, W_TIMEOUT_INITITE);
+
+        // Nearest missing block ahead first, then one behind; starts over if playhead moves
+        bool done = false;
+        while (!done && !player._stopping) {
+            const size_t playhead = player._playhead_block;
+            done = true;
+            for (size_t k = 0; k <= REPLAY_PREFETCH_BLOCKS + 1; ++k) {
+                size_t block = (k <= REPLAY_PREFETCH_BLOCKS) ? playhead + k : playhead - 1;
+                if ((block >= blocks_count) || player.find_cached(block))
+                    continue;
+                std::shared_ptr<const ReplayBlock> decoded = decode(player._prefetch_reader, block);
+                if (decoded && player.insert(decoded)) {
+                    ++player._prefetched;
+                    done = false; // Cache has room for more
+                }
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+const TrajectoryFrame* TrajectoryPlayer::frame_at(uint64_t step, std::shared_ptr<const ReplayBlock>& holder) {
+    if (!_open || (_reader.blocks_count() == 0))
+        return NULL;
+
+    const size_t block = _reader.find_block(step);
+    if (block != _playhead_block) {
+        _playhead_block = block;
+        wEventSignal(&_wake);
+    }
+
+    holder = find_cached(block);
+    if (holder) {
+        ++_hits;
+    } else {
+        ++_misses;
+        holder = decode(_reader, block);
+        if (!holder)
+            return NULL;
+        insert(holder);
+    }
+
+    // Last frame at or before step
+    const std::vector<TrajectoryFrame>& frames = holder->frames;
+    size_t low = 0, high = frames.size();
+    while (high - low > 1) {
+        size_t mid = (low + high) / 2;
+        if (frames[mid].step <= step)
+            low = mid;
+        else
+            high = mid;
+    }
+    return &frames[low];
+}
+
+ReplayStats TrajectoryPlayer::stats() const {
+    ReplayStats stats;
+    stats.hits = _hits;
+    stats.misses = _misses;
+    stats.prefetched = _prefetched;
+    return stats;
+}
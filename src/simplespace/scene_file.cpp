@@ -0,0 +1,475 @@
+//
+//  scene_file.cpp
+//  simple-space
+//
+
+#include "scene_file.h"
+
+#include <stdio.h>
+#include <string.h> // memcpy(), memcmp()
+#include <string>
+#include <algorithm> // std::min()
+
+#define SCENE_FILE_CHUNK_SIZE 8192 // Bodies per read task and per write buffer
+
+static const uint32_t column_elem_size[SCENE_COLUMNS_NUM] = {
+    sizeof(uint32_t),                                   // SCENE_COL_ID
+    sizeof(double), sizeof(double),                     // SCENE_COL_POS_X, SCENE_COL_POS_Y
+    sizeof(double), sizeof(double),                     // SCENE_COL_VEL_X, SCENE_COL_VEL_Y
+    sizeof(double), sizeof(double), sizeof(double),     // SCENE_COL_MASS, SCENE_COL_RAD, SCENE_COL_SOFTENING
+    3 * sizeof(float),                                  // SCENE_COL_COLOR
+    sizeof(uint8_t),                                    // SCENE_COL_FLAGS
+    sizeof(double), sizeof(double), sizeof(double), sizeof(double), // SCENE_COL_BELT_*
+    sizeof(double), sizeof(double),                     // SCENE_COL_PREV_POS_X, SCENE_COL_PREV_POS_Y
+    sizeof(double), sizeof(double),                     // SCENE_COL_REST_ACC_X, SCENE_COL_REST_ACC_Y
+    sizeof(uint32_t),                                   // SCENE_COL_REST_STEPS
+    sizeof(SceneEngineState)                            // SCENE_COL_ENGINE
+};
+
+static inline bool is_belt_column(unsigned int type) {
+    return (type >= SCENE_COL_BELT_X) && (type <= SCENE_COL_BELT_VY);
+}
+
+static inline bool is_optional_column(unsigned int type) {
+    return type >= SCENE_COL_PREV_POS_X;
+}
+
+// Elements number of column in file with given counts
+static inline uint64_t column_count(unsigned int type, uint64_t planets_count, uint64_t belt_count, bool has_engine) {
+    if (type == SCENE_COL_ENGINE)
+        return has_engine ? 1 : 0;
+    return is_belt_column(type) ? belt_count : planets_count;
+}
+
+static inline uint64_t align_up(uint64_t value) {
+    return (value + SCENE_FILE_ALIGNMENT - 1) / SCENE_FILE_ALIGNMENT * SCENE_FILE_ALIGNMENT;
+}
+
+const char* scene_file_status_str(SceneFileStatus status) {
+    switch (status) {
+        case SCENE_FILE_OK:           return "ok";
+        case SCENE_FILE_IO_ERROR:     return "I/O error";
+        case SCENE_FILE_BAD_FORMAT:   return "not a scene file or truncated";
+        case SCENE_FILE_BAD_VERSION:  return "unsupported version";
+        case SCENE_FILE_BAD_CHECKSUM: return "checksum mismatch";
+    }
+    return "unknown";
+}
+
+// Streaming checksum: one multiply-rotate round per 8 bytes, all parts but the last
+// must be multiples of 8 bytes. Same bytes give the same value however they are split.
+class Checksum
+{
+    uint64_t _h;
+    uint64_t _size;
+
+public:
+    Checksum() : _h(0x9E3779B97F4A7C15ULL), _size(0) {}
+
+    void add(const void* data, size_t size) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        size_t words = size / 8;
+        for (size_t i = 0; i < words; ++i, p += 8) {
+            uint64_t w;
+            memcpy(&w, p, 8);
+            round(w);
+        }
+        if (size % 8) {
+            uint64_t w = 0;
+            memcpy(&w, p, size % 8);
+            round(w);
+        }
+        _size += size;
+    }
+
+    uint64_t value() const {
+        uint64_t z = _h ^ _size;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+private:
+    void round(uint64_t w) {
+        _h ^= w * 0x9E3779B97F4A7C15ULL;
+        _h = ((_h << 29) | (_h >> 35)) * 0xBF58476D1CE4E5B9ULL;
+    }
+};
+
+uint64_t scene_checksum(const void* data, size_t size) {
+    Checksum sum;
+    sum.add(data, size);
+    return sum.value();
+}
+
+static uint64_t header_checksum(const SceneFileHeader& header, const SceneFileColumn* columns) {
+    SceneFileHeader copy = header;
+    copy.header_checksum = 0;
+    Checksum sum;
+    sum.add(&copy, sizeof(copy));
+    sum.add(columns, header.columns_num * sizeof(SceneFileColumn));
+    return sum.value();
+}
+
+// Gathers column type field of planets[0, n) into out
+static void gather_column(unsigned int type, const Planet* planets, size_t n, unsigned char* out) {
+    for (size_t i = 0; i < n; ++i) {
+        const Planet& pl = planets[i];
+        switch (type) {
+            case SCENE_COL_ID: {
+                uint32_t id = pl.id;
+                memcpy(out + i * sizeof(id), &id, sizeof(id));
+                break;
+            }
+            case SCENE_COL_POS_X:     memcpy(out + i * sizeof(double), &pl.pos.x, sizeof(double)); break;
+            case SCENE_COL_POS_Y:     memcpy(out + i * sizeof(double), &pl.pos.y, sizeof(double)); break;
+            case SCENE_COL_VEL_X:     memcpy(out + i * sizeof(double), &pl.vel.x, sizeof(double)); break;
+            case SCENE_COL_VEL_Y:     memcpy(out + i * sizeof(double), &pl.vel.y, sizeof(double)); break;
+            case SCENE_COL_MASS:      memcpy(out + i * sizeof(double), &pl.mass_kg, sizeof(double)); break;
+            case SCENE_COL_RAD:       memcpy(out + i * sizeof(double), &pl.rad_m, sizeof(double)); break;
+            case SCENE_COL_SOFTENING: memcpy(out + i * sizeof(double), &pl.softening_m, sizeof(double)); break;
+            case SCENE_COL_COLOR: {
+                float rgb[3] = {pl.color.R, pl.color.G, pl.color.B};
+                memcpy(out + i * sizeof(rgb), rgb, sizeof(rgb));
+                break;
+            }
+            case SCENE_COL_FLAGS:
+                out[i] = (pl.test_particle ? SCENE_FLAG_TEST_PARTICLE : 0) | (pl.sleeping ? SCENE_FLAG_SLEEPING : 0);
+                break;
+            case SCENE_COL_PREV_POS_X: memcpy(out + i * sizeof(double), &pl.prev_pos.x, sizeof(double)); break;
+            case SCENE_COL_PREV_POS_Y: memcpy(out + i * sizeof(double), &pl.prev_pos.y, sizeof(double)); break;
+            case SCENE_COL_REST_ACC_X: memcpy(out + i * sizeof(double), &pl.rest_acc.x, sizeof(double)); break;
+            case SCENE_COL_REST_ACC_Y: memcpy(out + i * sizeof(double), &pl.rest_acc.y, sizeof(double)); break;
+            case SCENE_COL_REST_STEPS: {
+                uint32_t steps = pl.rest_steps;
+                memcpy(out + i * sizeof(steps), &steps, sizeof(steps));
+                break;
+            }
+        }
+    }
+}
+
+static const double* belt_column(unsigned int type, const ParticleBelt& belt) {
+    switch (type) {
+        case SCENE_COL_BELT_X:  return belt.x();
+        case SCENE_COL_BELT_Y:  return belt.y();
+        case SCENE_COL_BELT_VX: return belt.vx();
+        default:                return belt.vy();
+    }
+}
+
+// Output of scene writer: file written in order (header is written last, over its place)
+class FileSink
+{
+    FILE* _file;
+
+public:
+    explicit FileSink(FILE* file) : _file(file) {}
+
+    bool write(const void* data, size_t size) {
+        return fwrite(data, 1, size, _file) == size;
+    }
+    bool write_header(const void* data, size_t size) {
+        return (fseek(_file, 0, SEEK_SET) == 0) && write(data, size);
+    }
+};
+
+// Output of scene writer: memory image of the whole file
+class ImageSink
+{
+    unsigned char* _data;
+    size_t _pos;
+
+public:
+    explicit ImageSink(std::vector<unsigned char>& image) : _data(image.data()), _pos(0) {}
+
+    bool write(const void* data, size_t size) {
+        memcpy(_data + _pos, data, size);
+        _pos += size;
+        return true;
+    }
+    bool write_header(const void* data, size_t size) {
+        memcpy(_data, data, size);
+        return true;
+    }
+};
+
+template <class Sink>
+static bool write_padding(Sink& sink, uint64_t size) {
+    static const unsigned char zeros[SCENE_FILE_ALIGNMENT] = {0};
+    for (; size > 0; size -= std::min<uint64_t>(size, sizeof(zeros))) {
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(size, sizeof(zeros)));
+        if (!sink.write(zeros, n))
+            return false;
+    }
+    return true;
+}
+
+// Header and columns table (checksums are filled by write_scene())
+static void layout_scene(const std::vector<Planet>& planets, const ParticleBelt& belt, const SceneEngineState* engine,
+                         SceneFileHeader& header, SceneFileColumn* columns) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC));
+    header.version = SCENE_FILE_VERSION;
+    header.columns_num = SCENE_COLUMNS_NUM;
+    header.planets_count = planets.size();
+    header.belt_count = belt.size();
+
+    uint64_t pos = align_up(sizeof(header) + SCENE_COLUMNS_NUM * sizeof(SceneFileColumn));
+    for (unsigned int type = 0; type < SCENE_COLUMNS_NUM; ++type) {
+        columns[type].type = type;
+        columns[type].elem_size = column_elem_size[type];
+        columns[type].offset = pos;
+        columns[type].count = column_count(type, header.planets_count, header.belt_count, engine != NULL);
+        columns[type].checksum = 0;
+        pos = align_up(pos + columns[type].count * columns[type].elem_size);
+    }
+    header.file_size = pos;
+}
+
+template <class Sink>
+static bool write_scene(Sink& sink, const std::vector<Planet>& planets, const ParticleBelt& belt,
+                        const SceneEngineState* engine, SceneFileHeader& header, SceneFileColumn* columns) {
+    // Header goes last, when checksums are known
+    bool ok = write_padding(sink, columns[0].offset);
+    std::vector<unsigned char> buffer(SCENE_FILE_CHUNK_SIZE * 3 * sizeof(float));
+    for (unsigned int type = 0; type < SCENE_COLUMNS_NUM && ok; ++type) {
+        SceneFileColumn& col = columns[type];
+        Checksum sum;
+        if (type == SCENE_COL_ENGINE) {
+            if (engine) {
+                sum.add(engine, sizeof(*engine));
+                ok = sink.write(engine, sizeof(*engine));
+            }
+        } else if (is_belt_column(type)) {
+            const size_t bytes = static_cast<size_t>(col.count * col.elem_size);
+            sum.add(belt_column(type, belt), bytes);
+            ok = sink.write(belt_column(type, belt), bytes);
+        } else {
+            for (size_t begin = 0; begin < planets.size() && ok; begin += SCENE_FILE_CHUNK_SIZE) {
+                const size_t n = std::min<size_t>(SCENE_FILE_CHUNK_SIZE, planets.size() - begin);
+                gather_column(type, &planets[begin], n, buffer.data());
+                sum.add(buffer.data(), n * col.elem_size);
+                ok = sink.write(buffer.data(), n * col.elem_size);
+            }
+        }
+        col.checksum = sum.value();
+        const uint64_t end = col.offset + col.count * col.elem_size;
+        ok = ok && write_padding(sink, align_up(end) - end);
+    }
+
+    header.header_checksum = header_checksum(header, columns);
+    unsigned char head[sizeof(header) + SCENE_COLUMNS_NUM * sizeof(SceneFileColumn)];
+    memcpy(head, &header, sizeof(header));
+    memcpy(head + sizeof(header), columns, SCENE_COLUMNS_NUM * sizeof(SceneFileColumn));
+    return ok && sink.write_header(head, sizeof(head));
+}
+
+SceneFileStatus write_scene_file(const char* path, const std::vector<Planet>& planets, const ParticleBelt& belt,
+                                 const SceneEngineState* engine) {
+    SceneFileHeader header;
+    SceneFileColumn columns[SCENE_COLUMNS_NUM];
+    layout_scene(planets, belt, engine, header, columns);
+
+    std::string tmp_path = std::string(path) + ".tmp";
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    if (!file)
+        return SCENE_FILE_IO_ERROR;
+    FileSink sink(file);
+    bool ok = write_scene(sink, planets, belt, engine, header, columns);
+    ok = (fclose(file) == 0) && ok;
+
+    #if defined(__WIN32__)
+    if (ok)
+        remove(path); // rename() doesn't replace there
+    #endif
+    if (!ok || rename(tmp_path.c_str(), path) != 0) {
+        remove(tmp_path.c_str());
+        return SCENE_FILE_IO_ERROR;
+    }
+    return SCENE_FILE_OK;
+}
+
+void make_scene_file_image(const std::vector<Planet>& planets, const ParticleBelt& belt, const SceneEngineState* engine,
+                           std::vector<unsigned char>& image) {
+    SceneFileHeader header;
+    SceneFileColumn columns[SCENE_COLUMNS_NUM];
+    layout_scene(planets, belt, engine, header, columns);
+    image.resize(static_cast<size_t>(header.file_size));
+    ImageSink sink(image);
+    write_scene(sink, planets, belt, engine, header, columns);
+}
+
+struct SceneFile::Job {
+    const SceneFile* file;
+    Planet* out;
+    bool valid[SCENE_COLUMNS_NUM];
+};
+
+SceneFile::SceneFile() : _header(NULL) {
+    _map.data = NULL;
+    _map.size = 0;
+    for (unsigned int type = 0; type < SCENE_COLUMNS_NUM; ++type)
+        _columns[type] = NULL;
+}
+
+SceneFile::~SceneFile() {
+    close();
+}
+
+void SceneFile::close() {
+    wUnmapFile(&_map);
+    _header = NULL;
+    for (unsigned int type = 0; type < SCENE_COLUMNS_NUM; ++type)
+        _columns[type] = NULL;
+}
+
+void SceneFile::verify_task(void* arg, unsigned int task_idx, unsigned int worker_idx) {
+    Job& job = *static_cast<Job*>(arg);
+    if (!job.file->_columns[task_idx]) {
+        job.valid[task_idx] = true; // Absent optional column
+        return;
+    }
+    const SceneFileColumn& col = *job.file->_columns[task_idx];
+    const size_t bytes = static_cast<size_t>(col.count * col.elem_size);
+    job.valid[task_idx] = scene_checksum(job.file->column(static_cast<SceneColumnType>(task_idx)), bytes) == col.checksum;
+}
+
+SceneFileStatus SceneFile::open(const char* path, WorkerPool* pool, bool verify_checksums) {
+    close();
+    if (!wMapFile(path, &_map))
+        return SCENE_FILE_IO_ERROR;
+
+    const unsigned char* data = static_cast<const unsigned char*>(_map.data);
+    const SceneFileHeader* header = reinterpret_cast<const SceneFileHeader*>(data);
+    if (_map.size < sizeof(SceneFileHeader) || memcmp(header->magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC)) != 0) {
+        close();
+        return SCENE_FILE_BAD_FORMAT;
+    }
+    if (header->version == 0 || header->version > SCENE_FILE_VERSION) {
+        close();
+        return SCENE_FILE_BAD_VERSION;
+    }
+    if (header->file_size != _map.size ||
+        header->columns_num > (_map.size - sizeof(SceneFileHeader)) / sizeof(SceneFileColumn)) {
+        close();
+        return SCENE_FILE_BAD_FORMAT;
+    }
+    const SceneFileColumn* columns = reinterpret_cast<const SceneFileColumn*>(data + sizeof(SceneFileHeader));
+    if (header_checksum(*header, columns) != header->header_checksum) {
+        close();
+        return SCENE_FILE_BAD_CHECKSUM;
+    }
+
+    // Columns table: known columns must be consistent and fit into file, unknown are skipped
+    const uint64_t data_begin = sizeof(SceneFileHeader) + header->columns_num * sizeof(SceneFileColumn);
+    bool consistent = true;
+    for (uint32_t i = 0; i < header->columns_num && consistent; ++i) {
+        const SceneFileColumn& col = columns[i];
+        if (col.type >= SCENE_COLUMNS_NUM)
+            continue;
+        const uint64_t count = column_count(col.type, header->planets_count, header->belt_count, col.count > 0);
+        consistent = !_columns[col.type] &&
+                     col.elem_size == column_elem_size[col.type] &&
+                     col.count == count &&
+                     col.offset % SCENE_FILE_ALIGNMENT == 0 &&
+                     col.offset >= data_begin &&
+                     col.offset <= _map.size &&
+                     col.count <= (_map.size - col.offset) / col.elem_size;
+        _columns[col.type] = &col;
+    }
+    for (unsigned int type = 0; type < SCENE_COLUMNS_NUM; ++type)
+        consistent = consistent && (_columns[type] || is_optional_column(type));
+    if (!consistent) {
+        close();
+        return SCENE_FILE_BAD_FORMAT;
+    }
+    _header = header;
+
+    if (verify_checksums) {
+        Job job;
+        job.file = this;
+        if (pool) {
+            pool->run(SceneFile::verify_task, &job, SCENE_COLUMNS_NUM);
+        } else {
+            for (unsigned int type = 0; type < SCENE_COLUMNS_NUM; ++type)
+                verify_task(&job, type, 0);
+        }
+        for (unsigned int type = 0; type < SCENE_COLUMNS_NUM; ++type) {
+            if (!job.valid[type]) {
+                close();
+                return SCENE_FILE_BAD_CHECKSUM;
+            }
+        }
+    }
+    return SCENE_FILE_OK;
+}
+
+const void* SceneFile::column(SceneColumnType type) const {
+    if (type >= SCENE_COLUMNS_NUM || !_columns[type])
+        return NULL;
+    return static_cast<const unsigned char*>(_map.data) + _columns[type]->offset;
+}
+
+const SceneEngineState* SceneFile::engine_state() const {
+    if (!_columns[SCENE_COL_ENGINE] || _columns[SCENE_COL_ENGINE]->count == 0)
+        return NULL;
+    return static_cast<const SceneEngineState*>(column(SCENE_COL_ENGINE));
+}
+
+void SceneFile::read_planets_task(void* arg, unsigned int task_idx, unsigned int worker_idx) {
+    Job& job = *static_cast<Job*>(arg);
+    const SceneFile& file = *job.file;
+    const size_t begin = task_idx * size_t(SCENE_FILE_CHUNK_SIZE);
+    const size_t end = std::min(begin + SCENE_FILE_CHUNK_SIZE, file.planets_count());
+
+    // Columns start at aligned offsets, so they are read as arrays in place
+    const uint32_t* id = static_cast<const uint32_t*>(file.column(SCENE_COL_ID));
+    const double* x = static_cast<const double*>(file.column(SCENE_COL_POS_X));
+    const double* y = static_cast<const double*>(file.column(SCENE_COL_POS_Y));
+    const double* vx = static_cast<const double*>(file.column(SCENE_COL_VEL_X));
+    const double* vy = static_cast<const double*>(file.column(SCENE_COL_VEL_Y));
+    const double* mass = static_cast<const double*>(file.column(SCENE_COL_MASS));
+    const double* rad = static_cast<const double*>(file.column(SCENE_COL_RAD));
+    const double* soft = static_cast<const double*>(file.column(SCENE_COL_SOFTENING));
+    const float* rgb = static_cast<const float*>(file.column(SCENE_COL_COLOR));
+    const uint8_t* flags = static_cast<const uint8_t*>(file.column(SCENE_COL_FLAGS));
+    // Engine state, may be absent
+    const double* prev_x = static_cast<const double*>(file.column(SCENE_COL_PREV_POS_X));
+    const double* prev_y = static_cast<const double*>(file.column(SCENE_COL_PREV_POS_Y));
+    const double* rest_ax = static_cast<const double*>(file.column(SCENE_COL_REST_ACC_X));
+    const double* rest_ay = static_cast<const double*>(file.column(SCENE_COL_REST_ACC_Y));
+    const uint32_t* rest_steps = static_cast<const uint32_t*>(file.column(SCENE_COL_REST_STEPS));
+
+    for (size_t i = begin; i < end; ++i) {
+        Planet& pl = job.out[i];
+        pl = Planet(Vector2d(x[i], y[i]), Vector2d(vx[i], vy[i]), mass[i], rad[i],
+                    Color_RGB(rgb[3 * i], rgb[3 * i + 1], rgb[3 * i + 2]), id[i], soft[i]);
+        pl.test_particle = (flags[i] & SCENE_FLAG_TEST_PARTICLE) != 0;
+        pl.sleeping = (flags[i] & SCENE_FLAG_SLEEPING) != 0;
+        if (prev_x && prev_y)
+            pl.prev_pos = Vector2d(prev_x[i], prev_y[i]);
+        if (rest_ax && rest_ay)
+            pl.rest_acc = Vector2d(rest_ax[i], rest_ay[i]);
+        if (rest_steps)
+            pl.rest_steps = rest_steps[i];
+    }
+}
+
+void SceneFile::read_planets(WorkerPool& pool, Planet* out) const {
+    Job job;
+    job.file = this;
+    job.out = out;
+    pool.run(SceneFile::read_planets_task, &job, static_cast<unsigned int>((planets_count() + SCENE_FILE_CHUNK_SIZE - 1) / SCENE_FILE_CHUNK_SIZE));
+}
+
+void SceneFile::read_belt(ParticleBelt& belt) const {
+    const size_t n = belt_count();
+    belt.resize(n);
+    if (n == 0)
+        return;
+    memcpy(belt.x(), column(SCENE_COL_BELT_X), n * sizeof(double));
+    memcpy(belt.y(), column(SCENE_COL_BELT_Y), n * sizeof(double));
+    memcpy(belt.vx(), column(SCENE_COL_BELT_VX), n * sizeof(double));
+    memcpy(belt.vy(), column(SCENE_COL_BELT_VY), n * sizeof(double));
+}
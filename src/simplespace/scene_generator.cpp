@@ -0,0 +1,145 @@
+//
+//  scene_generator.cpp
+//  simple-space
+//
+
+#include "scene_generator.h"
+
+#include <math.h>
+#include <algorithm> // std::min()
+
+// SplitMix64 finalizer: bijective mix with full avalanche
+static inline uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+SceneRandom::SceneRandom(uint64_t seed, uint64_t stream) :
+    _key(mix64(mix64(seed) ^ (stream * 0x9E3779B97F4A7C15ULL))),
+    _counter(0) {}
+
+uint64_t SceneRandom::next_u64() {
+    return mix64(_key + (_counter++) * 0x9E3779B97F4A7C15ULL);
+}
+
+double SceneRandom::uniform() {
+    return double(next_u64() >> 11) * (1.0 / 9007199254740992.0); // 53 bits
+}
+
+double SceneRandom::gaussian() {
+    // Box-Muller, one value per two uniforms (keeps numbers per body fixed)
+    double u = 1.0 - uniform(); // (0, 1]
+    double v = uniform();
+    return sqrt(-2.0 * log(u)) * cos(2 * M_PI * v);
+}
+
+// Position and velocity of circular orbit around params.center at radius r
+static void circular_orbit(const SceneParams& params, double r, double angle, Vector2d& pos, Vector2d& vel) {
+    double v = (r > 0) ? sqrt(CONST_G * params.central_mass_kg / r) : 0;
+    pos = Vector2d(params.center.x + r * cos(angle), params.center.y + r * sin(angle));
+    vel = Vector2d(params.center_vel.x - v * sin(angle), params.center_vel.y + v * cos(angle));
+}
+
+Planet generate_scene_body(const SceneParams& params, size_t idx) {
+    SceneRandom rnd(params.seed, idx);
+    Planet pl;
+    pl.mass_kg = params.body_mass_kg;
+    pl.rad_m = params.body_rad_m;
+    pl.test_particle = params.test_particles;
+
+    switch (params.kind) {
+        case SCENE_DISK: {
+            // Uniform surface density: r^2 is uniform between inner and outer radii squared
+            double r2_in = params.inner_rad_m * params.inner_rad_m;
+            double r2_out = params.outer_rad_m * params.outer_rad_m;
+            double r = sqrt(r2_in + (r2_out - r2_in) * rnd.uniform());
+            circular_orbit(params, r, 2 * M_PI * rnd.uniform(), pl.pos, pl.vel);
+            break;
+        }
+        case SCENE_BELT: {
+            double r = params.inner_rad_m + (params.outer_rad_m - params.inner_rad_m) * rnd.uniform();
+            circular_orbit(params, r, 2 * M_PI * rnd.uniform(), pl.pos, pl.vel);
+            break;
+        }
+        case SCENE_PLUMMER: {
+            // Projected Plummer profile: mass inside R is M * R^2 / (R^2 + a^2).
+            // Velocities: isotropic Gaussian with local dispersion of 3D Plummer model.
+            const double a = params.scale_rad_m;
+            double u = std::min(rnd.uniform(), 0.999); // Cut far tail
+            double r = a * sqrt(u / (1 - u));
+            double angle = 2 * M_PI * rnd.uniform();
+            double sigma = sqrt(CONST_G * params.central_mass_kg / (6 * sqrt(r * r + a * a)));
+            pl.mass_kg = params.central_mass_kg / double(params.count);
+            pl.pos = Vector2d(params.center.x + r * cos(angle), params.center.y + r * sin(angle));
+            pl.vel = Vector2d(params.center_vel.x + sigma * rnd.gaussian(), params.center_vel.y + sigma * rnd.gaussian());
+            break;
+        }
+        case SCENE_RANDOM_FIELD: {
+            pl.pos = Vector2d(params.left + (params.right - params.left) * rnd.uniform(),
+                              params.bottom + (params.top - params.bottom) * rnd.uniform());
+            double speed = params.max_speed * rnd.uniform();
+            double angle = 2 * M_PI * rnd.uniform();
+            pl.vel = Vector2d(speed * cos(angle), speed * sin(angle));
+            break;
+        }
+    }
+
+    pl.prev_pos = pl.pos;
+    pl.color = Color_RGB(float(0.1 + 0.9 * rnd.uniform()), float(0.1 + 0.9 * rnd.uniform()), float(0.1 + 0.9 * rnd.uniform()));
+    return pl;
+}
+
+struct SceneJob {
+    const SceneParams* params;
+    Planet* out;
+    unsigned int first_id;
+    ParticleBelt* belt;
+    size_t belt_first; // Index of first generated particle in belt
+};
+
+static void generate_bodies_task(void* arg, unsigned int task_idx, unsigned int worker_idx) {
+    SceneJob& job = *static_cast<SceneJob*>(arg);
+    const size_t begin = task_idx * size_t(SCENE_CHUNK_SIZE);
+    const size_t end = std::min(begin + SCENE_CHUNK_SIZE, job.params->count);
+    for (size_t i = begin; i < end; ++i) {
+        job.out[i] = generate_scene_body(*job.params, i);
+        job.out[i].id = job.first_id + static_cast<unsigned int>(i);
+    }
+}
+
+static void generate_particles_task(void* arg, unsigned int task_idx, unsigned int worker_idx) {
+    SceneJob& job = *static_cast<SceneJob*>(arg);
+    const size_t begin = task_idx * size_t(SCENE_CHUNK_SIZE);
+    const size_t end = std::min(begin + SCENE_CHUNK_SIZE, job.params->count);
+    ParticleBelt& belt = *job.belt;
+    for (size_t i = begin; i < end; ++i) {
+        Planet pl = generate_scene_body(*job.params, i);
+        const size_t k = job.belt_first + i;
+        belt.x()[k] = pl.pos.x;
+        belt.y()[k] = pl.pos.y;
+        belt.vx()[k] = pl.vel.x;
+        belt.vy()[k] = pl.vel.y;
+    }
+}
+
+static unsigned int scene_tasks_num(const SceneParams& params) {
+    return static_cast<unsigned int>((params.count + SCENE_CHUNK_SIZE - 1) / SCENE_CHUNK_SIZE);
+}
+
+void generate_scene(WorkerPool& pool, const SceneParams& params, Planet* out, unsigned int first_id) {
+    SceneJob job;
+    job.params = &params;
+    job.out = out;
+    job.first_id = first_id;
+    pool.run(generate_bodies_task, &job, scene_tasks_num(params));
+}
+
+void generate_scene(WorkerPool& pool, const SceneParams& params, ParticleBelt& belt) {
+    SceneJob job;
+    job.params = &params;
+    job.belt = &belt;
+    job.belt_first = belt.size();
+    belt.resize(belt.size() + params.count);
+    pool.run(generate_particles_task, &job, scene_tasks_num(params));
+}
@@ -0,0 +1,128 @@
+//
+//  scratch_arena.cpp
+//  simple-space
+//
+
+#include "scratch_arena.h"
+
+#include <stdlib.h> // malloc(), free()
+#include <stdint.h> // uintptr_t
+#include <new>      // std::bad_alloc
+
+#if defined(__APPLE__) || defined(__linux__)
+    #include <sys/mman.h> // mmap(), madvise()
+#endif
+
+extern "C"
+{
+    #include "logs.h"
+}
+
+static const char* tag = "ScratchArena";
+
+static const size_t huge_page_size = 2 * 1024 * 1024;
+
+ScratchArena::ScratchArena(size_t initial_size, bool use_huge_pages) :
+    _current(0),
+    _offset(0),
+    _used(0),
+    _peak_used(0),
+    _use_huge_pages(use_huge_pages) {
+    if (initial_size > 0)
+        _blocks.push_back(allocate_block(initial_size));
+}
+
+ScratchArena::~ScratchArena() {
+    for (std::vector<Block>::iterator it = _blocks.begin(), it_end = _blocks.end(); it != it_end; ++it)
+        free_block(*it);
+}
+
+ScratchArena::Block ScratchArena::allocate_block(size_t size) {
+#if defined(__APPLE__) || defined(__linux__)
+    if (_use_huge_pages) {
+        size_t mapped_size = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+        void* data = MAP_FAILED;
+    #if defined(MAP_HUGETLB)
+        // Explicit huge pages (needs pages reserved in /proc/sys/vm/nr_hugepages)
+        data = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    #endif
+        if (data == MAP_FAILED) {
+            // Fallback to transparent huge pages, if supported by system
+            data = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        #if defined(MADV_HUGEPAGE)
+            if (data != MAP_FAILED)
+                madvise(data, mapped_size, MADV_HUGEPAGE);
+        #endif
+        }
+        if (data != MAP_FAILED)
+            return Block(static_cast<char*>(data), mapped_size, true);
+        LogE(tag, "mmap() of %lu bytes failed, using malloc()", (unsigned long)mapped_size);
+    }
+#endif
+
+    char* data = static_cast<char*>(malloc(size));
+    if (data == NULL) {
+        LogE(tag, "malloc() of %lu bytes failed", (unsigned long)size);
+        throw std::bad_alloc();
+    }
+    return Block(data, size, false);
+}
+
+void ScratchArena::free_block(const Block& block) {
+#if defined(__APPLE__) || defined(__linux__)
+    if (block.mapped) {
+        munmap(block.data, block.size);
+        return;
+    }
+#endif
+    free(block.data);
+}
+
+void* ScratchArena::allocate(size_t bytes, size_t alignment) {
+    while (_current < _blocks.size()) {
+        Block& block = _blocks[_current];
+        uintptr_t base = reinterpret_cast<uintptr_t>(block.data);
+        size_t aligned_offset = ((base + _offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+        if (aligned_offset + bytes <= block.size) {
+            _offset = aligned_offset + bytes;
+            _used += bytes;
+            if (_used > _peak_used)
+                _peak_used = _used;
+            return block.data + aligned_offset;
+        }
+        // Try next block (if any left from previous steps)
+        ++_current;
+        _offset = 0;
+    }
+
+    // Out of space: add a new block, at least twice as big as the last one
+    size_t new_size = _blocks.empty() ? 0 : _blocks.back().size * 2;
+    if (new_size < bytes + alignment)
+        new_size = bytes + alignment;
+    _blocks.push_back(allocate_block(new_size));
+    _current = _blocks.size() - 1;
+    _offset = 0;
+    return allocate(bytes, alignment);
+}
+
+void ScratchArena::reset() {
+    if (_blocks.size() > 1) {
+        // Merge blocks, so next steps fit into single one
+        size_t total_size = get_capacity();
+        for (std::vector<Block>::iterator it = _blocks.begin(), it_end = _blocks.end(); it != it_end; ++it)
+            free_block(*it);
+        _blocks.clear();
+        _blocks.push_back(allocate_block(total_size));
+        LogD(tag, "arena blocks merged into %lu bytes", (unsigned long)total_size);
+    }
+    _current = 0;
+    _offset = 0;
+    _used = 0;
+}
+
+size_t ScratchArena::get_capacity() const {
+    size_t capacity = 0;
+    for (std::vector<Block>::const_iterator it = _blocks.begin(), it_end = _blocks.end(); it != it_end; ++it)
+        capacity += it->size;
+    return capacity;
+}
@@ -10,82 +10,1160 @@
 #include <sstream>
 #include <algorithm>
 #include <vector>
+#include <limits>
+#include <cmath> // std::isfinite()
+#include <string.h> // memset(), memcpy()
+#include <stdint.h> // uint64_t
 using std::vector;
 
 const char* tag = "SimpleSpace";
 
-SimpleSpace::SimpleSpace(int Time_Step_ms) : time_step_ms(Time_Step_ms), planets_number_max(500) {
+SimpleSpace::SimpleSpace(int Time_Step_ms, unsigned int Workers_Num, const SpaceConfig& Config) :
+    config(Config),
+    step_func(select_step_func(Config)),
+    steps_since_locality_check(0),
+    reorders_count(0),
+    steps_count(0),
+    time_step_ms(Time_Step_ms),
+    next_planet_id(0),
+    scratch(SCRATCH_ARENA_SIZE, SCRATCH_ARENA_HUGE_PAGES > 0),
+    collision_skin(0),
+    worker_pool(Workers_Num),
+    gravity_solver_type(GRAVITY_SOLVER_REFERENCE),
+    symmetric_solver(new SymmetricGravitySolver(worker_pool)),
+    tiled_solver(new TiledGravitySolver(worker_pool)),
+    journal_session(0),
+    history_dirty_begin(0),
+    history_belt_dirty(true),
+    diagnostics_interval(0),
+    collision_loss_j(0),
+    softening_type(GRAVITY_SOFTENING),
+    softening_length_m(GRAVITY_SOFTENING_LENGTH),
+    gravity_precision(GRAVITY_PRECISION_DOUBLE),
+    sleeping_forces_skipped(false),
+    snapshot_version(0),
+    belt_points_version(0),
+    belt_points_drawn(0),
+    planets_number_max(500) {
     wMutexInit(&movement_step_mutex);
+    publish_snapshot();
 }
 SimpleSpace::~SimpleSpace() {
     wMutexDestroy(&movement_step_mutex);
 }
 
 unsigned long SimpleSpace::get_planets_count() const {
-    return planets.size();
+    return get_snapshot()->planets.size();
 }
 
 int SimpleSpace::get_model_time_step_ms() const {
     return time_step_ms;
 }
 
+unsigned long SimpleSpace::get_reorders_count() const {
+    return reorders_count;
+}
+
+unsigned long SimpleSpace::get_steps_count() const {
+    return steps_count;
+}
+
+void SimpleSpace::set_checkpoints(const CheckpointConfig& checkpoints) {
+    wMutexLock(&movement_step_mutex);
+    checkpointer.configure(checkpoints);
+    wMutexUnlock(&movement_step_mutex);
+}
+
+void SimpleSpace::wait_checkpoints() {
+    wMutexLock(&movement_step_mutex);
+    checkpointer.wait();
+    wMutexUnlock(&movement_step_mutex);
+}
+
+CheckpointStats SimpleSpace::get_checkpoint_stats() {
+    wMutexLock(&movement_step_mutex);
+    checkpointer.poll();
+    CheckpointStats stats = checkpointer.stats();
+    wMutexUnlock(&movement_step_mutex);
+    return stats;
+}
+
+bool SimpleSpace::start_recording(const char* path, const TrajectoryConfig& config) {
+    wMutexLock(&movement_step_mutex);
+    bool ok = recorder.start(path, config);
+    wMutexUnlock(&movement_step_mutex);
+    return ok;
+}
+
+void SimpleSpace::stop_recording() {
+    wMutexLock(&movement_step_mutex);
+    recorder.stop();
+    wMutexUnlock(&movement_step_mutex);
+}
+
+TrajectoryStats SimpleSpace::get_recording_stats() const {
+    // Recorder's file and timers are changed by steps
+    wMutexLock(&movement_step_mutex);
+    TrajectoryStats stats = recorder.stats();
+    wMutexUnlock(&movement_step_mutex);
+    return stats;
+}
+
+JournalStatus SimpleSpace::start_journal(const char* path) {
+    wMutexLock(&movement_step_mutex);
+    do_apply_pending_commands(); // Posted before journal, part of initial scene
+    JournalStatus status = journal.start(path, worker_pool.workersNum(), time_step_ms, steps_count,
+                                         planets, belt, make_engine_state());
+    ++journal_session;
+    publish_snapshot();
+    wMutexUnlock(&movement_step_mutex);
+    return status;
+}
+
+void SimpleSpace::stop_journal() {
+    wMutexLock(&movement_step_mutex);
+    journal.stop(steps_count);
+    wMutexUnlock(&movement_step_mutex);
+}
+
+void SimpleSpace::journal_front_end_event(JournalEventType type, long value) {
+    wMutexLock(&movement_step_mutex);
+    if (journal.is_recording())
+        journal.simple(steps_count, type, value);
+    wMutexUnlock(&movement_step_mutex);
+}
+
+void SimpleSpace::do_apply_journal_event(const JournalEvent& event) {
+    switch (event.type) {
+        case JOURNAL_ADD_PLANET:
+            do_add_planet(event.planet, event.id);
+            if (next_planet_id <= event.id)
+                next_planet_id = event.id + 1;
+            break;
+        case JOURNAL_REMOVE_PLANET:
+            do_remove_planet(event.id);
+            break;
+        case JOURNAL_MODIFY_PLANET:
+            do_modify_planet(event.planet);
+            break;
+        case JOURNAL_REMOVE_ALL:
+            do_remove_all_objects();
+            break;
+        case JOURNAL_ADD_SCENE:
+            do_add_scene(event.scene, event.id);
+            if (next_planet_id < event.id + event.scene.count)
+                next_planet_id = static_cast<unsigned int>(event.id + event.scene.count);
+            break;
+        case JOURNAL_ADD_SCENE_PARTICLES:
+            generate_scene(worker_pool, event.scene, belt);
+            mark_belt_changed();
+            break;
+        case JOURNAL_ADD_BELT_PARTICLES:
+            do_add_belt_particles(event.pos, event.vel);
+            break;
+        case JOURNAL_REMOVE_BELT:
+            belt.clear();
+            mark_belt_changed();
+            break;
+        case JOURNAL_SETTINGS:
+            apply_engine_state(event.settings);
+            break;
+        case JOURNAL_SAVE_UNDO_POINT:
+            do_save_undo_point();
+            break;
+        case JOURNAL_UNDO:
+        case JOURNAL_REDO:
+            do_undo_or_redo(event.type == JOURNAL_UNDO);
+            break;
+        default:
+            break; // Not scene changes
+    }
+}
+
+JournalStatus SimpleSpace::replay_journal(const char* path, unsigned long until_step, JournalReplayStats* stats) {
+    JournalReplayStats replay = {0, 0, 0};
+    JournalReader reader;
+    JournalStatus status = reader.open(path);
+
+    JournalEvent event;
+    bool end = (status != JOURNAL_OK);
+    while (!end && reader.next_event(event)) {
+        // Steps between events, as many as session made (none before initial scene)
+        const bool initial = (replay.events == 0);
+        while (!initial && (steps_count < event.step) && (steps_count < until_step)) {
+            const unsigned long steps_before = steps_count;
+            move_one_step();
+            if (steps_count == steps_before) {
+                status = JOURNAL_DIVERGED; // Empty scene doesn't step, recorded one did
+                replay.diverged_step = steps_count;
+                end = true;
+                break;
+            }
+        }
+        if (end || (!initial && (event.step > until_step)))
+            break;
+
+        ++replay.events;
+        switch (event.type) {
+            case JOURNAL_LOAD_SCENE: {
+                std::string copy = JournalWriter::scene_copy_path(path, static_cast<unsigned int>(event.value));
+                if (load_scene_file(copy.c_str(), true) != SCENE_FILE_OK) {
+                    status = JOURNAL_IO_ERROR;
+                    end = true;
+                }
+                break;
+            }
+            case JOURNAL_CHECK:
+                wMutexLock(&movement_step_mutex);
+                if (journal_state_hash(planets, belt, reader.header().version) == static_cast<uint64_t>(event.value)) {
+                    ++replay.checks;
+                } else {
+                    status = JOURNAL_DIVERGED;
+                    replay.diverged_step = steps_count;
+                    end = true;
+                }
+                wMutexUnlock(&movement_step_mutex);
+                break;
+            case JOURNAL_END:
+                end = true;
+                break;
+            default:
+                wMutexLock(&movement_step_mutex);
+                do_apply_journal_event(event);
+                publish_snapshot();
+                wMutexUnlock(&movement_step_mutex);
+                break;
+        }
+    }
+
+    if (stats)
+        *stats = replay;
+    return status;
+}
+
+std::shared_ptr<const UndoState> SimpleSpace::capture_history(unsigned long tag) {
+    std::shared_ptr<const UndoState> state = history.capture(planets, history_dirty_begin, belt, history_belt_dirty, tag);
+    history_dirty_begin = planets.size();
+    history_belt_dirty = false;
+    return state;
+}
+
+void SimpleSpace::save_undo_point() {
+    wMutexLock(&movement_step_mutex);
+    do_apply_pending_commands();
+    do_save_undo_point();
+    publish_snapshot();
+    wMutexUnlock(&movement_step_mutex);
+}
+
+void SimpleSpace::do_save_undo_point() {
+    // Replay saves the same state, so it can be restored by event
+    const bool journaled = journal.is_recording();
+    history.push(capture_history(journaled ? journal_session : 0));
+    if (journaled)
+        journal.simple(steps_count, JOURNAL_SAVE_UNDO_POINT);
+}
+
+bool SimpleSpace::undo_or_redo(bool undo) {
+    wMutexLock(&movement_step_mutex);
+    do_apply_pending_commands();
+    bool restored = do_undo_or_redo(undo);
+    publish_snapshot();
+    wMutexUnlock(&movement_step_mutex);
+    return restored;
+}
+
+bool SimpleSpace::do_undo_or_redo(bool undo) {
+    const UndoState* next = undo ? history.next_undo() : history.next_redo();
+    if (next == NULL)
+        return false;
+    // Replay has only states captured by events of this journal (others were made before
+    // it started or restored without replay knowing): they are journaled as few bytes
+    // event, the rest as scene load. Time and settings go on, only objects are restored.
+    const bool as_event = journal.is_recording() && (next->tag == journal_session);
+    std::shared_ptr<const UndoState> current = capture_history(as_event ? journal_session : 0);
+    std::shared_ptr<const UndoState> state = undo ? history.undo(current) : history.redo(current);
+    UndoHistory::restore(*state, planets, belt);
+    id_to_index.clear();
+    update_id_map(0);
+    history_dirty_begin = planets.size(); // Same as restored state, next capture shares all of it
+    history_belt_dirty = false;
+    if (as_event)
+        journal.simple(steps_count, undo ? JOURNAL_UNDO : JOURNAL_REDO);
+    else if (journal.is_recording())
+        journal.load_scene(steps_count, planets, belt, make_engine_state());
+    return true;
+}
+
+bool SimpleSpace::undo() {
+    return undo_or_redo(true);
+}
+
+bool SimpleSpace::redo() {
+    return undo_or_redo(false);
+}
+
+bool SimpleSpace::can_undo() {
+    wMutexLock(&movement_step_mutex);
+    bool result = history.can_undo();
+    wMutexUnlock(&movement_step_mutex);
+    return result;
+}
+
+bool SimpleSpace::can_redo() {
+    wMutexLock(&movement_step_mutex);
+    bool result = history.can_redo();
+    wMutexUnlock(&movement_step_mutex);
+    return result;
+}
+
+// Interleaves bits of x and y (16 bits each) into Z-order code
+static inline uint32_t morton_code(uint32_t x, uint32_t y) {
+    x = (x | (x << 8)) & 0x00FF00FF;
+    x = (x | (x << 4)) & 0x0F0F0F0F;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    y = (y | (y << 8)) & 0x00FF00FF;
+    y = (y | (y << 4)) & 0x0F0F0F0F;
+    y = (y | (y << 2)) & 0x33333333;
+    y = (y | (y << 1)) & 0x55555555;
+    return x | (y << 1);
+}
+
+// Grid coordinate of Morton code: out of range values are clamped and NaN goes to 0
+// (converting them to integer right away is undefined behaviour)
+static inline uint32_t grid_cell(double coord) {
+    if (!(coord > 0))
+        return 0;
+    return (coord < 65535.0) ? static_cast<uint32_t>(coord) : 65535;
+}
+
+void SimpleSpace::check_locality_and_reorder() {
+    const size_t planets_count = planets.size();
+    if (planets_count < MORTON_REORDER_MIN_BODIES)
+        return;
+
+    scratch.reset();
+    // Bounding box of finite positions only: a body sent to infinity (or NaN) by bad input
+    // must not spoil grid of others
+    double min_x = std::numeric_limits<double>::infinity(), max_x = -min_x, min_y = min_x, max_y = -min_x;
+    for (size_t i = 0; i < planets_count; ++i) {
+        if (!std::isfinite(planets[i].pos.x) || !std::isfinite(planets[i].pos.y))
+            continue;
+        min_x = std::min(min_x, planets[i].pos.x);
+        max_x = std::max(max_x, planets[i].pos.x);
+        min_y = std::min(min_y, planets[i].pos.y);
+        max_y = std::max(max_y, planets[i].pos.y);
+    }
+    // 65536 x 65536 grid over bounding box
+    const double scale = 65535.0 / std::max(std::max(max_x - min_x, max_y - min_y), 1.0);
+    uint32_t* codes = scratch.allocate_array<uint32_t>(planets_count);
+    size_t out_of_order = 0;
+    for (size_t i = 0; i < planets_count; ++i) {
+        codes[i] = morton_code(grid_cell((planets[i].pos.x - min_x) * scale),
+                               grid_cell((planets[i].pos.y - min_y) * scale));
+        if ((i > 0) && (codes[i] < codes[i - 1]))
+            ++out_of_order;
+    }
+
+    // Sorted storage has no neighbours out of order, random one has about a half
+    if (out_of_order < MORTON_REORDER_THRESHOLD * planets_count)
+        return;
+
+    unsigned int* order = scratch.allocate_array<unsigned int>(planets_count);
+    for (size_t i = 0; i < planets_count; ++i)
+        order[i] = static_cast<unsigned int>(i);
+    std::sort(order, order + planets_count, [&](unsigned int a, unsigned int b) {
+        return (codes[a] < codes[b]) || ((codes[a] == codes[b]) && (a < b));
+    });
+    reorder_buffer.resize(planets_count);
+    for (size_t i = 0; i < planets_count; ++i)
+        reorder_buffer[i] = planets[order[i]];
+    planets.swap(reorder_buffer);
+    update_id_map(0);
+    ++reorders_count;
+}
+
+size_t SimpleSpace::find_planet_index(unsigned int id) {
+    if ((id < id_to_index.size()) && (id_to_index[id] < planets.size()) && (planets[id_to_index[id]].id == id))
+        return id_to_index[id];
+    // Stale remap (planets were changed bypassing engine): search and repair
+    for (size_t i = 0; i < planets.size(); ++i) {
+        if (planets[i].id == id) {
+            update_id_map(0);
+            mark_planets_changed(0); // Unmarked changes go into next undo state
+            return i;
+        }
+    }
+    return planets.size();
+}
+
+void SimpleSpace::update_id_map(size_t begin) {
+    for (size_t i = begin; i < planets.size(); ++i) {
+        const unsigned int id = planets[i].id;
+        if (id >= id_to_index.size())
+            id_to_index.resize(id + 1, std::numeric_limits<unsigned int>::max());
+        id_to_index[id] = static_cast<unsigned int>(i);
+    }
+}
+
 void SimpleSpace::move_one_step() {
     wMutexLock(&movement_step_mutex);
 
-    if (planets.size() == 0)
+    do_apply_pending_commands();
+
+    if (planets.size() == 0) {
+        publish_snapshot();
+        wMutexUnlock(&movement_step_mutex);
         return;
+    }
+
+    if (++steps_since_locality_check >= LOCALITY_CHECK_INTERVAL) {
+        steps_since_locality_check = 0;
+        check_locality_and_reorder();
+    }
+
+    (this->*step_func)();
+    ++steps_count;
+    mark_planets_changed(0);
+    if (belt.size())
+        mark_belt_changed();
+
+    checkpointer.poll();
+    if (checkpointer.is_due(steps_count))
+        checkpointer.start(steps_count, planets, belt, make_engine_state());
+    if (recorder.is_due(steps_count))
+        recorder.capture(steps_count, planets);
+    if (journal.is_recording() && (steps_count % JOURNAL_CHECK_INTERVAL == 0))
+        journal.check(steps_count, journal_state_hash(planets, belt));
+
+    publish_snapshot(true);
+    wMutexUnlock(&movement_step_mutex);
+}
+
+SceneEngineState SimpleSpace::make_engine_state() const {
+    SceneEngineState state;
+    memset(&state, 0, sizeof(state));
+    state.steps_count = steps_count;
+    state.reorders_count = reorders_count;
+    state.time_step_ms = time_step_ms;
+    state.collision_skin = collision_skin;
+    state.softening_length_m = softening_length_m;
+    state.coef_res = config.coef_res;
+    state.border_friction = config.border_friction;
+    state.left_border = config.left_border;
+    state.right_border = config.right_border;
+    state.top_border = config.top_border;
+    state.bottom_border = config.bottom_border;
+    state.global_top_mass = config.global_top_mass;
+    state.global_right_mass = config.global_right_mass;
+    state.sleep_velocity = config.sleep_velocity;
+    state.sleep_acc_change = config.sleep_acc_change;
+    state.sleep_steps = config.sleep_steps;
+    state.steps_since_locality_check = steps_since_locality_check;
+    state.next_planet_id = next_planet_id;
+    state.gravity_enabled = config.gravity_enabled;
+    state.borders_enabled = config.borders_enabled;
+    state.sleep_enabled = config.sleep_enabled;
+    state.collision_mode = static_cast<uint8_t>(config.collision_mode);
+    state.gravity_solver = static_cast<uint8_t>(gravity_solver_type);
+    state.gravity_precision = static_cast<uint8_t>(gravity_precision);
+    state.softening_type = static_cast<uint8_t>(softening_type);
+    return state;
+}
+
+// Enums of state come from file, they are cast only after this check
+static bool is_valid_engine_state(const SceneEngineState& state) {
+    return (state.collision_mode <= COLLISION_MODE_MERGE) &&
+           (state.gravity_solver <= GRAVITY_SOLVER_PM) &&
+           (state.gravity_precision <= GRAVITY_PRECISION_MIXED) &&
+           (state.softening_type <= Physics::SOFTENING_SPLINE);
+}
+
+void SimpleSpace::apply_engine_state(const SceneEngineState& state) {
+    steps_count = static_cast<unsigned long>(state.steps_count);
+    reorders_count = static_cast<unsigned long>(state.reorders_count);
+    time_step_ms = state.time_step_ms;
+    collision_skin = state.collision_skin;
+    softening_length_m = state.softening_length_m;
+    config.coef_res = state.coef_res;
+    config.border_friction = state.border_friction;
+    config.left_border = state.left_border;
+    config.right_border = state.right_border;
+    config.top_border = state.top_border;
+    config.bottom_border = state.bottom_border;
+    config.global_top_mass = state.global_top_mass;
+    config.global_right_mass = state.global_right_mass;
+    config.sleep_velocity = state.sleep_velocity;
+    config.sleep_acc_change = state.sleep_acc_change;
+    config.sleep_steps = state.sleep_steps;
+    steps_since_locality_check = state.steps_since_locality_check;
+    if (next_planet_id < state.next_planet_id)
+        next_planet_id = state.next_planet_id;
+    config.gravity_enabled = state.gravity_enabled != 0;
+    config.borders_enabled = state.borders_enabled != 0;
+    config.sleep_enabled = state.sleep_enabled != 0;
+    config.collision_mode = static_cast<CollisionMode>(state.collision_mode);
+    step_func = select_step_func(config);
+    gravity_solver_type = static_cast<GravitySolverType>(state.gravity_solver);
+    if ((gravity_solver_type == GRAVITY_SOLVER_PM) && !pm_solver)
+        pm_solver.reset(new PMGravitySolver(worker_pool));
+    gravity_precision = static_cast<GravityPrecision>(state.gravity_precision);
+    softening_type = static_cast<Physics::SofteningType>(state.softening_type);
+}
+
+SimpleSpace::StepFunc SimpleSpace::select_step_func(const SpaceConfig& config) {
+    // All combinations are instantiated here, runtime config only picks one
+    static const StepFunc step_funcs[12] = {
+        &SimpleSpace::step<SpacePolicy<false, false, false, false> >,
+        &SimpleSpace::step<SpacePolicy<false, false, true,  false> >,
+        &SimpleSpace::step<SpacePolicy<false, true,  false, false> >,
+        &SimpleSpace::step<SpacePolicy<false, true,  true,  false> >,
+        &SimpleSpace::step<SpacePolicy<true,  false, false, false> >,
+        &SimpleSpace::step<SpacePolicy<true,  false, true,  false> >,
+        &SimpleSpace::step<SpacePolicy<true,  true,  false, false> >,
+        &SimpleSpace::step<SpacePolicy<true,  true,  true,  false> >,
+        // Sleeping (borders only)
+        &SimpleSpace::step<SpacePolicy<false, true,  false, true > >,
+        &SimpleSpace::step<SpacePolicy<false, true,  true,  true > >,
+        &SimpleSpace::step<SpacePolicy<true,  true,  false, true > >,
+        &SimpleSpace::step<SpacePolicy<true,  true,  true,  true > >
+    };
+    if (config.sleep_enabled && config.borders_enabled)
+        return step_funcs[8 + (config.gravity_enabled ? 2 : 0) + (config.external_fields_enabled() ? 1 : 0)];
+    return step_funcs[(config.gravity_enabled ? 4 : 0) +
+                      (config.borders_enabled ? 2 : 0) +
+                      (config.external_fields_enabled() ? 1 : 0)];
+}
+
+template <class Policy>
+void SimpleSpace::step() {
+    scratch.reset();
+    const size_t planets_count = planets.size();
+
+    // Fisrt: save current positions, gravity is calculated for positions at step beginning
+    for (vector<Planet>::iterator it = planets.begin(), it_end = planets.end(); it != it_end; ++it)
+        it->prev_pos = it->pos;
+
+    // Diagnostics step: motion sums by state at step beginning, potential by gravity pass
+    const bool measure = (diagnostics_interval > 0) && (steps_count % diagnostics_interval == 0);
+    double* potential = NULL;
+    if (measure) {
+        measure_motion(worker_pool, planets, diagnostics);
+        diagnostics.step = steps_count;
+        diagnostics.collision_loss_j = collision_loss_j;
+        diagnostics.potential_valid = !Policy::gravity || (gravity_solver_type != GRAVITY_SOLVER_PM); // PM has no potential
+        if (Policy::gravity && diagnostics.potential_valid) {
+            potential = scratch.allocate_array<double>(planets_count);
+            std::fill(potential, potential + planets_count, 0.0);
+        }
+    }
+
+    // Sleeping bodies don't move, so between force checks (every SLEEP_FORCE_CHECK_INTERVAL
+    // steps and diagnostics ones) they are gravity sources only and pairs of them are skipped
+    sleeping_forces_skipped = Policy::sleeping && !measure && (steps_count % SLEEP_FORCE_CHECK_INTERVAL != 0);
+
+    // Second: gravity and movement. Gravity pass also collects candidates for collision:
+    // pairs which are closer than sum of radii plus doubled collision skin
+    Vector2d* acc = scratch.allocate_array<Vector2d>(planets_count);
+    ScratchBuffer<CollisionPair> candidates(scratch, planets_count);
+    bool candidates_collected = false;
+    double max_shift = 0;
+
+    if (gravity_solver_type == GRAVITY_SOLVER_REFERENCE) {
+        candidates_collected = reference_gravity_and_movement<Policy>(acc, potential, candidates, max_shift);
+    } else {
+        add_external_fields<Policy>(0, planets_count, acc);
+
+        if (Policy::gravity) {
+            // Solvers take sleeping massive bodies (if their forces are skipped) first, then
+            // other massive bodies and test particles after them. Without test particles and
+            // skipped ones order is the planets one, otherwise order[] maps solver index to planet.
+            size_t massive_count = 0, sleeping_count = 0;
+            for (size_t i = 0; i < planets_count; ++i) {
+                if (!planets[i].test_particle) {
+                    ++massive_count;
+                    if (sleeping_forces_skipped && planets[i].sleeping)
+                        ++sleeping_count;
+                }
+            }
+            size_t* order = NULL;
+            Vector2d* solver_acc = acc;
+            double* solver_potential = potential;
+            if ((massive_count < planets_count) || (sleeping_count > 0)) {
+                order = scratch.allocate_array<size_t>(planets_count);
+                size_t next_sleeping = 0, next_massive = sleeping_count, next_test = massive_count;
+                for (size_t i = 0; i < planets_count; ++i) {
+                    const Planet& pl = planets[i];
+                    if (pl.test_particle)
+                        order[next_test++] = i;
+                    else if (sleeping_forces_skipped && pl.sleeping)
+                        order[next_sleeping++] = i;
+                    else
+                        order[next_massive++] = i;
+                }
+                solver_acc = scratch.allocate_array<Vector2d>(planets_count);
+                std::fill(solver_acc, solver_acc + planets_count, Vector2d());
+                if (potential) {
+                    solver_potential = scratch.allocate_array<double>(planets_count);
+                    std::fill(solver_potential, solver_potential + planets_count, 0.0);
+                }
+            }
+
+            GravityBodies bodies;
+            double* x = scratch.allocate_array<double>(planets_count);
+            double* y = scratch.allocate_array<double>(planets_count);
+            double* mass = scratch.allocate_array<double>(planets_count);
+            double* rad = scratch.allocate_array<double>(planets_count);
+            double* soft = scratch.allocate_array<double>(planets_count);
+            for (size_t k = 0; k < planets_count; ++k) {
+                const Planet& pl = planets[order ? order[k] : k];
+                x[k] = pl.prev_pos.x;
+                y[k] = pl.prev_pos.y;
+                mass[k] = pl.mass_kg;
+                rad[k] = pl.rad_m;
+                soft[k] = std::max(softening_length_m, pl.softening_m);
+            }
+            bodies.count = planets_count;
+            bodies.massive_count = massive_count;
+            bodies.sleeping_count = sleeping_count;
+            bodies.x = x;
+            bodies.y = y;
+            bodies.mass = mass;
+            bodies.rad = rad;
+            bodies.soft = soft;
+            bodies.softening = softening_type;
+            bodies.precision = gravity_precision;
+            GravitySolver* solver = symmetric_solver.get();
+            if (gravity_solver_type == GRAVITY_SOLVER_TILED) {
+                solver = tiled_solver.get();
+            } else if (gravity_solver_type == GRAVITY_SOLVER_PM) {
+                pm_solver->set_domain(config.left_border, config.bottom_border, config.right_border, config.top_border);
+                solver = pm_solver.get();
+            }
+            candidates_collected = solver->compute(bodies, solver_acc, solver_potential, 2 * collision_skin, candidates);
 
-    for (vector<Planet>::iterator ita = planets.begin(), ita_end = planets.end(); ita != ita_end; ++ita) {
-        // Fisrt: save current position
-        ita->prev_pos = ita->pos;
-
-        // Second: calculate new positions for planets with/without gravity after movement
-        Vector2d acc;
-        #if (GRAVITY_ENABLED > 0)
-        for (vector<Planet>::const_iterator itb = planets.begin(), itb_end = planets.end(); itb != itb_end; ++itb) {
-            if (ita != itb) {
-                // Calculate acceleration for some planet (ita), produced by others one by one (itb)
-                double acc_abs;
-                pair<double, double> DistAngle = Physics::DistAngleFromPos(ita->prev_pos, itb->prev_pos);
-                acc_abs = Physics::GravAcc(itb->mass_kg, DistAngle.first);
-                acc.x += acc_abs * cos(DistAngle.second);    // accX = acc * cos(fi)
-                acc.y += acc_abs * sin(DistAngle.second);    // accY = acc * sin(fi)
+            if (order) {
+                for (size_t k = 0; k < planets_count; ++k) {
+                    acc[order[k]].x += solver_acc[k].x;
+                    acc[order[k]].y += solver_acc[k].y;
+                    if (potential)
+                        potential[order[k]] = solver_potential[k];
+                }
             }
         }
-        #endif
-
-        #if (BORDERS_ENABLED > 0)
-        acc.y += Physics::GravAcc(GLOBAL_TOP_MASS, abs(ita->pos.y - TOP_BORDER));
-        acc.x += Physics::GravAcc(GLOBAL_RIGHT_MASS, abs(ita->pos.x - RIGHT_BORDER));
-        #endif
-
-        // Third: make movement, updating position and velocity
-        Physics::MoveWithConstAcc(ita->pos, ita->vel, acc, (time_step_ms/1000.0));
-    }
-
-    // Collision detection and resolving
-    for (vector<Planet>::iterator ita = planets.begin(), ita_end = --planets.end(); ita != ita_end; ++ita) {
-        for (vector<Planet>::iterator itb = ita + 1, itb_end = planets.end(); itb != itb_end; ++itb) {
-            double dist = Physics::DistFromPos(ita->pos, itb->pos);
-            double rad_sum = ita->rad_m + itb->rad_m;
-            if (dist < rad_sum) {
-                // Debug log
-                //cout << "Collision between: " << ita->id << " and " << itb->id << endl;
-                resolve_body_collision(*ita, *itb);
+
+        max_shift = move_planets<Policy>(0, planets_count, acc);
+    }
+
+    if (measure) {
+        diagnostics.potential_j = potential ? measure_potential_energy(worker_pool, planets, potential) : 0;
+        if (!diagnostics.valid)
+            diagnostics.initial_j = diagnostics.total_j() + diagnostics.collision_loss_j;
+        diagnostics.valid = true;
+    }
+
+    if (belt.size() > 0)
+        advance_belt<Policy>();
+
+    // Third: collision detection and resolving.
+    // No planet moved further than collision skin => any overlapping pair was closer than
+    // (rad_sum + 2 * skin) at step beginning, so it's in candidates list.
+    // Otherwise candidates may be incomplete and all pairs are checked.
+    resolve_collisions<Policy>(candidates_collected && (max_shift <= collision_skin), candidates);
+
+    // Skin for next step: twice the current max shift gives margin for accelerating bodies
+    collision_skin = 2 * max_shift;
+}
+
+template <class Policy>
+void SimpleSpace::add_external_fields(size_t begin, size_t end, Vector2d* acc) const {
+    for (size_t i = begin; i < end; ++i) {
+        acc[i] = Vector2d();
+        if (Policy::external_fields) {
+            acc[i].y += Physics::SoftenedGravAcc(config.global_top_mass, abs(planets[i].pos.y - config.top_border), softening_length_m, softening_type);
+            acc[i].x += Physics::SoftenedGravAcc(config.global_right_mass, abs(planets[i].pos.x - config.right_border), softening_length_m, softening_type);
+        }
+    }
+}
+
+template <class Policy>
+double SimpleSpace::move_planets(size_t begin, size_t end, const Vector2d* acc) {
+    double max_shift = 0;
+    for (size_t i = begin; i < end; ++i) {
+        Planet& pl = planets[i];
+        if (Policy::sleeping && pl.sleeping) {
+            if (sleeping_forces_skipped)
+                continue; // Its force isn't computed this step
+            // Force change wakes body up, otherwise it stays where it is
+            double acc_change = Physics::DistFromPos(acc[i], pl.rest_acc);
+            if (acc_change <= config.sleep_acc_change * Physics::DistFromPos(Vector2d(), acc[i]))
+                continue;
+            pl.wake_up();
+        }
+        Physics::MoveWithConstAcc(pl.pos, pl.vel, acc[i], (time_step_ms/1000.0));
+        if (Policy::borders)
+            check_and_resolve_border_collision(pl);
+        if (Policy::sleeping)
+            update_rest_state(pl, acc[i]);
+        double shift = Physics::DistFromPos(pl.prev_pos, pl.pos);
+        if (shift > max_shift)
+            max_shift = shift;
+    }
+    return max_shift;
+}
+
+template <class Policy>
+bool SimpleSpace::reference_gravity_and_movement(Vector2d* acc, double* potential,
+                                                 ScratchBuffer<CollisionPair>& candidates, double& max_shift) {
+    // Single fused sweep over cache-sized tiles of planets. For every tile:
+    // - accumulate gravity (by positions at step beginning) against all other tiles;
+    // - by the same pairwise distances collect candidates for collision;
+    // - make movement and resolve borders while tile data is still in cache.
+    const size_t planets_count = planets.size();
+    const double skin_dist = 2 * collision_skin;
+    max_shift = 0;
+
+    for (size_t tile_begin = 0; tile_begin < planets_count; tile_begin += FUSED_TILE_SIZE) {
+        const size_t tile_end = std::min(tile_begin + FUSED_TILE_SIZE, planets_count);
+
+        add_external_fields<Policy>(tile_begin, tile_end, acc);
+
+        if (Policy::gravity) {
+            for (size_t src_begin = 0; src_begin < planets_count; src_begin += FUSED_TILE_SIZE) {
+                const size_t src_end = std::min(src_begin + FUSED_TILE_SIZE, planets_count);
+                for (size_t i = tile_begin; i < tile_end; ++i) {
+                    const Planet& pla = planets[i];
+                    const double soft_a = std::max(softening_length_m, pla.softening_m);
+                    if (Policy::sleeping && sleeping_forces_skipped && pla.sleeping) {
+                        // Force isn't computed: only candidates with awake bodies (found here for j > i)
+                        for (size_t j = std::max(src_begin, i + 1); j < src_end; ++j) {
+                            const Planet& plb = planets[j];
+                            if (!plb.sleeping &&
+                                (Physics::DistFromPos(pla.prev_pos, plb.prev_pos) < pla.rad_m + plb.rad_m + skin_dist))
+                                candidates.push_back(CollisionPair(i, j));
+                        }
+                        continue;
+                    }
+                    for (size_t j = src_begin; j < src_end; ++j) {
+                        const Planet& plb = planets[j];
+                        if (i == j)
+                            continue;
+                        double dist;
+                        if (!plb.test_particle) {
+                            // Calculate acceleration for some planet (i), produced by others one by one (j)
+                            double acc_abs;
+                            pair<double, double> DistAngle = Physics::DistAngleFromPos(pla.prev_pos, plb.prev_pos);
+                            acc_abs = Physics::SoftenedGravAcc(plb.mass_kg, DistAngle.first,
+                                                               std::max(soft_a, plb.softening_m), softening_type);
+                            acc[i].x += acc_abs * cos(DistAngle.second);    // accX = acc * cos(fi)
+                            acc[i].y += acc_abs * sin(DistAngle.second);    // accY = acc * sin(fi)
+                            if (potential)
+                                potential[i] -= CONST_G * plb.mass_kg * Physics::SoftenedInvDist(DistAngle.first * DistAngle.first,
+                                                                                                 std::max(soft_a, plb.softening_m), softening_type);
+                            dist = DistAngle.first;
+                        } else if (j > i) {
+                            // Test particle exerts no gravity, but collides with anything
+                            dist = Physics::DistFromPos(pla.prev_pos, plb.prev_pos);
+                        } else {
+                            continue;
+                        }
+
+                        if ((j > i) && (dist < pla.rad_m + plb.rad_m + skin_dist))
+                            candidates.push_back(CollisionPair(i, j));
+                    }
+                }
             }
         }
+
+        double shift = move_planets<Policy>(tile_begin, tile_end, acc);
+        if (shift > max_shift)
+            max_shift = shift;
     }
 
-    #if (BORDERS_ENABLED > 0)
-    // Check for border collision
-    for (vector<Planet>::iterator it = planets.begin(), it_end = planets.end(); it != it_end; ++it) {
-        check_and_resolve_border_collision(*it);
+    return Policy::gravity;
+}
+
+template <class Policy>
+void SimpleSpace::resolve_collisions(bool candidates_complete, const ScratchBuffer<CollisionPair>& candidates) {
+    const size_t planets_count = planets.size();
+    char* collided = scratch.allocate_array<char>(planets_count);
+    memset(collided, 0, planets_count);
+
+    // Detection: contacts are overlapping pairs after movement, in ascending (a, b) order
+    ScratchBuffer<CollisionPair> contacts(scratch, 64);
+    if (candidates_complete) {
+        for (size_t k = 0; k < candidates.size(); ++k) {
+            Planet& pla = planets[candidates[k].a];
+            Planet& plb = planets[candidates[k].b];
+            if (Policy::sleeping && pla.sleeping && plb.sleeping)
+                continue; // Resting pile is not collided
+            if (Physics::DistFromPos(pla.pos, plb.pos) < pla.rad_m + plb.rad_m) {
+                if (Policy::sleeping) {
+                    pla.wake_up();
+                    plb.wake_up();
+                }
+                contacts.push_back(candidates[k]);
+            }
+        }
+    } else {
+        // Sweep and prune along x: overlapping bodies have overlapping x extents, so by bodies
+        // sorted by left edge every one is checked only against those starting before its right edge
+        unsigned int* sorted = scratch.allocate_array<unsigned int>(planets_count);
+        for (size_t i = 0; i < planets_count; ++i)
+            sorted[i] = static_cast<unsigned int>(i);
+        std::sort(sorted, sorted + planets_count, [&](unsigned int a, unsigned int b) {
+            double left_a = planets[a].pos.x - planets[a].rad_m;
+            double left_b = planets[b].pos.x - planets[b].rad_m;
+            return (left_a < left_b) || ((left_a == left_b) && (a < b));
+        });
+        for (size_t s = 0; s + 1 < planets_count; ++s) {
+            const double right = planets[sorted[s]].pos.x + planets[sorted[s]].rad_m;
+            for (size_t t = s + 1; t < planets_count; ++t) {
+                Planet& pla = planets[sorted[s]];
+                Planet& plb = planets[sorted[t]];
+                if (plb.pos.x - plb.rad_m > right)
+                    break;
+                if (Policy::sleeping && pla.sleeping && plb.sleeping)
+                    continue; // Resting pile is not collided
+                if (Physics::DistFromPos(pla.pos, plb.pos) < pla.rad_m + plb.rad_m) {
+                    if (Policy::sleeping) {
+                        pla.wake_up();
+                        plb.wake_up();
+                    }
+                    contacts.push_back(CollisionPair(std::min(sorted[s], sorted[t]), std::max(sorted[s], sorted[t])));
+                }
+            }
+        }
+        std::sort(contacts.data(), contacts.data() + contacts.size());
+    }
+
+    // Resolution
+    if (config.collision_mode == COLLISION_MODE_MERGE)
+        merge_contacts(contacts, collided);
+    else
+        resolve_contacts(contacts, collided);
+
+    if (Policy::borders) {
+        // Moving bodies apart (or growing merged ones) may push them behind border again
+        for (size_t i = 0; i < planets.size(); ++i) {
+            if (collided[i])
+                check_and_resolve_border_collision(planets[i]);
+        }
+    }
+}
+
+template <class Policy>
+void SimpleSpace::advance_belt() {
+    // Sources are massive planets at step beginning, before collisions change them
+    const size_t planets_count = planets.size();
+    double* x = scratch.allocate_array<double>(planets_count);
+    double* y = scratch.allocate_array<double>(planets_count);
+    double* gm = scratch.allocate_array<double>(planets_count);
+    double* soft2 = scratch.allocate_array<double>(planets_count);
+    BeltSources sources;
+    sources.count = 0;
+    if (Policy::gravity) {
+        for (size_t i = 0; i < planets_count; ++i) {
+            const Planet& pl = planets[i];
+            if (pl.test_particle)
+                continue;
+            // Kernel has Plummer softening only, it stands for spline one too
+            const double soft = (softening_type == Physics::SOFTENING_NONE) ? 0 : std::max(softening_length_m, pl.softening_m);
+            x[sources.count] = pl.prev_pos.x;
+            y[sources.count] = pl.prev_pos.y;
+            gm[sources.count] = CONST_G * pl.mass_kg;
+            soft2[sources.count] = soft * soft;
+            ++sources.count;
+        }
+    }
+    sources.x = x;
+    sources.y = y;
+    sources.gm = gm;
+    sources.soft2 = soft2;
+    belt.advance(worker_pool, sources, time_step_ms / 1000.0);
+}
+
+struct SimpleSpace::ContactsJob {
+    SimpleSpace* space;
+    const CollisionPair* contacts; // Batch of pairs without common bodies
+    size_t count;
+    size_t chunk;
+    char* collided;
+    double* loss; // Kinetic energy taken by every contact of batch (NULL - not counted)
+};
+
+static inline double kinetic_energy(const Planet& pl) {
+    return 0.5 * pl.mass_kg * (pl.vel.x * pl.vel.x + pl.vel.y * pl.vel.y);
+}
+
+void SimpleSpace::resolve_contacts_task(void* arg, unsigned int task_idx, unsigned int worker_idx) {
+    ContactsJob& job = *static_cast<ContactsJob*>(arg);
+    const size_t begin = task_idx * job.chunk;
+    const size_t end = std::min(begin + job.chunk, job.count);
+    for (size_t k = begin; k < end; ++k) {
+        const CollisionPair& contact = job.contacts[k];
+        Planet& pla = job.space->planets[contact.a];
+        Planet& plb = job.space->planets[contact.b];
+        // Previous batches could have already moved bodies apart
+        if (Physics::DistFromPos(pla.pos, plb.pos) < pla.rad_m + plb.rad_m) {
+            // Debug log
+            //cout << "Collision between: " << pla.id << " and " << plb.id << endl;
+            const double energy = job.loss ? kinetic_energy(pla) + kinetic_energy(plb) : 0;
+            job.space->resolve_body_collision(pla, plb);
+            job.collided[contact.a] = job.collided[contact.b] = 1;
+            if (job.loss)
+                job.loss[k] = energy - kinetic_energy(pla) - kinetic_energy(plb);
+        }
+    }
+}
+
+void SimpleSpace::resolve_contacts(const ScratchBuffer<CollisionPair>& contacts, char* collided) {
+    if (contacts.size() == 0)
+        return;
+
+    // Greedy coloring of contact graph in contacts order: every contact gets the smallest
+    // color not used yet by any of its bodies. Contacts of one color share no bodies, so
+    // they are resolved in parallel, and colors go one by one. Coloring doesn't depend on
+    // workers number, so results are the same for any of them.
+    // Bodies with more than 64 contacts (never in practice) go to last, sequential, batch.
+    const size_t planets_count = planets.size();
+    const unsigned int overflow_color = 64;
+    uint64_t* used_colors = scratch.allocate_array<uint64_t>(planets_count);
+    memset(used_colors, 0, planets_count * sizeof(uint64_t));
+    unsigned char* contact_color = scratch.allocate_array<unsigned char>(contacts.size());
+    size_t batch_size[overflow_color + 1] = {0};
+
+    for (size_t k = 0; k < contacts.size(); ++k) {
+        uint64_t used = used_colors[contacts[k].a] | used_colors[contacts[k].b];
+        unsigned int color = overflow_color;
+        if (~used != 0) {
+            color = 0;
+            while (used & (uint64_t(1) << color))
+                ++color;
+            used_colors[contacts[k].a] |= (uint64_t(1) << color);
+            used_colors[contacts[k].b] |= (uint64_t(1) << color);
+        }
+        contact_color[k] = static_cast<unsigned char>(color);
+        ++batch_size[color];
+    }
+
+    // Counting sort by color (stable: contacts order is kept inside batch)
+    size_t batch_begin[overflow_color + 2];
+    batch_begin[0] = 0;
+    for (unsigned int c = 0; c <= overflow_color; ++c)
+        batch_begin[c + 1] = batch_begin[c] + batch_size[c];
+    CollisionPair* batched = scratch.allocate_array<CollisionPair>(contacts.size());
+    size_t fill[overflow_color + 1];
+    memcpy(fill, batch_begin, sizeof(fill));
+    for (size_t k = 0; k < contacts.size(); ++k)
+        batched[fill[contact_color[k]]++] = contacts[k];
+
+    // Losses go by contact, so their sum has fixed order too
+    double* loss = NULL;
+    if (diagnostics_interval > 0) {
+        loss = scratch.allocate_array<double>(contacts.size());
+        std::fill(loss, loss + contacts.size(), 0.0);
+    }
+
+    ContactsJob job;
+    job.space = this;
+    job.collided = collided;
+    for (unsigned int c = 0; c <= overflow_color; ++c) {
+        job.contacts = batched + batch_begin[c];
+        job.loss = loss ? loss + batch_begin[c] : NULL;
+        job.count = batch_size[c];
+        if (job.count == 0)
+            continue;
+        if ((c == overflow_color) || (job.count < COLLISIONS_PARALLEL_MIN_BATCH) || (worker_pool.workersNum() == 1)) {
+            job.chunk = job.count;
+            resolve_contacts_task(&job, 0, 0);
+        } else {
+            const unsigned int tasks = worker_pool.workersNum();
+            job.chunk = (job.count + tasks - 1) / tasks;
+            worker_pool.run(SimpleSpace::resolve_contacts_task, &job, tasks);
+        }
+    }
+    for (size_t k = 0; loss && (k < contacts.size()); ++k)
+        collision_loss_j += loss[k];
+}
+
+void SimpleSpace::merge_contacts(const ScratchBuffer<CollisionPair>& contacts, char* collided) {
+    // Sequential: chains of contacts accrete into one body. Contacts are found by radii
+    // before merging, so a body that the grown radius reaches (and no contact of this
+    // step does) is merged next step, when candidates are collected by the new radius.
+    const size_t planets_count = planets.size();
+    char* removed = scratch.allocate_array<char>(planets_count); // Merged into other body
+    memset(removed, 0, planets_count);
+    size_t removed_count = 0;
+
+    for (size_t k = 0; k < contacts.size(); ++k) {
+        const size_t a = contacts[k].a;
+        const size_t b = contacts[k].b;
+        if (removed[a] || removed[b])
+            continue;
+        const Planet& pla = planets[a];
+        const Planet& plb = planets[b];
+        if (Physics::DistFromPos(pla.pos, plb.pos) < pla.rad_m + plb.rad_m) {
+            // Heavier body survives (keeps its id and color)
+            const size_t into = (plb.mass_kg > pla.mass_kg) ? b : a;
+            const size_t from = (into == a) ? b : a;
+            const double energy = (diagnostics_interval > 0) ? kinetic_energy(pla) + kinetic_energy(plb) : 0;
+            merge_bodies(planets[into], planets[from]);
+            if (diagnostics_interval > 0)
+                collision_loss_j += energy - kinetic_energy(planets[into]);
+            removed[from] = 1;
+            ++removed_count;
+            collided[into] = 1;
+        }
+    }
+
+    if (removed_count > 0) {
+        // Batched removal: single compaction pass, order of remaining planets is kept
+        size_t kept = 0;
+        for (size_t i = 0; i < planets_count; ++i) {
+            if (!removed[i]) {
+                if (kept != i) {
+                    planets[kept] = planets[i];
+                    collided[kept] = collided[i];
+                }
+                ++kept;
+            }
+        }
+        planets.resize(kept);
+        update_id_map(0);
     }
-    #endif
-    
+}
+
+void SimpleSpace::journal_settings() {
+    if (journal.is_recording())
+        journal.settings(steps_count, make_engine_state());
+}
+
+void SimpleSpace::set_config(const SpaceConfig& new_config) {
+    wMutexLock(&movement_step_mutex);
+    config = new_config;
+    step_func = select_step_func(config);
+    journal_settings();
     wMutexUnlock(&movement_step_mutex);
 }
 
+const SpaceConfig& SimpleSpace::get_config() const {
+    return config;
+}
+
+void SimpleSpace::set_gravity_solver(GravitySolverType type) {
+    wMutexLock(&movement_step_mutex);
+    if ((type == GRAVITY_SOLVER_PM) && !pm_solver)
+        pm_solver.reset(new PMGravitySolver(worker_pool)); // Meshes are big, made on demand
+    gravity_solver_type = type;
+    journal_settings();
+    wMutexUnlock(&movement_step_mutex);
+}
+
+GravitySolverType SimpleSpace::get_gravity_solver() const {
+    return gravity_solver_type;
+}
+
+void SimpleSpace::set_softening(Physics::SofteningType type, double length_m) {
+    wMutexLock(&movement_step_mutex);
+    softening_type = type;
+    softening_length_m = length_m;
+    journal_settings();
+    wMutexUnlock(&movement_step_mutex);
+}
+
+Physics::SofteningType SimpleSpace::get_softening_type() const {
+    return softening_type;
+}
+
+double SimpleSpace::get_softening_length() const {
+    return softening_length_m;
+}
+
+void SimpleSpace::set_gravity_precision(GravityPrecision precision) {
+    wMutexLock(&movement_step_mutex);
+    gravity_precision = precision;
+    journal_settings();
+    wMutexUnlock(&movement_step_mutex);
+}
+
+void SimpleSpace::set_diagnostics_interval(unsigned long interval_steps) {
+    wMutexLock(&movement_step_mutex);
+    if ((diagnostics_interval == 0) && (interval_steps > 0)) {
+        collision_loss_j = 0;
+        diagnostics = SpaceDiagnostics();
+    }
+    diagnostics_interval = interval_steps;
+    publish_snapshot();
+    wMutexUnlock(&movement_step_mutex);
+}
+
+unsigned long SimpleSpace::get_diagnostics_interval() const {
+    return diagnostics_interval;
+}
+
+GravityPrecision SimpleSpace::get_gravity_precision() const {
+    return gravity_precision;
+}
+
+void SimpleSpace::publish_snapshot(bool lazy_belt) {
+    std::shared_ptr<PlanetsSnapshot> snapshot;
+    for (vector<std::shared_ptr<PlanetsSnapshot> >::iterator it = snapshots_pool.begin(), it_end = snapshots_pool.end(); it != it_end; ++it) {
+        if (it->use_count() == 1) {
+            snapshot = *it;
+            break;
+        }
+    }
+
+    if (snapshot) {
+        // Pairs with release of the last reader's reference
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } else {
+        // All snapshots are still read, pool grows (only until readers count is reached)
+        snapshot = std::make_shared<PlanetsSnapshot>();
+        snapshots_pool.push_back(snapshot);
+    }
+
+    snapshot->planets = planets; // Reuses capacity, no allocation in steady state
+    snapshot->belt_points.reset(); // Its buffer may be reused below
+
+    // Step doesn't change particles count, so lagging points still match belt_count
+    std::shared_ptr<const PlanetsSnapshot> previous = std::atomic_load(&published_snapshot);
+    if (!belt.size()) {
+        snapshot->belt_points.reset();
+    } else if (lazy_belt && previous && previous->belt_points && (previous->belt_points->size() == 2 * belt.size()) &&
+               (belt_points_drawn.load(std::memory_order_relaxed) != previous->belt_version)) {
+        snapshot->belt_points = previous->belt_points;
+        snapshot->belt_version = previous->belt_version;
+    } else {
+        std::shared_ptr<std::vector<float> > points;
+        for (vector<std::shared_ptr<std::vector<float> > >::iterator it = belt_points_pool.begin(), it_end = belt_points_pool.end(); it != it_end; ++it) {
+            if (it->use_count() == 1) {
+                points = *it;
+                break;
+            }
+        }
+        if (points) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } else {
+            points = std::make_shared<std::vector<float> >();
+            belt_points_pool.push_back(points);
+        }
+        fill_belt_points(*points);
+        snapshot->belt_points = points;
+        snapshot->belt_version = ++belt_points_version;
+    }
+    snapshot->belt_count = belt.size();
+    snapshot->diagnostics = diagnostics;
+    snapshot->version = ++snapshot_version;
+    std::atomic_store(&published_snapshot, std::shared_ptr<const PlanetsSnapshot>(snapshot));
+}
+
+std::shared_ptr<const PlanetsSnapshot> SimpleSpace::get_snapshot() const {
+    return std::atomic_load(&published_snapshot);
+}
+
 void SimpleSpace::move_apart_bodies(Planet& p1, Planet& p2) {
     // Move bodies apart (correlating with their masses)
     // from: d = d1 + d2; and: m1 * d1 = m2 * d2;
@@ -131,11 +1209,11 @@ void SimpleSpace::resolve_body_collision(Planet& pla, Planet& plb) {
     // Get velocities after collision (in NT coordinates)
     U1.y = V1.y;
     U2.y = V2.y;
-    U1.x = ((1 + COEF_RES) * plb.mass_kg * V2.x + V1.x * (pla.mass_kg - COEF_RES * plb.mass_kg)) / (pla.mass_kg + plb.mass_kg);
-    U2.x = ((1 + COEF_RES) * pla.mass_kg * V1.x + V2.x * (plb.mass_kg - COEF_RES * pla.mass_kg)) / (pla.mass_kg + plb.mass_kg);
+    U1.x = ((1 + config.coef_res) * plb.mass_kg * V2.x + V1.x * (pla.mass_kg - config.coef_res * plb.mass_kg)) / (pla.mass_kg + plb.mass_kg);
+    U2.x = ((1 + config.coef_res) * pla.mass_kg * V1.x + V2.x * (plb.mass_kg - config.coef_res * pla.mass_kg)) / (pla.mass_kg + plb.mass_kg);
     // Same formula, just to check from wiki
-    //U1.x = (pla.mass_kg * V1.x + plb.mass_kg * V2.x + plb.mass_kg * COEF_RES * (V2.x - V1.x)) / (pla.mass_kg + plb.mass_kg);
-    //U2.x = (plb.mass_kg * V2.x + pla.mass_kg * V1.x + pla.mass_kg * COEF_RES * (V1.x - V2.x)) / (pla.mass_kg + plb.mass_kg);
+    //U1.x = (pla.mass_kg * V1.x + plb.mass_kg * V2.x + plb.mass_kg * config.coef_res * (V2.x - V1.x)) / (pla.mass_kg + plb.mass_kg);
+    //U2.x = (plb.mass_kg * V2.x + pla.mass_kg * V1.x + pla.mass_kg * config.coef_res * (V1.x - V2.x)) / (pla.mass_kg + plb.mass_kg);
 
     // Move velocities back to XY coordinate system from NT
     Physics::RotateVector(U1, angle);
@@ -144,81 +1222,344 @@ void SimpleSpace::resolve_body_collision(Planet& pla, Planet& plb) {
     plb.vel = U2;
 }
 
+void SimpleSpace::merge_bodies(Planet& into, const Planet& from) {
+    // Perfectly inelastic collision: mass and momentum are conserved,
+    // merged body is in center of mass (at step beginning too) and has volume of both
+    const double mass = into.mass_kg + from.mass_kg;
+    if (mass > 0) {
+        into.pos.x = (into.pos.x * into.mass_kg + from.pos.x * from.mass_kg) / mass;
+        into.pos.y = (into.pos.y * into.mass_kg + from.pos.y * from.mass_kg) / mass;
+        into.prev_pos.x = (into.prev_pos.x * into.mass_kg + from.prev_pos.x * from.mass_kg) / mass;
+        into.prev_pos.y = (into.prev_pos.y * into.mass_kg + from.prev_pos.y * from.mass_kg) / mass;
+        into.vel.x = (into.vel.x * into.mass_kg + from.vel.x * from.mass_kg) / mass;
+        into.vel.y = (into.vel.y * into.mass_kg + from.vel.y * from.mass_kg) / mass;
+    }
+    into.mass_kg = mass;
+    into.rad_m = cbrt(into.rad_m * into.rad_m * into.rad_m + from.rad_m * from.rad_m * from.rad_m);
+    into.softening_m = std::max(into.softening_m, from.softening_m);
+    into.test_particle = into.test_particle && from.test_particle;
+}
+
 void SimpleSpace::check_and_resolve_border_collision(Planet& pl) {
-    if ((pl.pos.x + pl.rad_m) > RIGHT_BORDER) {
-        if ((pl.pos.x + pl.rad_m) > RIGHT_BORDER)
-            pl.pos.x = RIGHT_BORDER - pl.rad_m;
+    if ((pl.pos.x + pl.rad_m) > config.right_border) {
+        if ((pl.pos.x + pl.rad_m) > config.right_border)
+            pl.pos.x = config.right_border - pl.rad_m;
         if (pl.vel.x > 0)
-            pl.vel.x = -pl.vel.x * COEF_RES;
-        pl.vel.y *= BORDER_FRICTION;
+            pl.vel.x = -pl.vel.x * config.coef_res;
+        pl.vel.y *= config.border_friction;
     }
 
-    if ((pl.pos.x - pl.rad_m) < LEFT_BORDER) {
-        if ((pl.pos.x - pl.rad_m) < LEFT_BORDER)
-            pl.pos.x = LEFT_BORDER + pl.rad_m;
+    if ((pl.pos.x - pl.rad_m) < config.left_border) {
+        if ((pl.pos.x - pl.rad_m) < config.left_border)
+            pl.pos.x = config.left_border + pl.rad_m;
         if (pl.vel.x < 0)
-            pl.vel.x = -pl.vel.x * COEF_RES;
-        pl.vel.y *= BORDER_FRICTION;
+            pl.vel.x = -pl.vel.x * config.coef_res;
+        pl.vel.y *= config.border_friction;
     }
 
-    if ((pl.pos.y + pl.rad_m) > TOP_BORDER) {
-        if ((pl.pos.y + pl.rad_m) > TOP_BORDER)
-            pl.pos.y = TOP_BORDER - pl.rad_m;
+    if ((pl.pos.y + pl.rad_m) > config.top_border) {
+        if ((pl.pos.y + pl.rad_m) > config.top_border)
+            pl.pos.y = config.top_border - pl.rad_m;
         if (pl.vel.y > 0)
-            pl.vel.y = -pl.vel.y * COEF_RES;
-        pl.vel.x *= BORDER_FRICTION;
+            pl.vel.y = -pl.vel.y * config.coef_res;
+        pl.vel.x *= config.border_friction;
     }
 
-    if ((pl.pos.y - pl.rad_m) < BOTTOM_BORDER) {
-        if ((pl.pos.y - pl.rad_m) < BOTTOM_BORDER)
-            pl.pos.y = BOTTOM_BORDER + pl.rad_m;
+    if ((pl.pos.y - pl.rad_m) < config.bottom_border) {
+        if ((pl.pos.y - pl.rad_m) < config.bottom_border)
+            pl.pos.y = config.bottom_border + pl.rad_m;
         if (pl.vel.y < 0)
-            pl.vel.y = -pl.vel.y * COEF_RES;
-        pl.vel.x *= BORDER_FRICTION;
+            pl.vel.y = -pl.vel.y * config.coef_res;
+        pl.vel.x *= config.border_friction;
     }
 }
 
-void SimpleSpace::add_planet(const Planet& pl) {
-    wMutexLock(&movement_step_mutex);
+bool SimpleSpace::is_touching_border(const Planet& pl) const {
+    // Border check puts bodies exactly at border, small margin is for rounding
+    const double margin = pl.rad_m * 1.001;
+    return ((pl.pos.x + margin) >= config.right_border) ||
+           ((pl.pos.x - margin) <= config.left_border) ||
+           ((pl.pos.y + margin) >= config.top_border) ||
+           ((pl.pos.y - margin) <= config.bottom_border);
+}
 
-    unsigned int new_id = 0;
-    while (std::any_of(planets.begin(), planets.end(), [&](Planet pl) {return pl.id == new_id;}))
-        ++new_id;
+void SimpleSpace::update_rest_state(Planet& pl, const Vector2d& acc) {
+    const double acc_abs = Physics::DistFromPos(Vector2d(), acc);
+    const double speed = Physics::DistFromPos(Vector2d(), pl.vel);
+    // Body pressed to border by constant force bounces by about (acc * dt) every step
+    const double speed_limit = config.sleep_velocity + 2 * acc_abs * (time_step_ms/1000.0);
+    const bool at_rest = (speed < speed_limit) &&
+                         (Physics::DistFromPos(acc, pl.rest_acc) <= config.sleep_acc_change * acc_abs) &&
+                         is_touching_border(pl);
+    pl.rest_acc = acc;
+    if (!at_rest) {
+        pl.rest_steps = 0;
+        return;
+    }
+    if (++pl.rest_steps >= config.sleep_steps) {
+        pl.sleeping = true;
+        pl.vel = Vector2d();
+    }
+}
 
+void SimpleSpace::do_add_planet(const Planet& pl, const unsigned int& id) {
+    if (journal.is_recording())
+        journal.add_planet(steps_count, id, pl);
     Planet new_planet = pl;
-    new_planet.id = new_id;
-    check_and_resolve_border_collision(new_planet);
+    new_planet.id = id;
+    new_planet.wake_up();
+    if (config.borders_enabled)
+        check_and_resolve_border_collision(new_planet);
     for (vector<Planet>::iterator it = planets.begin(), it_end = planets.end(); it != it_end; ++it) {
         double dist = Physics::DistFromPos(new_planet.pos, it->pos);
         double rad_sum = new_planet.rad_m + it->rad_m;
-        if (dist < rad_sum)
+        if (dist < rad_sum) {
             move_apart_bodies(new_planet, *it);
+            it->wake_up();
+            mark_planets_changed(it - planets.begin());
+        }
     }
+    mark_planets_changed(planets.size());
     planets.push_back(new_planet);
+    update_id_map(planets.size() - 1);
+}
 
+void SimpleSpace::do_remove_planet(const unsigned int& id) {
+    if (journal.is_recording())
+        journal.remove_planet(steps_count, id);
+    size_t idx = find_planet_index(id);
+    if (idx == planets.size()) {
+        cout << "Didn't find planet to remove with id=" << id << endl;
+    } else {
+        planets.erase(planets.begin() + idx);
+        update_id_map(idx);
+        mark_planets_changed(idx);
+    }
+}
+
+void SimpleSpace::do_modify_planet(const Planet& pl) {
+    if (journal.is_recording())
+        journal.modify_planet(steps_count, pl);
+    size_t idx = find_planet_index(pl.id);
+    if (idx == planets.size()) {
+        cout << "Didn't find planet to modify with id=" << pl.id << endl;
+    } else {
+        planets[idx] = pl;
+        planets[idx].wake_up();
+        mark_planets_changed(idx);
+        if (config.borders_enabled)
+            check_and_resolve_border_collision(planets[idx]);
+    }
+}
+
+void SimpleSpace::do_apply_pending_commands() {
+    SpaceCommand cmd;
+    while (pending_commands.pop(cmd)) {
+        switch (cmd.type) {
+            case CMD_ADD_PLANET:
+                do_add_planet(cmd.planet, cmd.id);
+                break;
+            case CMD_REMOVE_PLANET:
+                do_remove_planet(cmd.id);
+                break;
+            case CMD_REMOVE_ALL:
+                do_remove_all_objects();
+                break;
+            case CMD_MODIFY_PLANET:
+                do_modify_planet(cmd.planet);
+                break;
+        }
+    }
+}
+
+void SimpleSpace::add_planet(const Planet& pl) {
+    wMutexLock(&movement_step_mutex);
+    do_add_planet(pl, next_planet_id++);
+    publish_snapshot();
     wMutexUnlock(&movement_step_mutex);
 }
 
 void SimpleSpace::remove_planet(const unsigned int& id) {
     wMutexLock(&movement_step_mutex);
+    do_remove_planet(id);
+    publish_snapshot();
+    wMutexUnlock(&movement_step_mutex);
+}
 
-    std::vector<Planet>::iterator it = std::find_if(planets.begin(), planets.end(), [&](Planet pl) {return pl.id == id;});
-    if (it == planets.end()) {
-        cout << "Didn't find planet to remove with id=" << id << endl;
-    } else {
-        planets.erase(it);
+unsigned int SimpleSpace::post_add_planet(const Planet& pl) {
+    // Id is reserved right away, so caller may refer to planet before it's actually added
+    unsigned int id = next_planet_id++;
+    pending_commands.push(SpaceCommand(CMD_ADD_PLANET, id, pl));
+    return id;
+}
+
+void SimpleSpace::post_remove_planet(const unsigned int& id) {
+    pending_commands.push(SpaceCommand(CMD_REMOVE_PLANET, id));
+}
+
+void SimpleSpace::post_remove_all_objects() {
+    pending_commands.push(SpaceCommand(CMD_REMOVE_ALL));
+}
+
+void SimpleSpace::post_modify_planet(const Planet& pl) {
+    pending_commands.push(SpaceCommand(CMD_MODIFY_PLANET, pl.id, pl));
+}
+
+void SimpleSpace::apply_pending_commands() {
+    wMutexLock(&movement_step_mutex);
+    if (!pending_commands.empty()) {
+        do_apply_pending_commands();
+        publish_snapshot();
     }
+    wMutexUnlock(&movement_step_mutex);
+}
+
+void SimpleSpace::do_remove_all_objects() {
+    if (journal.is_recording())
+        journal.simple(steps_count, JOURNAL_REMOVE_ALL);
+    planets.clear();
+    belt.clear();
+    mark_planets_changed(0);
+    mark_belt_changed();
+}
+
+void SimpleSpace::do_add_belt_particles(const std::vector<Vector2d>& pos, const std::vector<Vector2d>& vel) {
+    if (journal.is_recording())
+        journal.add_belt_particles(steps_count, pos, vel);
+    belt.reserve(belt.size() + pos.size());
+    for (size_t i = 0; i < pos.size(); ++i)
+        belt.add(pos[i], vel[i]);
+    mark_belt_changed();
+}
+
+void SimpleSpace::do_add_scene(const SceneParams& params, unsigned int first_id) {
+    if (journal.is_recording())
+        journal.add_scene(steps_count, params, first_id);
+    const size_t begin = planets.size();
+    planets.resize(begin + params.count);
+    generate_scene(worker_pool, params, planets.data() + begin, first_id);
+    update_id_map(begin);
+    mark_planets_changed(begin);
+}
+
+void SimpleSpace::add_belt_particles(const std::vector<Vector2d>& pos, const std::vector<Vector2d>& vel) {
+    wMutexLock(&movement_step_mutex);
+    do_add_belt_particles(pos, vel);
+    publish_snapshot();
+    wMutexUnlock(&movement_step_mutex);
+}
+
+void SimpleSpace::add_scene(const SceneParams& params) {
+    wMutexLock(&movement_step_mutex);
+    do_add_scene(params, next_planet_id.fetch_add(static_cast<unsigned int>(params.count)));
+    publish_snapshot();
+    wMutexUnlock(&movement_step_mutex);
+}
 
+void SimpleSpace::add_scene_particles(const SceneParams& params) {
+    wMutexLock(&movement_step_mutex);
+    if (journal.is_recording())
+        journal.add_scene_particles(steps_count, params);
+    generate_scene(worker_pool, params, belt);
+    mark_belt_changed();
+    publish_snapshot();
     wMutexUnlock(&movement_step_mutex);
 }
 
-std::pair<bool, unsigned int> SimpleSpace::find_planet_by_click(const Vector2d& click_pos) {
+SceneFileStatus SimpleSpace::save_scene(const char* path) {
     wMutexLock(&movement_step_mutex);
+    SceneEngineState engine = make_engine_state();
+    SceneFileStatus status = write_scene_file(path, planets, belt, &engine);
+    wMutexUnlock(&movement_step_mutex);
+    return status;
+}
+
+SceneFileStatus SimpleSpace::load_scene(const char* path) {
+    return load_scene_file(path, false);
+}
+
+SceneFileStatus SimpleSpace::restore_checkpoint(const char* path) {
+    return load_scene_file(path, true);
+}
+
+SceneFileStatus SimpleSpace::load_scene_file(const char* path, bool restore_state) {
+    // Mapping and checksums don't touch the scene, so simulation goes on meanwhile
+    SceneFile file;
+    SceneFileStatus status = file.open(path, &worker_pool);
+    if (status != SCENE_FILE_OK)
+        return status;
+    if (restore_state && !file.engine_state())
+        return SCENE_FILE_BAD_FORMAT; // Plain scene, not checkpoint
+    if (restore_state && !is_valid_engine_state(*file.engine_state()))
+        return SCENE_FILE_BAD_FORMAT;
+
+    // Ids must be unique, as bodies are looked up by them, and bounded, as lookup map
+    // is sized by the largest one (file may come from anywhere)
+    const uint32_t* ids = static_cast<const uint32_t*>(file.column(SCENE_COL_ID));
+    std::vector<uint32_t> sorted_ids(ids, ids + file.planets_count());
+    std::sort(sorted_ids.begin(), sorted_ids.end());
+    if (std::adjacent_find(sorted_ids.begin(), sorted_ids.end()) != sorted_ids.end())
+        return SCENE_FILE_BAD_FORMAT;
+    const uint32_t max_id = sorted_ids.empty() ? 0 : sorted_ids.back();
+    if (max_id >= LOADED_PLANET_ID_MAX)
+        return SCENE_FILE_BAD_FORMAT;
+
+    wMutexLock(&movement_step_mutex);
+    const unsigned long load_step = steps_count;
+    planets.resize(file.planets_count());
+    file.read_planets(worker_pool, planets.data());
+    file.read_belt(belt);
+    id_to_index.clear();
+    update_id_map(0);
+    mark_planets_changed(0);
+    mark_belt_changed();
+    // Ids reserved by post_add_planet() stay valid
+    if (file.planets_count() && next_planet_id <= max_id)
+        next_planet_id = max_id + 1;
+    if (restore_state)
+        apply_engine_state(*file.engine_state());
+    if (journal.is_recording())
+        journal.load_scene(load_step, planets, belt, make_engine_state()); // Loaded file may change later
+    publish_snapshot();
+    wMutexUnlock(&movement_step_mutex);
+    return SCENE_FILE_OK;
+}
+
+void SimpleSpace::remove_belt_particles() {
+    wMutexLock(&movement_step_mutex);
+    if (journal.is_recording())
+        journal.simple(steps_count, JOURNAL_REMOVE_BELT);
+    belt.clear();
+    mark_belt_changed();
+    publish_snapshot();
+    wMutexUnlock(&movement_step_mutex);
+}
+
+unsigned long SimpleSpace::get_belt_particles_count() const {
+    return get_snapshot()->belt_count;
+}
+
+void SimpleSpace::fill_belt_points(std::vector<float>& points) const {
+    points.resize(belt.size() * 2);
+    for (size_t i = 0; i < belt.size(); ++i) {
+        points[2 * i] = static_cast<float>(belt.x()[i]);
+        points[2 * i + 1] = static_cast<float>(belt.y()[i]);
+    }
+}
+
+void SimpleSpace::get_belt_points(std::vector<float>& points) const {
+    wMutexLock(&movement_step_mutex);
+    fill_belt_points(points);
+    wMutexUnlock(&movement_step_mutex);
+}
+
+std::pair<bool, unsigned int> SimpleSpace::find_planet_by_click(const Vector2d& click_pos) const {
+    std::shared_ptr<const PlanetsSnapshot> snapshot = get_snapshot();
 
     pair<bool, unsigned int> result;
     result.first = false;
     result.second = std::numeric_limits<unsigned int>::max();
-    for (vector<Planet>::const_iterator it = planets.begin(), it_end = planets.end(); it != it_end; ++it) {
+    for (vector<Planet>::const_iterator it = snapshot->planets.begin(), it_end = snapshot->planets.end(); it != it_end; ++it) {
         if (Physics::DistFromPos(click_pos, it->pos) < it->rad_m) {
             result.first = true;
             result.second = it->id;
@@ -226,19 +1567,20 @@ std::pair<bool, unsigned int> SimpleSpace::find_planet_by_click(const Vector2d&
         }
     }
 
-    wMutexUnlock(&movement_step_mutex);
     return result;
 }
 
-std::vector<unsigned int> SimpleSpace::find_planets_by_selection(const Vector2d& sel_start_pos,
-                                                                 const Vector2d& sel_end_pos) {
-    wMutexLock(&movement_step_mutex);
+void SimpleSpace::find_planets_by_selection(const Vector2d& sel_start_pos,
+                                            const Vector2d& sel_end_pos,
+                                            std::vector<unsigned int>& found_id_list) const {
+    std::shared_ptr<const PlanetsSnapshot> snapshot = get_snapshot();
+
     double border_right  = (sel_end_pos.x > sel_start_pos.x) ? sel_end_pos.x : sel_start_pos.x;
     double border_top    = (sel_end_pos.y > sel_start_pos.y) ? sel_end_pos.y : sel_start_pos.y;
     double border_left   = (sel_end_pos.x > sel_start_pos.x) ? sel_start_pos.x : sel_end_pos.x;
     double border_bottom = (sel_end_pos.y > sel_start_pos.y) ? sel_start_pos.y : sel_end_pos.y;
-    std::vector<unsigned int> found_id_list;
-    for (vector<Planet>::const_iterator it = planets.begin(), it_end = planets.end(); it != it_end; ++it) {
+    found_id_list.clear();
+    for (vector<Planet>::const_iterator it = snapshot->planets.begin(), it_end = snapshot->planets.end(); it != it_end; ++it) {
         if ((it->pos.x < border_right) &&
             (it->pos.y < border_top) &&
             (it->pos.x > border_left) &&
@@ -246,13 +1588,12 @@ std::vector<unsigned int> SimpleSpace::find_planets_by_selection(const Vector2d&
             found_id_list.push_back(it->id);
         }
     }
-    wMutexUnlock(&movement_step_mutex);
-    return found_id_list;
 }
 
 void SimpleSpace::remove_all_objects() {
     wMutexLock(&movement_step_mutex);
-    planets.clear();
+    do_remove_all_objects();
+    publish_snapshot();
     wMutexUnlock(&movement_step_mutex);
 }
 
@@ -264,9 +1605,39 @@ void SimpleSpace::draw_planet(const float& rad, const float& x, const float& y)
     glEnd();
 }
 
+void SimpleSpace::draw_belt(const std::vector<float>& points, const float& scale) const {
+    // All particles by single draw call, straight from snapshot memory
+    glPushMatrix();
+    glScalef(1.0f / scale, 1.0f / scale, 1.0f);
+    glColor3f(0.6f, 0.6f, 0.6f);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, points.data());
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(points.size() / 2));
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glPopMatrix();
+}
+
 void SimpleSpace::draw_scene(const float& scale) const {
-    std::for_each(planets.begin(), planets.end(), [&](Planet p) {
+    std::shared_ptr<const PlanetsSnapshot> snapshot = get_snapshot();
+    if (snapshot->belt_points) {
+        draw_belt(*snapshot->belt_points, scale);
+        belt_points_drawn.store(snapshot->belt_version, std::memory_order_relaxed); // Next step refreshes them
+    }
+    std::for_each(snapshot->planets.begin(), snapshot->planets.end(), [&](const Planet& p) {
         glColor3f(p.color.R, p.color.G, p.color.B);
         draw_planet(p.rad_m/scale, p.pos.x/scale, p.pos.y/scale);
     } );
 }
+
+void SimpleSpace::draw_scene(const TrajectoryFrame& frame, const float& scale) const {
+    glPointSize(3.0f);
+    glBegin(GL_POINTS);
+    for (size_t i = 0; i < frame.id.size(); ++i) {
+        // Radii and colors aren't recorded: color is stable per id
+        uint32_t hash = frame.id[i] * 2654435761u;
+        glColor3f(0.5f + (hash >> 24) / 512.0f, 0.5f + ((hash >> 16) & 0xFF) / 512.0f, 0.5f + ((hash >> 8) & 0xFF) / 512.0f);
+        glVertex2d(frame.x[i] / scale, frame.y[i] / scale);
+    }
+    glEnd();
+    glPointSize(1.0f);
+}
@@ -0,0 +1,582 @@
+//
+//  trajectory.cpp
+//  simple-space
+//
+
+#include "trajectory.h"
+#include "scene_file.h" // scene_checksum()
+#include "varint.h"
+
+#include <string.h> // memcpy(), memcmp(), strncpy()
+#include <math.h>   // llround()
+
+#if TRAJECTORY_ZLIB
+    #include <zlib.h>
+#endif
+
+#define TRAJECTORY_FLAG_SAME_IDS 0x01 // Ids are the same as in previous frame of block
+
+#define TRAJECTORY_BLOCK_MAX_SIZE (1ULL << 31) // Sanity limit for reader
+
+// Block header of version 1 files (no last step)
+struct TrajectoryBlockHeaderV1 {
+    uint32_t method;
+    uint32_t frames_num;
+    uint64_t first_step;
+    uint64_t raw_size;
+    uint64_t stored_size;
+    uint64_t checksum;
+};
+
+static inline unsigned int fields_num(uint32_t fields) {
+    return (fields & TRAJECTORY_FIELD_VELOCITY) ? 4 : 2;
+}
+
+// Previous quantized values by id: valid only if id was in the frame just before
+static void grow_by_id(uint32_t id, std::vector<int64_t>* prev_q, std::vector<uint32_t>& prev_frame) {
+    if (id < prev_frame.size())
+        return;
+    size_t size = static_cast<size_t>(id) + 1;
+    size = (size < 2 * prev_frame.size()) ? 2 * prev_frame.size() : size;
+    prev_frame.resize(size, 0);
+    for (unsigned int k = 0; k < 4; ++k)
+        prev_q[k].resize(size, 0);
+}
+
+TrajectoryRecorder::TrajectoryRecorder() :
+    _file(NULL),
+    _failed(false),
+    _head(0),
+    _tail(0),
+    _stride(1),
+    _stopping(false),
+    _block_frames(0),
+    _block_first_step(0),
+    _prev_step(0),
+    _frames_encoded(0),
+    _frames_captured(0),
+    _frames_written(0),
+    _frames_dropped(0),
+    _steps_blocked(0),
+    _blocks_written(0),
+    _bytes_encoded(0),
+    _bytes_stored(0),
+    _writer_busy_ms(0),
+    _elapsed_ms(0) {
+    wTimeZero(&_start_time);
+}
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+    stop();
+}
+
+bool TrajectoryRecorder::start(const char* path, const TrajectoryConfig& config) {
+    stop();
+
+    _config = config;
+    if (_config.interval_steps == 0)
+        _config.interval_steps = 1;
+    if (_config.ring_frames == 0)
+        _config.ring_frames = 1;
+    if (!(_config.pos_quantum_m > 0) || !(_config.vel_quantum > 0))
+        return false;
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+        return false;
+
+    TrajectoryFileHeader header;
+    memset(&header, 0, sizeof(header));
+    strncpy(header.magic, TRAJECTORY_FILE_MAGIC, sizeof(header.magic));
+    header.version = TRAJECTORY_FILE_VERSION;
+    header.fields = _config.fields;
+    header.pos_quantum_m = _config.pos_quantum_m;
+    header.vel_quantum = _config.vel_quantum;
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        fclose(file);
+        return false;
+    }
+
+    // Slots keep their capacity between frames, so capture doesn't allocate once warmed up
+    _ring.resize(_config.ring_frames);
+    _head = 0;
+    _tail = 0;
+    _stride = 1;
+    _stopping = false;
+    _failed = false;
+
+    _prev_id.clear();
+    _block_frames = 0;
+    _block.clear();
+    _frames_encoded = 0;
+
+    _frames_captured = 0;
+    _frames_written = 0;
+    _frames_dropped = 0;
+    _steps_blocked = 0;
+    _blocks_written = 0;
+    _bytes_encoded = 0;
+    _bytes_stored = sizeof(header);
+    _writer_busy_ms = 0;
+    _elapsed_ms = 0;
+    wTimeNow(&_start_time);
+
+    _file = file;
+    wEventInit(&_data_event);
+    wEventInit(&_space_event);
+    wThreadCreate(&_writer, writer_loop, this, true);
+    return true;
+}
+
+void TrajectoryRecorder::stop() {
+    if (_file == NULL)
+        return;
+    _stopping = true;
+    wEventSignal(&_data_event);
+    wThreadJoin(_writer, NULL);
+
+    if (fclose(_file) != 0)
+        _failed = true;
+    _file = NULL;
+    wEventDestroy(&_data_event);
+    wEventDestroy(&_space_event);
+
+    wTime now;
+    wTimeNow(&now);
+    _elapsed_ms = wTimeDiffMs(&_start_time, &now);
+}
+
+void TrajectoryRecorder::capture(unsigned long steps_count, const std::vector<Planet>& planets) {
+    if (_file == NULL)
+        return;
+
+    const uint64_t head = _head.load(std::memory_order_relaxed);
+    const uint64_t ring_size = _ring.size();
+    uint64_t tail = _tail.load(std::memory_order_acquire);
+
+    if (head == tail)
+        _stride = 1; // Writer caught up
+
+    if (head - tail >= ring_size) {
+        if (_config.policy != TRAJECTORY_BLOCK) {
+            ++_frames_dropped;
+            if ((_config.policy == TRAJECTORY_DECIMATE) && (_stride < (1UL << 20)))
+                _stride *= 2;
+            return;
+        }
+        ++_steps_blocked;
+        while (head - _tail.load(std::memory_order_acquire) >= ring_size)
+            wEventWait(&_space_event, 10); // Timeout covers signal sent before wait
+    }
+
+    TrajectoryFrame& frame = _ring[head % ring_size];
+    const size_t count = planets.size();
+    const bool velocity = (_config.fields & TRAJECTORY_FIELD_VELOCITY) != 0;
+    frame.step = steps_count;
+    frame.id.resize(count);
+    frame.x.resize(count);
+    frame.y.resize(count);
+    frame.vx.resize(velocity ? count : 0);
+    frame.vy.resize(velocity ? count : 0);
+    for (size_t i = 0; i < count; ++i) {
+        const Planet& pl = planets[i];
+        frame.id[i] = pl.id;
+        frame.x[i] = pl.pos.x;
+        frame.y[i] = pl.pos.y;
+    }
+    if (velocity) {
+        for (size_t i = 0; i < count; ++i) {
+            frame.vx[i] = planets[i].vel.x;
+            frame.vy[i] = planets[i].vel.y;
+        }
+    }
+
+    _head.store(head + 1, std::memory_order_release);
+    ++_frames_captured;
+    wEventSignal(&_data_event);
+}
+
+int TrajectoryRecorder::writer_loop(void* arg) {
+    TrajectoryRecorder& rec = *static_cast<TrajectoryRecorder*>(arg);
+    const uint64_t ring_size = rec._ring.size();
+
+    for (;;) {
+        uint64_t tail = rec._tail.load(std::memory_order_relaxed);
+        uint64_t head = rec._head.load(std::memory_order_acquire);
+        if (tail == head) {
+            if (rec._stopping.load()) {
+                if (rec._head.load(std::memory_order_acquire) == tail)
+                    break; // Nothing was captured after check
+                continue;
+            }
+            wEventWait(&rec._data_event, 100);
+            continue;
+        }
+
+        wTime busy_start, busy_end;
+        wTimeNow(&busy_start);
+        for (; tail != head; ++tail) {
+            rec.encode_frame(rec._ring[tail % ring_size]);
+            rec._tail.store(tail + 1, std::memory_order_release);
+            wEventSignal(&rec._space_event);
+            if ((rec._block_frames >= TRAJECTORY_BLOCK_FRAMES) || (rec._block.size() >= TRAJECTORY_BLOCK_BYTES))
+                rec.flush_block();
+        }
+        wTimeNow(&busy_end);
+        rec._writer_busy_ms += wTimeDiffMs(&busy_start, &busy_end);
+    }
+
+    rec.flush_block();
+    return 0;
+}
+
+void TrajectoryRecorder::encode_frame(const TrajectoryFrame& frame) {
+    const size_t begin_size = _block.size();
+    const size_t count = frame.id.size();
+    const bool keyframe = (_block_frames == 0);
+    if (keyframe)
+        _block_first_step = frame.step;
+
+    put_varint(_block, frame.step - (keyframe ? _block_first_step : _prev_step));
+    put_varint(_block, count);
+
+    const bool same_ids = !keyframe && (frame.id == _prev_id);
+    _block.push_back(same_ids ? TRAJECTORY_FLAG_SAME_IDS : 0);
+    if (!same_ids) {
+        int64_t prev = 0;
+        for (size_t i = 0; i < count; ++i) {
+            put_zigzag(_block, static_cast<int64_t>(frame.id[i]) - prev);
+            prev = frame.id[i];
+        }
+        _prev_id = frame.id;
+    }
+
+    // Frame stamps are numbers of frames (from 1), so stamp of previous frame means
+    // body was there; keyframe ignores them
+    const uint32_t stamp = ++_frames_encoded;
+    for (size_t i = 0; i < count; ++i)
+        grow_by_id(frame.id[i], _prev_q, _prev_frame);
+
+    const std::vector<double>* values[4] = {&frame.x, &frame.y, &frame.vx, &frame.vy};
+    const unsigned int nfields = fields_num(_config.fields);
+    for (unsigned int k = 0; k < nfields; ++k) {
+        const double scale = 1.0 / ((k < 2) ? _config.pos_quantum_m : _config.vel_quantum);
+        const std::vector<double>& v = *values[k];
+        std::vector<int64_t>& prev_q = _prev_q[k];
+        for (size_t i = 0; i < count; ++i) {
+            const uint32_t id = frame.id[i];
+            const int64_t q = llround(v[i] * scale);
+            const int64_t base = (!keyframe && (_prev_frame[id] == stamp - 1)) ? prev_q[id] : 0;
+            put_zigzag(_block, q - base);
+            prev_q[id] = q;
+        }
+    }
+    for (size_t i = 0; i < count; ++i)
+        _prev_frame[frame.id[i]] = stamp;
+
+    _prev_step = frame.step;
+    ++_block_frames;
+    _bytes_encoded += _block.size() - begin_size;
+}
+
+void TrajectoryRecorder::flush_block() {
+    if (_block_frames == 0)
+        return;
+
+    TrajectoryBlockHeader header;
+    memset(&header, 0, sizeof(header));
+    header.method = TRAJECTORY_METHOD_RAW;
+    header.frames_num = _block_frames;
+    header.first_step = _block_first_step;
+    header.last_step = _prev_step;
+    header.raw_size = _block.size();
+    header.stored_size = _block.size();
+    header.checksum = scene_checksum(_block.data(), _block.size());
+    const unsigned char* payload = _block.data();
+
+#if TRAJECTORY_ZLIB
+    // Fastest level: deltas are small numbers, most of gain comes at level 1 already
+    uLongf compressed_size = compressBound(static_cast<uLong>(_block.size()));
+    _compressed.resize(compressed_size);
+    if ((compress2(_compressed.data(), &compressed_size, _block.data(), static_cast<uLong>(_block.size()), 1) == Z_OK) &&
+        (compressed_size < _block.size())) {
+        header.method = TRAJECTORY_METHOD_ZLIB;
+        header.stored_size = compressed_size;
+        payload = _compressed.data();
+    }
+#endif
+
+    if (!_failed) {
+        if ((fwrite(&header, sizeof(header), 1, _file) != 1) ||
+            (fwrite(payload, 1, header.stored_size, _file) != header.stored_size))
+            _failed = true;
+    }
+
+    _bytes_stored += sizeof(header) + header.stored_size;
+    _frames_written += _block_frames;
+    ++_blocks_written;
+    _block_frames = 0;
+    _block.clear();
+}
+
+TrajectoryStats TrajectoryRecorder::stats() const {
+    TrajectoryStats stats;
+    stats.frames_captured = _frames_captured;
+    stats.frames_written = _frames_written;
+    stats.frames_dropped = _frames_dropped;
+    stats.steps_blocked = _steps_blocked;
+    stats.blocks_written = _blocks_written;
+    stats.bytes_encoded = _bytes_encoded;
+    stats.bytes_stored = _bytes_stored;
+    stats.writer_busy_ms = _writer_busy_ms;
+    stats.failed = _failed;
+    if (_file != NULL) {
+        wTime now;
+        wTimeNow(&now);
+        stats.elapsed_ms = wTimeDiffMs(&_start_time, &now);
+    } else {
+        stats.elapsed_ms = _elapsed_ms;
+    }
+    return stats;
+}
+
+TrajectoryReader::TrajectoryReader() :
+    _file(NULL),
+    _block_pos(0),
+    _block_frames_left(0),
+    _block_frame(0),
+    _block_first_step(0),
+    _prev_step(0),
+    _frames_decoded(0) {
+    memset(&_header, 0, sizeof(_header));
+}
+
+TrajectoryReader::~TrajectoryReader() {
+    close();
+}
+
+bool TrajectoryReader::open(const char* path) {
+    close();
+    _file = fopen(path, "rb");
+    if (_file == NULL)
+        return false;
+    if ((fread(&_header, sizeof(_header), 1, _file) != 1) ||
+        (memcmp(_header.magic, TRAJECTORY_FILE_MAGIC, sizeof(TRAJECTORY_FILE_MAGIC)) != 0) ||
+        (_header.version < 1) || (_header.version > TRAJECTORY_FILE_VERSION) ||
+        !(_header.pos_quantum_m > 0) || !(_header.vel_quantum > 0)) {
+        close();
+        return false;
+    }
+
+    // Index: headers only, payloads are skipped
+    const int64_t file_size = wFileSeek(_file, 0, SEEK_END) ? wFileTell(_file) : -1;
+    if (file_size < 0) {
+        close();
+        return false;
+    }
+    const uint64_t header_size = block_header_size();
+    uint64_t offset = sizeof(_header);
+    uint64_t frames = 0;
+    TrajectoryBlockHeader block;
+    while ((offset + header_size <= static_cast<uint64_t>(file_size)) &&
+           wFileSeek(_file, static_cast<int64_t>(offset), SEEK_SET) &&
+           read_block_header(block)) {
+        if ((block.frames_num == 0) || (block.last_step < block.first_step) ||
+            (block.stored_size > file_size - offset - header_size))
+            break;
+        TrajectoryBlockInfo info;
+        info.offset = offset;
+        info.first_step = block.first_step;
+        info.last_step = block.last_step;
+        info.first_frame = frames;
+        info.frames_num = block.frames_num;
+        _index.push_back(info);
+        frames += block.frames_num;
+        offset += header_size + block.stored_size;
+    }
+
+    // Version 1 headers have no last step: it's found by decoding every block once
+    if (_header.version == 1) {
+        std::vector<TrajectoryFrame> block_frames;
+        for (size_t b = 0; b < _index.size(); ++b) {
+            if (!read_block_frames(b, block_frames)) {
+                _index.resize(b); // Read up to corrupted block, like truncated file
+                break;
+            }
+            _index[b].last_step = block_frames.back().step;
+        }
+    }
+    return seek_block(0) || _index.empty();
+}
+
+uint64_t TrajectoryReader::block_header_size() const {
+    return (_header.version == 1) ? sizeof(TrajectoryBlockHeaderV1) : sizeof(TrajectoryBlockHeader);
+}
+
+bool TrajectoryReader::read_block_header(TrajectoryBlockHeader& header) {
+    if (_header.version != 1)
+        return fread(&header, sizeof(header), 1, _file) == 1;
+    TrajectoryBlockHeaderV1 v1;
+    if (fread(&v1, sizeof(v1), 1, _file) != 1)
+        return false;
+    header.method = v1.method;
+    header.frames_num = v1.frames_num;
+    header.first_step = v1.first_step;
+    header.last_step = v1.first_step; // Unknown until block is decoded
+    header.raw_size = v1.raw_size;
+    header.stored_size = v1.stored_size;
+    header.checksum = v1.checksum;
+    return true;
+}
+
+uint64_t TrajectoryReader::frames_count() const {
+    return _index.empty() ? 0 : _index.back().first_frame + _index.back().frames_num;
+}
+
+uint64_t TrajectoryReader::first_step() const {
+    return _index.empty() ? 0 : _index.front().first_step;
+}
+
+uint64_t TrajectoryReader::last_step() const {
+    return _index.empty() ? 0 : _index.back().last_step;
+}
+
+size_t TrajectoryReader::find_block(uint64_t step) const {
+    // Last block starting at or before step
+    size_t low = 0, high = _index.size();
+    while (high - low > 1) {
+        size_t mid = (low + high) / 2;
+        if (_index[mid].first_step <= step)
+            low = mid;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+bool TrajectoryReader::seek_block(size_t block) {
+    _block_frames_left = 0;
+    if ((_file == NULL) || (block >= _index.size()))
+        return false;
+    return wFileSeek(_file, static_cast<int64_t>(_index[block].offset), SEEK_SET);
+}
+
+bool TrajectoryReader::read_block_frames(size_t block, std::vector<TrajectoryFrame>& frames) {
+    if (!seek_block(block) || !read_block())
+        return false;
+    frames.resize(_index[block].frames_num);
+    for (size_t i = 0; i < frames.size(); ++i) {
+        if (!next_frame(frames[i]))
+            return false;
+    }
+    return true;
+}
+
+void TrajectoryReader::close() {
+    if (_file != NULL)
+        fclose(_file);
+    _file = NULL;
+    _block_frames_left = 0;
+    _prev_id.clear();
+    _index.clear();
+}
+
+bool TrajectoryReader::read_block() {
+    TrajectoryBlockHeader header;
+    if (!read_block_header(header))
+        return false;
+    if ((header.frames_num == 0) ||
+        (header.raw_size > TRAJECTORY_BLOCK_MAX_SIZE) || (header.stored_size > TRAJECTORY_BLOCK_MAX_SIZE))
+        return false;
+
+    _block.resize(header.raw_size);
+    if (header.method == TRAJECTORY_METHOD_RAW) {
+        if ((header.stored_size != header.raw_size) ||
+            (fread(_block.data(), 1, _block.size(), _file) != _block.size()))
+            return false;
+#if TRAJECTORY_ZLIB
+    } else if (header.method == TRAJECTORY_METHOD_ZLIB) {
+        _stored.resize(header.stored_size);
+        if (fread(_stored.data(), 1, _stored.size(), _file) != _stored.size())
+            return false;
+        uLongf raw_size = static_cast<uLongf>(header.raw_size);
+        if ((uncompress(_block.data(), &raw_size, _stored.data(), static_cast<uLong>(_stored.size())) != Z_OK) ||
+            (raw_size != header.raw_size))
+            return false;
+#endif
+    } else {
+        return false;
+    }
+    if (scene_checksum(_block.data(), _block.size()) != header.checksum)
+        return false;
+
+    _block_pos = 0;
+    _block_frames_left = header.frames_num;
+    _block_frame = 0;
+    _block_first_step = header.first_step;
+    return true;
+}
+
+bool TrajectoryReader::next_frame(TrajectoryFrame& frame) {
+    if (_file == NULL)
+        return false;
+    if ((_block_frames_left == 0) && !read_block())
+        return false;
+
+    const bool keyframe = (_block_frame == 0);
+    uint64_t step_delta, count;
+    if (!get_varint(_block, _block_pos, step_delta) || !get_varint(_block, _block_pos, count) ||
+        (_block_pos >= _block.size()) || (count > _block.size()))
+        return false;
+    const unsigned char flags = _block[_block_pos++];
+    frame.step = (keyframe ? _block_first_step : _prev_step) + step_delta;
+
+    if (flags & TRAJECTORY_FLAG_SAME_IDS) {
+        if (keyframe || (_prev_id.size() != count))
+            return false;
+    } else {
+        _prev_id.resize(count);
+        int64_t prev = 0;
+        for (size_t i = 0; i < count; ++i) {
+            int64_t delta;
+            if (!get_zigzag(_block, _block_pos, delta))
+                return false;
+            prev += delta;
+            if ((prev < 0) || (prev > 0xFFFFFFFFLL))
+                return false;
+            _prev_id[i] = static_cast<uint32_t>(prev);
+        }
+    }
+    frame.id = _prev_id;
+
+    const uint32_t stamp = ++_frames_decoded;
+    for (size_t i = 0; i < count; ++i)
+        grow_by_id(frame.id[i], _prev_q, _prev_frame);
+
+    const unsigned int nfields = fields_num(_header.fields);
+    frame.vx.clear();
+    frame.vy.clear();
+    std::vector<double>* values[4] = {&frame.x, &frame.y, &frame.vx, &frame.vy};
+    for (unsigned int k = 0; k < nfields; ++k) {
+        const double quantum = (k < 2) ? _header.pos_quantum_m : _header.vel_quantum;
+        std::vector<double>& v = *values[k];
+        std::vector<int64_t>& prev_q = _prev_q[k];
+        v.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            const uint32_t id = frame.id[i];
+            int64_t delta;
+            if (!get_zigzag(_block, _block_pos, delta))
+                return false;
+            const int64_t base = (!keyframe && (_prev_frame[id] == stamp - 1)) ? prev_q[id] : 0;
+            prev_q[id] = base + delta;
+            v[i] = static_cast<double>(prev_q[id]) * quantum;
+        }
+    }
+    for (size_t i = 0; i < count; ++i)
+        _prev_frame[frame.id[i]] = stamp;
+
+    _prev_step = frame.step;
+    ++_block_frame;
+    --_block_frames_left;
+    return true;
+}
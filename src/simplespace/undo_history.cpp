@@ -0,0 +1,116 @@
+//
+//  undo_history.cpp
+//  simple-space
+//
+
+#include "undo_history.h"
+#include <algorithm>
+#include <set>
+
+std::shared_ptr<const UndoState> UndoHistory::capture(const std::vector<Planet>& planets, size_t dirty_begin,
+                                                      const ParticleBelt& belt, bool belt_dirty, unsigned long tag) {
+    std::shared_ptr<UndoState> state(new UndoState);
+    state->tag = tag;
+    state->planets_count = planets.size();
+    const size_t chunks_count = (planets.size() + UNDO_CHUNK_PLANETS - 1) / UNDO_CHUNK_PLANETS;
+    state->chunks.reserve(chunks_count);
+    for (size_t c = 0; c < chunks_count; ++c) {
+        const size_t begin = c * UNDO_CHUNK_PLANETS;
+        const size_t end = std::min(begin + UNDO_CHUNK_PLANETS, planets.size());
+        // Clean chunk of base is full one: base had at least dirty_begin planets
+        if (_base && (end <= dirty_begin) && (c < _base->chunks.size()) &&
+            (_base->chunks[c]->size() == end - begin)) {
+            state->chunks.push_back(_base->chunks[c]);
+        } else {
+            state->chunks.push_back(std::shared_ptr<const UndoChunk>(
+                new UndoChunk(planets.begin() + begin, planets.begin() + end)));
+        }
+    }
+
+    if (_base && !belt_dirty && (_base->belt->x.size() == belt.size())) {
+        state->belt = _base->belt;
+    } else {
+        std::shared_ptr<UndoBelt> copy(new UndoBelt);
+        copy->x.assign(belt.x(), belt.x() + belt.size());
+        copy->y.assign(belt.y(), belt.y() + belt.size());
+        copy->vx.assign(belt.vx(), belt.vx() + belt.size());
+        copy->vy.assign(belt.vy(), belt.vy() + belt.size());
+        state->belt = copy;
+    }
+
+    _base = state;
+    return state;
+}
+
+void UndoHistory::push(const std::shared_ptr<const UndoState>& state) {
+    _undo.push_back(state);
+    _redo.clear();
+    trim();
+}
+
+std::shared_ptr<const UndoState> UndoHistory::undo(const std::shared_ptr<const UndoState>& current) {
+    if (_undo.empty())
+        return std::shared_ptr<const UndoState>();
+    _redo.push_back(current);
+    _base = _undo.back();
+    _undo.pop_back();
+    return _base;
+}
+
+std::shared_ptr<const UndoState> UndoHistory::redo(const std::shared_ptr<const UndoState>& current) {
+    if (_redo.empty())
+        return std::shared_ptr<const UndoState>();
+    _undo.push_back(current);
+    _base = _redo.back();
+    _redo.pop_back();
+    trim();
+    return _base;
+}
+
+void UndoHistory::trim() {
+    while (_undo.size() > UNDO_HISTORY_DEPTH)
+        _undo.pop_front();
+    while ((_undo.size() > 1) && (bytes() > UNDO_HISTORY_BYTES))
+        _undo.pop_front();
+}
+
+void UndoHistory::clear() {
+    _undo.clear();
+    _redo.clear();
+    _base.reset();
+}
+
+static void count_state(const std::shared_ptr<const UndoState>& state, std::set<const void*>& seen, size_t& bytes) {
+    if (!state)
+        return;
+    for (size_t c = 0; c < state->chunks.size(); ++c) {
+        if (seen.insert(state->chunks[c].get()).second)
+            bytes += state->chunks[c]->size() * sizeof(Planet);
+    }
+    if (seen.insert(state->belt.get()).second)
+        bytes += state->belt->x.size() * 4 * sizeof(double);
+}
+
+size_t UndoHistory::bytes() const {
+    std::set<const void*> seen;
+    size_t total = 0;
+    for (size_t i = 0; i < _undo.size(); ++i)
+        count_state(_undo[i], seen, total);
+    for (size_t i = 0; i < _redo.size(); ++i)
+        count_state(_redo[i], seen, total);
+    count_state(_base, seen, total);
+    return total;
+}
+
+void UndoHistory::restore(const UndoState& state, std::vector<Planet>& planets, ParticleBelt& belt) {
+    planets.resize(state.planets_count);
+    for (size_t c = 0; c < state.chunks.size(); ++c)
+        std::copy(state.chunks[c]->begin(), state.chunks[c]->end(), planets.begin() + c * UNDO_CHUNK_PLANETS);
+
+    const UndoBelt& copy = *state.belt;
+    belt.resize(copy.x.size());
+    std::copy(copy.x.begin(), copy.x.end(), belt.x());
+    std::copy(copy.y.begin(), copy.y.end(), belt.y());
+    std::copy(copy.vx.begin(), copy.vx.end(), belt.vx());
+    std::copy(copy.vy.begin(), copy.vy.end(), belt.vy());
+}
@@ -0,0 +1,116 @@
+//
+//  WorkerPool.cpp
+//
+
+#include "WorkerPool.h"
+
+
+WorkerPool::WorkerPool(unsigned int workersNum /* = 0 */) :
+    mWorkersNum((workersNum > 0) ? workersNum : wCpuCoresNum()),
+    mIsRunning(true),
+    mTaskFunc(NULL),
+    mTaskArg(NULL),
+    mTasksNum(0),
+    mBusyWorkers(0)
+{
+    wEventInit(&mDoneEvent);
+    wMutexInit(&mRunLock);
+
+    // Worker #0 is the thread calling run(), others are spawned
+    mWorkers.resize(mWorkersNum);
+    for (unsigned int i = 0; i < mWorkersNum; ++i)
+    {
+        mWorkers[i].pPool = this;
+        mWorkers[i].idx = i;
+        wEventInit(&mWorkers[i].startEvent);
+    }
+    for (unsigned int i = 1; i < mWorkersNum; ++i)
+    {
+        wThreadCreate(&mWorkers[i].thread, WorkerPool::staticWrapper, &mWorkers[i], true);
+    }
+}
+
+
+WorkerPool::~WorkerPool()
+{
+    mIsRunning = false;
+    for (unsigned int i = 1; i < mWorkersNum; ++i)
+    {
+        wEventSignal(&mWorkers[i].startEvent);
+        wThreadJoin(mWorkers[i].thread, NULL);
+    }
+    for (unsigned int i = 0; i < mWorkersNum; ++i)
+    {
+        wEventDestroy(&mWorkers[i].startEvent);
+    }
+    wMutexDestroy(&mRunLock);
+    wEventDestroy(&mDoneEvent);
+}
+
+
+unsigned int WorkerPool::workersNum() const
+{
+    return mWorkersNum;
+}
+
+
+void WorkerPool::run(wTaskFunc taskFunc, void* arg, unsigned int tasksNum)
+{
+    if (tasksNum == 0)
+        return;
+
+    wMutexLock(&mRunLock);
+
+    mTaskFunc = taskFunc;
+    mTaskArg = arg;
+    mTasksNum = tasksNum;
+
+    // Wake up only workers having tasks
+    unsigned int helpers = ((tasksNum < mWorkersNum) ? tasksNum : mWorkersNum) - 1;
+    mBusyWorkers.store(helpers, std::memory_order_release);
+    for (unsigned int i = 1; i <= helpers; ++i)
+    {
+        wEventSignal(&mWorkers[i].startEvent);
+    }
+
+    runWorkerTasks(0);
+
+    while (mBusyWorkers.load(std::memory_order_acquire) > 0)
+    {
+        wEventWait(&mDoneEvent, W_TIMEOUT_INITITE);
+    }
+
+    wMutexUnlock(&mRunLock);
+}
+
+
+void WorkerPool::runWorkerTasks(unsigned int workerIdx)
+{
+    for (unsigned int task = workerIdx; task < mTasksNum; task += mWorkersNum)
+    {
+        mTaskFunc(mTaskArg, task, workerIdx);
+    }
+}
+
+
+int WorkerPool::staticWrapper(void* arg)
+{
+    Worker* pWorker = static_cast<Worker*>(arg);
+    WorkerPool* pPool = pWorker->pPool;
+
+    while (true)
+    {
+        wEventWait(&pWorker->startEvent, W_TIMEOUT_INITITE);
+        if (!pPool->mIsRunning)
+            break;
+
+        pPool->runWorkerTasks(pWorker->idx);
+
+        if (pPool->mBusyWorkers.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            wEventSignal(&pPool->mDoneEvent);
+        }
+    }
+
+    return 0;
+}
@@ -309,6 +309,19 @@ void wThreadJoin(wThread thread, int* p_retval)
     #endif
 }
 
+unsigned int wCpuCoresNum()
+{
+    #if defined(__APPLE__) || defined(__linux__)
+    long num = sysconf(_SC_NPROCESSORS_ONLN);
+    return (num > 0) ? (unsigned int)num : 1;
+
+    #elif defined(__WIN32__)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 0) ? (unsigned int)info.dwNumberOfProcessors : 1;
+    #endif
+}
+
 // Events
 
 void wEventInit(wEvent* event)
@@ -347,7 +360,7 @@ int wEventWait(wEvent* event, unsigned long timeoutMs)
     #if defined(__APPLE__) || defined(__linux__)
 
     int ret;
-    int wait_ret;
+    int wait_ret = 0; // Stays 0 if event is already signaled
 
     ret = pthread_mutex_lock(&event->mutex);
     assert(ret == 0);
@@ -437,3 +450,111 @@ void wEventReset(wEvent* event)
     assert(ret != 0);
     #endif
 }
+
+// Memory-mapped files
+
+bool wMapFile(const char* path, wMappedFile* file)
+{
+    file->data = NULL;
+    file->size = 0;
+
+    #if defined(__APPLE__) || defined(__linux__)
+    struct stat st;
+    void* data;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return false;
+    }
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // Mapping keeps file referenced
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    file->data = data;
+    file->size = (size_t)st.st_size;
+    return true;
+
+    #elif defined(__WIN32__)
+    LARGE_INTEGER size;
+    HANDLE handle = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart <= 0)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+    file->mapping = CreateFileMapping(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(handle); // Mapping keeps file referenced
+    if (file->mapping == NULL)
+    {
+        return false;
+    }
+    file->data = MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (file->data == NULL)
+    {
+        CloseHandle(file->mapping);
+        return false;
+    }
+    file->size = (size_t)size.QuadPart;
+    return true;
+    #endif
+}
+
+void wUnmapFile(wMappedFile* file)
+{
+    if (file->data == NULL)
+    {
+        return;
+    }
+
+    #if defined(__APPLE__) || defined(__linux__)
+    int ret = munmap((void*)file->data, file->size);
+    assert(ret == 0);
+
+    #elif defined(__WIN32__)
+    int ret = UnmapViewOfFile(file->data);
+    assert(ret != 0);
+    ret = CloseHandle(file->mapping);
+    assert(ret != 0);
+    #endif
+
+    file->data = NULL;
+    file->size = 0;
+}
+
+// Files larger than 2 GB
+
+bool wFileSeek(FILE* file, int64_t offset, int origin)
+{
+    #if defined(__APPLE__) || defined(__linux__)
+    // off_t is 64-bit on 64-bit systems (and with _FILE_OFFSET_BITS=64 on 32-bit ones)
+    if ((sizeof(off_t) < sizeof(offset)) && (offset != (int64_t)(off_t)offset))
+    {
+        return false;
+    }
+    return fseeko(file, (off_t)offset, origin) == 0;
+
+    #elif defined(__WIN32__)
+    return _fseeki64(file, offset, origin) == 0;
+    #endif
+}
+
+int64_t wFileTell(FILE* file)
+{
+    #if defined(__APPLE__) || defined(__linux__)
+    return (int64_t)ftello(file);
+
+    #elif defined(__WIN32__)
+    return _ftelli64(file);
+    #endif
+}
@@ -0,0 +1,140 @@
+//
+//  bench_gravity.cpp
+//  simple-space
+//
+//  Throughput of direct-sum gravity versus bodies number.
+//  Interactions are ordered pairs (N * (N - 1) per step), whatever the solver visits.
+//
+//  Measured on one core (x86-64 Xeon, 48 KB L1d, 2 MB L2), g++ -O2, SSE2, Mpairs/s:
+//
+//       N    reference   symmetric   tiled
+//    1000          12         291      357
+//    2000          13         287      343
+//    5000          12         297      342
+//   10000           -         310      331
+//   20000           -         270      304
+//   50000           -         271      286
+//
+//  Symmetric solver evaluates every pair once, but scatters into accelerations of both
+//  bodies and its kernel is scalar. Tiled one evaluates every pair twice with packed
+//  (two targets) kernel on cache-resident blocks: it's the fastest exact mode here, and
+//  validation step at N = 50000 takes about 9 s per core.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+extern "C"
+{
+    #include "osWrappers.h"
+    #include "logs.h"
+}
+
+#include "simplespace.h"
+
+#define BENCH_MIN_TIME_MS  500  // Every measurement repeats steps at least for this time
+#define REFERENCE_MAX_N    5000 // Reference solver is too slow for bigger scenes
+
+// Uniform disk of equal bodies, same for every run (fixed LCG)
+static void make_bodies(size_t count, std::vector<double>& x, std::vector<double>& y) {
+    unsigned long long seed = 12345;
+    x.resize(count);
+    y.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        double r, a;
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        r = 4e7 * sqrt(double(seed >> 11) / double(1ULL << 53));
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        a = 2 * M_PI * double(seed >> 11) / double(1ULL << 53);
+        x[i] = r * cos(a);
+        y[i] = r * sin(a);
+    }
+}
+
+// Mpairs/s of solver compute() alone
+static double bench_solver(GravitySolver& solver, size_t count) {
+    std::vector<double> x, y;
+    make_bodies(count, x, y);
+    std::vector<double> mass(count, 1e24), rad(count, 1e3), soft(count, 0);
+    std::vector<Vector2d> acc(count);
+
+    GravityBodies bodies;
+    bodies.count = count;
+    bodies.massive_count = count;
+    bodies.x = x.data();
+    bodies.y = y.data();
+    bodies.mass = mass.data();
+    bodies.rad = rad.data();
+    bodies.soft = soft.data();
+    bodies.softening = Physics::SOFTENING_NONE;
+    bodies.precision = GRAVITY_PRECISION_DOUBLE;
+
+    ScratchArena arena;
+    unsigned long elapsed = 0;
+    unsigned long steps = 0;
+    wTime start, now;
+    wTimeNow(&start);
+    do {
+        arena.reset();
+        ScratchBuffer<CollisionPair> candidates(arena, 256);
+        solver.compute(bodies, acc.data(), 0, candidates);
+        ++steps;
+        wTimeNow(&now);
+        elapsed = wTimeDiffMs(&start, &now);
+    } while (elapsed < BENCH_MIN_TIME_MS);
+    return double(count) * double(count - 1) * steps / (elapsed * 1e3);
+}
+
+// Mpairs/s of whole engine step with reference (fused) solver
+static double bench_reference(size_t count) {
+    std::vector<double> x, y;
+    make_bodies(count, x, y);
+    SpaceConfig config;
+    config.borders_enabled = false;
+    SimpleSpace space(10, 1, config);
+    for (size_t i = 0; i < count; ++i)
+        space.add_planet(Planet(Vector2d(x[i], y[i]), Vector2d(), 1e24, 1e3));
+
+    unsigned long elapsed = 0;
+    unsigned long steps = 0;
+    wTime start, now;
+    wTimeNow(&start);
+    do {
+        space.move_one_step();
+        ++steps;
+        wTimeNow(&now);
+        elapsed = wTimeDiffMs(&start, &now);
+    } while (elapsed < BENCH_MIN_TIME_MS);
+    return double(count) * double(count - 1) * steps / (elapsed * 1e3);
+}
+
+int main(int argc, char* argv[])
+{
+    wTimeInit();
+    logsInit();
+
+    // Workers number: first argument (default 1, so numbers are per core)
+    unsigned int workers = (argc > 1) ? static_cast<unsigned int>(atoi(argv[1])) : 1;
+    WorkerPool pool(workers);
+    SymmetricGravitySolver symmetric(pool);
+    TiledGravitySolver tiled(pool);
+
+    const size_t sizes[] = {1000, 2000, 5000, 10000, 20000, 50000};
+    printf("Direct-sum gravity throughput, Mpairs/s (%u workers)\n", pool.workersNum());
+    printf("%8s %12s %12s %8s\n", "N", "reference", "symmetric", "tiled");
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); ++k) {
+        const size_t n = sizes[k];
+        if (n <= REFERENCE_MAX_N)
+            printf("%8lu %12.0f", (unsigned long)n, bench_reference(n));
+        else
+            printf("%8lu %12s", (unsigned long)n, "-");
+        printf(" %12.0f", bench_solver(symmetric, n));
+        printf(" %8.0f\n", bench_solver(tiled, n));
+        fflush(stdout);
+    }
+
+    logsDeinit();
+    wTimeDeinit();
+    return 0;
+}
@@ -0,0 +1,1647 @@
+//
+//  test_simplespace.cpp
+//  simple-space
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h> // offsetof()
+#include <new>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+extern "C"
+{
+    #include "osWrappers.h"
+    #include "logs.h"
+}
+
+#include "simplespace.h"
+#include "replay.h"
+
+#define PRODUCERS_NUM       4
+#define POSTS_PER_PRODUCER  100
+
+SimpleSpace* gSpace = NULL;
+
+// Allocations counting hook (all C++ heap allocations go through these operators)
+volatile bool gCountAllocations = false;
+std::atomic<unsigned long> gAllocations(0);
+
+void* operator new(size_t size)
+{
+    if (gCountAllocations)
+        ++gAllocations;
+    void* ptr = malloc(size);
+    if (ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+int failures = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("CHECK FAILED: %s (%s:%d)\n", #cond, __FILE__, __LINE__);  \
+            ++failures;                                                     \
+        }                                                                   \
+    } while (0)
+
+int producerFunc(void* arg)
+{
+    int producer = (int)(uintptr_t)arg;
+    for (int i = 0; i < POSTS_PER_PRODUCER; ++i)
+    {
+        // Unique position for every planet (far enough to never collide)
+        Vector2d pos(-7e7 + i * 1e6, -4e7 + producer * 1e7);
+        gSpace->post_add_planet(Planet(pos, Vector2d(), 1, 1));
+    }
+    return 0;
+}
+
+volatile bool gReading = false;
+volatile bool gReaderStarted = false;
+
+int readerFunc(void* arg)
+{
+    unsigned long reads = 0, last_version = 0;
+    gReaderStarted = true;
+    while (gReading)
+    {
+        std::shared_ptr<const PlanetsSnapshot> snapshot = gSpace->get_snapshot();
+        CHECK(snapshot->version >= last_version);
+        last_version = snapshot->version;
+        gSpace->find_planet_by_click(Vector2d(0, 0));
+        ++reads;
+    }
+    printf("reader: %lu snapshots read, last version: %lu\n", reads, last_version);
+    return 0;
+}
+
+int main(void)
+{
+    wTimeInit();
+    logsInit();
+
+    // ==== Test Case 1 ====
+
+    printf("Test Case 1: Started (posting from %d threads while stepping)\n", PRODUCERS_NUM);
+    gSpace = new SimpleSpace(10);
+
+    wThread producers[PRODUCERS_NUM];
+    for (int i = 0; i < PRODUCERS_NUM; ++i)
+        wThreadCreate(&producers[i], producerFunc, (void*)(uintptr_t)i, true);
+
+    for (int i = 0; i < 50; ++i)
+        gSpace->move_one_step();
+
+    for (int i = 0; i < PRODUCERS_NUM; ++i)
+        wThreadJoin(producers[i], NULL);
+
+    gSpace->apply_pending_commands();
+    printf("planets after posting: %lu\n", gSpace->get_planets_count());
+    CHECK(gSpace->get_planets_count() == PRODUCERS_NUM * POSTS_PER_PRODUCER);
+    printf("Test Case 1: Finished\n");
+
+    // ==== Test Case 2 ====
+
+    printf("Test Case 2: Started (commands order)\n");
+    gSpace->post_remove_all_objects();
+    unsigned int id_a = gSpace->post_add_planet(Planet(Vector2d(-1e7, 0), Vector2d(), 1, 1));
+    unsigned int id_b = gSpace->post_add_planet(Planet(Vector2d( 1e7, 0), Vector2d(), 1, 1));
+    CHECK(gSpace->get_planets_count() == PRODUCERS_NUM * POSTS_PER_PRODUCER); // Nothing applied yet
+
+    Planet modified(Vector2d(2e7, 0), Vector2d(), 5, 2);
+    modified.id = id_b;
+    gSpace->post_modify_planet(modified);
+    gSpace->post_remove_planet(id_a);
+    gSpace->apply_pending_commands();
+
+    CHECK(gSpace->get_planets_count() == 1);
+    CHECK(gSpace->planets.size() == 1 && gSpace->planets[0].id == id_b);
+    CHECK(gSpace->planets.size() == 1 && gSpace->planets[0].mass_kg == 5);
+    printf("Test Case 2: Finished\n");
+
+    // ==== Test Case 3 ====
+
+    printf("Test Case 3: Started (reading snapshots while stepping)\n");
+    wThread reader;
+    gReading = true;
+    wThreadCreate(&reader, readerFunc, NULL, true);
+    while (!gReaderStarted)
+        wTimeSleepMs(1);
+    for (int i = 0; i < 200; ++i) {
+        gSpace->move_one_step();
+        if (i % 20 == 0)
+            wTimeSleepMs(1); // Let reader run on single core machines too
+    }
+    gReading = false;
+    wThreadJoin(reader, NULL);
+    printf("Test Case 3: Finished\n");
+
+    // ==== Test Case 4 ====
+
+    printf("Test Case 4: Started (no heap allocations in steady state steps)\n");
+    producerFunc((void*)0);
+    producerFunc((void*)1);
+    gSpace->apply_pending_commands();
+    for (int i = 0; i < 5; ++i) // Warm up: snapshots pool and scratch arena get their sizes
+        gSpace->move_one_step();
+
+    gAllocations = 0;
+    gCountAllocations = true;
+    for (int i = 0; i < 50; ++i)
+        gSpace->move_one_step();
+    gCountAllocations = false;
+
+    printf("allocations during 50 steps: %lu\n", gAllocations.load());
+    CHECK(gAllocations == 0);
+    printf("Test Case 4: Finished\n");
+
+    delete gSpace;
+
+    // ==== Test Case 5 ====
+
+    printf("Test Case 5: Started (symmetric gravity solver)\n");
+    SimpleSpace* spaces[3] = {new SimpleSpace(10, 1), new SimpleSpace(10, 3), new SimpleSpace(10, 1)};
+    spaces[0]->set_gravity_solver(GRAVITY_SOLVER_SYMMETRIC);
+    spaces[1]->set_gravity_solver(GRAVITY_SOLVER_SYMMETRIC);
+    for (int k = 0; k < 3; ++k) {
+        // More than two tiles, so tile pairs are spread between rounds and workers
+        for (int i = 0; i < 300; ++i) {
+            Vector2d pos(-7e7 + (i % 30) * 4.5e6, -4e7 + (i / 30) * 8e6);
+            spaces[k]->add_planet(Planet(pos, Vector2d(), 1e24 * (1 + i % 7), 1e5));
+        }
+    }
+    for (int i = 0; i < 100; ++i) {
+        for (int k = 0; k < 3; ++k)
+            spaces[k]->move_one_step();
+    }
+
+    bool identical = true;
+    double max_diff = 0;
+    for (size_t i = 0; i < spaces[0]->planets.size(); ++i) {
+        const Planet& a = spaces[0]->planets[i];
+        const Planet& b = spaces[1]->planets[i];
+        const Planet& ref = spaces[2]->planets[i];
+        if ((a.pos.x != b.pos.x) || (a.pos.y != b.pos.y) || (a.vel.x != b.vel.x) || (a.vel.y != b.vel.y))
+            identical = false;
+        max_diff = std::max(max_diff, Physics::DistFromPos(a.pos, ref.pos));
+    }
+    printf("max distance from reference solver: %g m\n", max_diff);
+    CHECK(identical);       // Same bits for 1 and 3 workers
+    CHECK(max_diff < 1.0);  // Only rounding differs from reference
+    for (int k = 0; k < 3; ++k)
+        delete spaces[k];
+    printf("Test Case 5: Finished\n");
+
+    // ==== Test Case 6 ====
+
+    printf("Test Case 6: Started (softened gravity for coinciding bodies)\n");
+    CHECK(Physics::NewtonInvDist3(0) == 0);
+    CHECK(Physics::SplineInvDist3(100.0 * 100.0, 10.0) == Physics::NewtonInvDist3(100.0 * 100.0)); // Beyond 2.8 * eps
+    CHECK(fabs(Physics::PlummerInvDist3(1e6 * 1e6, 1.0) / Physics::NewtonInvDist3(1e6 * 1e6) - 1) < 1e-9);
+
+    Physics::SofteningType types[3] = {Physics::SOFTENING_NONE, Physics::SOFTENING_PLUMMER, Physics::SOFTENING_SPLINE};
+    for (int t = 0; t < 3; ++t) {
+        for (int solver = 0; solver < 2; ++solver) {
+            SimpleSpace space(10, 2);
+            space.set_gravity_solver(solver ? GRAVITY_SOLVER_SYMMETRIC : GRAVITY_SOLVER_REFERENCE);
+            space.set_softening(types[t], 1e6);
+            // Zero radius bodies never collide, so they stay in the same point
+            space.add_planet(Planet(Vector2d(1e7, 1e7), Vector2d(), 1e24, 0));
+            space.add_planet(Planet(Vector2d(1e7, 1e7), Vector2d(), 1e24, 0));
+            space.add_planet(Planet(Vector2d(1e7 + 1e5, 1e7), Vector2d(), 1e24, 0, Color_RGB(), 0, 5e6));
+            bool finite = true;
+            try {
+                for (int i = 0; i < 20; ++i)
+                    space.move_one_step();
+                for (size_t i = 0; i < space.planets.size(); ++i)
+                    finite = finite && std::isfinite(space.planets[i].pos.x) && std::isfinite(space.planets[i].pos.y);
+            } catch (...) {
+                finite = false;
+            }
+            CHECK(finite);
+        }
+    }
+    printf("Test Case 6: Finished\n");
+
+    // ==== Test Case 7 ====
+
+    printf("Test Case 7: Started (mixed precision gravity)\n");
+    SimpleSpace* mixed[3] = {new SimpleSpace(10, 1), new SimpleSpace(10, 3), new SimpleSpace(10, 1)};
+    for (int k = 0; k < 3; ++k) {
+        mixed[k]->set_gravity_solver(GRAVITY_SOLVER_SYMMETRIC);
+        mixed[k]->set_gravity_precision((k < 2) ? GRAVITY_PRECISION_MIXED : GRAVITY_PRECISION_DOUBLE);
+        for (int i = 0; i < 300; ++i) {
+            Vector2d pos(-7e7 + (i % 30) * 4.5e6, -4e7 + (i / 30) * 8e6);
+            mixed[k]->add_planet(Planet(pos, Vector2d(), 1e24 * (1 + i % 7), 1e5));
+        }
+    }
+    for (int i = 0; i < 100; ++i) {
+        for (int k = 0; k < 3; ++k)
+            mixed[k]->move_one_step();
+    }
+
+    identical = true;
+    double max_rel_diff = 0;
+    for (size_t i = 0; i < mixed[0]->planets.size(); ++i) {
+        const Planet& a = mixed[0]->planets[i];
+        const Planet& b = mixed[1]->planets[i];
+        const Planet& ref = mixed[2]->planets[i];
+        if ((a.pos.x != b.pos.x) || (a.pos.y != b.pos.y))
+            identical = false;
+        // Velocity is gained from gravity only, so compare it relatively
+        double ref_vel = Physics::Hypotenuse(ref.vel.x, ref.vel.y);
+        max_rel_diff = std::max(max_rel_diff, Physics::DistFromPos(a.vel, ref.vel) / ref_vel);
+    }
+    printf("max relative velocity difference from double: %g\n", max_rel_diff);
+    CHECK(identical);
+    CHECK(max_rel_diff < 1e-3);
+    for (int k = 0; k < 3; ++k)
+        delete mixed[k];
+    printf("Test Case 7: Finished\n");
+
+    // ==== Test Case 8 ====
+
+    printf("Test Case 8: Started (engine configs)\n");
+    {
+        // Gravity off: resting bodies stay in place
+        SpaceConfig no_gravity;
+        no_gravity.gravity_enabled = false;
+        SimpleSpace space(10, 1, no_gravity);
+        space.add_planet(Planet(Vector2d(-1e7, 0), Vector2d(), 1e30, 1e6));
+        space.add_planet(Planet(Vector2d( 1e7, 0), Vector2d(), 1e30, 1e6));
+        for (int i = 0; i < 10; ++i)
+            space.move_one_step();
+        CHECK(space.planets[0].pos == Vector2d(-1e7, 0));
+        CHECK(space.planets[1].pos == Vector2d( 1e7, 0));
+    }
+    {
+        // Borders off: body flies away; borders on: body bounces
+        SpaceConfig no_borders;
+        no_borders.gravity_enabled = false;
+        no_borders.borders_enabled = false;
+        SimpleSpace free_space(10, 1, no_borders);
+        free_space.add_planet(Planet(Vector2d(0, 0), Vector2d(1e10, 0), 1, 1e6));
+        free_space.move_one_step();
+        CHECK(free_space.planets[0].pos.x > no_borders.right_border);
+
+        SpaceConfig borders;
+        borders.gravity_enabled = false;
+        SimpleSpace box(10, 1, borders);
+        box.add_planet(Planet(Vector2d(0, 0), Vector2d(1e10, 0), 1, 1e6));
+        box.move_one_step();
+        CHECK(box.planets[0].pos.x <= borders.right_border);
+        CHECK(box.planets[0].vel.x < 0);
+    }
+    {
+        // External field pulls to top border
+        SpaceConfig field;
+        field.gravity_enabled = false;
+        field.global_top_mass = 1e30;
+        SimpleSpace space(10, 1, field);
+        space.add_planet(Planet(Vector2d(0, 0), Vector2d(), 1, 1e6));
+        space.move_one_step();
+        CHECK(space.planets[0].vel.y > 0);
+        CHECK(space.planets[0].vel.x == 0);
+    }
+    printf("Test Case 8: Finished\n");
+
+    // ==== Test Case 9 ====
+
+    printf("Test Case 9: Started (particle-mesh gravity)\n");
+    {
+        // Sun and probe far apart (in cells), mesh field must be close to Newtonian
+        const size_t count = 2;
+        double x[count] = {-3e7, 4e7};
+        double y[count] = {-1e7, 2e7};
+        double mass[count] = {1e30, 1};
+        double zeros[count] = {0, 0};
+        GravityBodies bodies;
+        bodies.count = count;
+        bodies.massive_count = count;
+        bodies.x = x;
+        bodies.y = y;
+        bodies.mass = mass;
+        bodies.rad = zeros;
+        bodies.soft = zeros;
+        bodies.softening = Physics::SOFTENING_NONE;
+        bodies.precision = GRAVITY_PRECISION_DOUBLE;
+
+        ScratchArena arena;
+        ScratchBuffer<CollisionPair> candidates(arena, 16);
+        Vector2d acc[3][count];
+        for (int k = 0; k < 3; ++k) {
+            WorkerPool pool((k == 1) ? 3 : 1);
+            PMGravitySolver pm(pool, (k == 2) ? 128 : 256);
+            pm.set_domain(-8e7, -5e7, 8e7, 5e7);
+            pm.compute(bodies, acc[k], 0, candidates);
+        }
+
+        double dist = Physics::DistFromPos(x[0], y[0], x[1], y[1]);
+        double expected = Physics::GravAcc(mass[0], dist);
+        double got = Physics::Hypotenuse(acc[0][1].x, acc[0][1].y);
+        double cos_angle = (acc[0][1].x * (x[0] - x[1]) + acc[0][1].y * (y[0] - y[1])) / (got * dist);
+        printf("probe acceleration: %g (expected %g), coarse mesh: %g\n",
+               got, expected, Physics::Hypotenuse(acc[2][1].x, acc[2][1].y));
+        CHECK(fabs(got / expected - 1) < 0.01);
+        CHECK(cos_angle > 0.9999);
+        CHECK((acc[0][1].x == acc[1][1].x) && (acc[0][1].y == acc[1][1].y)); // Same bits for 1 and 3 workers
+
+        // Through engine
+        SimpleSpace space(10, 2);
+        space.set_gravity_solver(GRAVITY_SOLVER_PM);
+        space.add_planet(Planet(Vector2d(x[0], y[0]), Vector2d(), mass[0], 1e6));
+        space.add_planet(Planet(Vector2d(x[1], y[1]), Vector2d(), mass[1], 1e6));
+        space.move_one_step();
+        CHECK(fabs(Physics::Hypotenuse(space.planets[1].vel.x, space.planets[1].vel.y) / (expected * 0.01) - 1) < 0.01);
+
+        // Solver collects no candidates: contacts are found by engine broad phase
+        SimpleSpace colliding(10, 2);
+        colliding.set_gravity_solver(GRAVITY_SOLVER_PM);
+        colliding.add_planet(Planet(Vector2d(-0.9e6, 0), Vector2d( 1e6, 0), 1e20, 1e6));
+        colliding.add_planet(Planet(Vector2d( 0.9e6, 0), Vector2d(-1e6, 0), 1e20, 1e6));
+        colliding.move_one_step();
+        CHECK((colliding.planets[0].vel.x < 0) && (colliding.planets[1].vel.x > 0));
+    }
+    printf("Test Case 9: Finished\n");
+
+    // ==== Test Case 10 ====
+
+    printf("Test Case 10: Started (merge collisions)\n");
+    {
+        SpaceConfig merge;
+        merge.gravity_enabled = false;
+        merge.collision_mode = COLLISION_MODE_MERGE;
+        SimpleSpace space(10, 1, merge);
+        // Three overlapping bodies merge into one, far one stays
+        space.add_planet(Planet(Vector2d(0, 0),     Vector2d(1e5, 0),  3e24, 1e6));
+        space.add_planet(Planet(Vector2d(1.5e6, 0), Vector2d(-1e5, 0), 1e24, 1e6));
+        space.add_planet(Planet(Vector2d(0, 1.5e6), Vector2d(0, 2e5),  2e24, 1e6));
+        space.add_planet(Planet(Vector2d(3e7, 0),   Vector2d(),        1e24, 1e6));
+        // add_planet() moves overlapping bodies apart, so bring them together by positions
+        space.planets[1].pos = Vector2d(1.5e6, 0);
+        space.planets[2].pos = Vector2d(0, 1.5e6);
+        unsigned int heaviest_id = space.planets[0].id;
+
+        double px = 0, py = 0, mass = 0;
+        Vector2d center;
+        for (size_t i = 0; i < 3; ++i) {
+            px += space.planets[i].vel.x * space.planets[i].mass_kg;
+            py += space.planets[i].vel.y * space.planets[i].mass_kg;
+            center.x += space.planets[i].pos.x * space.planets[i].mass_kg;
+            center.y += space.planets[i].pos.y * space.planets[i].mass_kg;
+            mass += space.planets[i].mass_kg;
+        }
+        space.move_one_step();
+
+        CHECK(space.planets.size() == 2);
+        const Planet& merged = space.planets[0];
+        CHECK(merged.id == heaviest_id);
+        CHECK(merged.mass_kg == mass);
+        CHECK(fabs(merged.vel.x * merged.mass_kg - px) < 1e-6 * fabs(mass * 1e5));
+        CHECK(fabs(merged.vel.y * merged.mass_kg - py) < 1e-6 * fabs(mass * 1e5));
+        CHECK(fabs(merged.rad_m - cbrt(3.0) * 1e6) < 1);
+        // Step beginning position is center of mass too
+        CHECK(Physics::DistFromPos(merged.prev_pos, Vector2d(center.x / mass, center.y / mass)) < 1);
+    }
+    printf("Test Case 10: Finished\n");
+
+    // ==== Test Case 11 ====
+
+    printf("Test Case 11: Started (parallel collisions resolution)\n");
+    {
+        SpaceConfig pile;
+        pile.gravity_enabled = false;
+        SimpleSpace* piles[2] = {new SimpleSpace(10, 1, pile), new SimpleSpace(10, 3, pile)};
+        for (int k = 0; k < 2; ++k) {
+            for (int i = 0; i < 900; ++i)
+                piles[k]->add_planet(Planet(Vector2d(), Vector2d((i % 7) * 1e5, (i % 5) * 1e5), 1e24 * (1 + i % 3), 1e6));
+            // Every body overlaps its neighbours
+            for (int i = 0; i < 900; ++i)
+                piles[k]->planets[i].pos = Vector2d(-2.8e7 + (i % 30) * 1.9e6, -4.8e7 + (i / 30) * 1.9e6);
+        }
+        for (int i = 0; i < 20; ++i) {
+            for (int k = 0; k < 2; ++k)
+                piles[k]->move_one_step();
+        }
+        bool same = true;
+        for (size_t i = 0; i < piles[0]->planets.size(); ++i) {
+            const Planet& a = piles[0]->planets[i];
+            const Planet& b = piles[1]->planets[i];
+            same = same && (a.pos == b.pos) && (a.vel == b.vel);
+        }
+        CHECK(same); // Same bits for 1 and 3 workers
+        for (int k = 0; k < 2; ++k)
+            delete piles[k];
+    }
+    printf("Test Case 11: Finished\n");
+
+    // ==== Test Case 12 ====
+
+    printf("Test Case 12: Started (sleeping bodies)\n");
+    {
+        // Bodies fall to bottom border under external field, settle and fall asleep
+        SpaceConfig settle;
+        settle.gravity_enabled = false;
+        settle.global_right_mass = 0;
+        settle.global_top_mass = -1e31; // Pushes down
+        settle.sleep_enabled = true;
+        settle.coef_res = 0.3;
+        settle.border_friction = 0.3;
+        SimpleSpace space(10, 1, settle);
+        for (int i = 0; i < 10; ++i)
+            space.add_planet(Planet(Vector2d(-5e7 + i * 1e7, -4.8e7), Vector2d(1e5 * (i % 3), 0), 1e24, 1e6));
+        for (int i = 0; i < 2000; ++i)
+            space.move_one_step();
+        size_t asleep = 0;
+        for (size_t i = 0; i < space.planets.size(); ++i)
+            asleep += space.planets[i].sleeping ? 1 : 0;
+        printf("sleeping bodies: %lu of %lu\n", (unsigned long)asleep, (unsigned long)space.planets.size());
+        CHECK(asleep == space.planets.size());
+
+        // Sleeping body doesn't move
+        Vector2d rest_pos = space.planets[0].pos;
+        space.move_one_step();
+        CHECK(space.planets[0].pos == rest_pos);
+
+        // Contact with awake body wakes it up
+        space.add_planet(Planet(Vector2d(rest_pos.x, rest_pos.y + 5e6), Vector2d(0, -5e8), 1e24, 1e6));
+        for (int i = 0; i < 5; ++i)
+            space.move_one_step();
+        CHECK(!space.planets[0].sleeping);
+
+        // With gravity: sleeping bodies are sources only between force checks, yet force
+        // change still wakes them (by next check) and falling body still hits them
+        const GravitySolverType solvers[] = {GRAVITY_SOLVER_REFERENCE, GRAVITY_SOLVER_SYMMETRIC, GRAVITY_SOLVER_TILED};
+        for (size_t s = 0; s < 3; ++s) {
+            settle.gravity_enabled = true;
+            SimpleSpace pile(10, 2, settle);
+            pile.set_gravity_solver(solvers[s]);
+            for (int i = 0; i < 10; ++i)
+                pile.add_planet(Planet(Vector2d(-5e7 + i * 1e7, -4.8e7), Vector2d(1e5 * (i % 3), 0), 1e10, 1e6));
+            for (int i = 0; i < 2000; ++i)
+                pile.move_one_step();
+            asleep = 0;
+            for (size_t i = 0; i < pile.planets.size(); ++i)
+                asleep += pile.planets[i].sleeping ? 1 : 0;
+            CHECK(asleep == pile.planets.size());
+
+            Vector2d hit_pos = pile.planets[0].pos;
+            pile.add_planet(Planet(Vector2d(hit_pos.x, hit_pos.y + 5e6), Vector2d(0, -5e8), 1e10, 1e6));
+            for (int i = 0; i < 5; ++i)
+                pile.move_one_step();
+            CHECK(!pile.planets[0].sleeping);
+            CHECK(pile.planets[5].sleeping);
+
+            pile.add_planet(Planet(Vector2d(0, 3e7), Vector2d(), 1e30, 1e6));
+            for (int i = 0; i < SLEEP_FORCE_CHECK_INTERVAL; ++i)
+                pile.move_one_step();
+            CHECK(!pile.planets[5].sleeping);
+        }
+    }
+    printf("Test Case 12: Finished\n");
+
+    // ==== Test Case 13 ====
+
+    printf("Test Case 13: Started (test particles)\n");
+    {
+        // Star and companion are massive, rings of light bodies are test particles
+        SimpleSpace* spaces[3] = {new SimpleSpace(10, 1), new SimpleSpace(10, 1), new SimpleSpace(10, 3)};
+        spaces[1]->set_gravity_solver(GRAVITY_SOLVER_SYMMETRIC);
+        spaces[2]->set_gravity_solver(GRAVITY_SOLVER_SYMMETRIC);
+        for (int k = 0; k < 3; ++k) {
+            spaces[k]->add_planet(Planet(Vector2d(), Vector2d(), 1e30, 3e6));
+            spaces[k]->add_planet(Planet(Vector2d(0, 4.5e7), Vector2d(1e6, 0), 1e29, 2e6));
+            for (int i = 0; i < 600; ++i) {
+                double r = 1e7 + (i % 6) * 3e6;
+                double angle = 2 * M_PI * (i / 6) / 100.0;
+                double v = sqrt(CONST_G * 1e30 / r);
+                Planet pl(Vector2d(r * cos(angle), r * sin(angle)), Vector2d(-v * sin(angle), v * cos(angle)), 1e15, 1e5);
+                pl.test_particle = true;
+                spaces[k]->add_planet(pl);
+            }
+        }
+        for (int i = 0; i < 20; ++i) {
+            for (int k = 0; k < 3; ++k)
+                spaces[k]->move_one_step();
+        }
+
+        // Star is moved by companion only
+        SimpleSpace pair_space(10, 1);
+        pair_space.set_gravity_solver(GRAVITY_SOLVER_SYMMETRIC);
+        pair_space.add_planet(Planet(Vector2d(), Vector2d(), 1e30, 3e6));
+        pair_space.add_planet(Planet(Vector2d(0, 4.5e7), Vector2d(1e6, 0), 1e29, 2e6));
+        for (int i = 0; i < 20; ++i)
+            pair_space.move_one_step();
+        CHECK(spaces[1]->planets[0].pos == pair_space.planets[0].pos);
+        CHECK(spaces[1]->planets[1].pos == pair_space.planets[1].pos);
+
+        // Stream kernel agrees with reference solver, same bits for 1 and 3 workers
+        double max_error = 0;
+        bool same = true;
+        for (size_t i = 0; i < spaces[0]->planets.size(); ++i) {
+            const Planet& ref = spaces[0]->planets[i];
+            double error = Physics::DistFromPos(ref.pos, spaces[1]->planets[i].pos) /
+                           Physics::DistFromPos(ref.prev_pos, ref.pos); // Relative to step shift
+            max_error = std::max(max_error, error);
+            same = same && (spaces[1]->planets[i].pos == spaces[2]->planets[i].pos) &&
+                           (spaces[1]->planets[i].vel == spaces[2]->planets[i].vel);
+        }
+        printf("max relative deviation from reference: %g\n", max_error);
+        CHECK(max_error < 1e-9);
+        CHECK(same);
+        for (int k = 0; k < 3; ++k)
+            delete spaces[k];
+
+        // Reference solver collides test particles with massive bodies and with each other
+        SimpleSpace colliding(10, 1);
+        const Vector2d starts[4] = {Vector2d(0, 0), Vector2d(1.8e6, 0), Vector2d(0, 2e7), Vector2d(1.8e6, 2e7)};
+        for (int i = 0; i < 4; ++i) {
+            Planet pl(Vector2d(starts[i].x * 10, starts[i].y), Vector2d((i % 2) ? -1e5 : 1e5, 0), 1e20, 1e6);
+            pl.test_particle = (i > 0);
+            colliding.add_planet(pl);
+        }
+        // First step finds contacts by all pairs (collision skin isn't known yet), so bodies
+        // are brought together after it
+        colliding.move_one_step();
+        for (int i = 0; i < 4; ++i)
+            colliding.planets[i].pos = starts[i];
+        colliding.move_one_step();
+        CHECK((colliding.planets[0].vel.x < 0) && (colliding.planets[1].vel.x > 0)); // Massive and test particle
+        CHECK((colliding.planets[2].vel.x < 0) && (colliding.planets[3].vel.x > 0)); // Two test particles
+    }
+    printf("Test Case 13: Finished\n");
+
+    // ==== Test Case 14 ====
+
+    printf("Test Case 14: Started (particle belt)\n");
+    {
+        // Odd count leaves scalar tail after SIMD pairs; one particle is in star center
+        const size_t count = 10001;
+        std::vector<Vector2d> pos(count), vel(count);
+        for (size_t i = 1; i < count; ++i) {
+            double r = 2e7 + (i % 100) * 1e5;
+            double angle = 2 * M_PI * (i / 100) / 100.0;
+            double v = sqrt(CONST_G * 1e30 / r);
+            pos[i] = Vector2d(r * cos(angle), r * sin(angle));
+            vel[i] = Vector2d(-v * sin(angle), v * cos(angle));
+        }
+        SimpleSpace* spaces[2] = {new SimpleSpace(10, 1), new SimpleSpace(10, 3)};
+        for (int k = 0; k < 2; ++k) {
+            spaces[k]->add_planet(Planet(Vector2d(), Vector2d(), 1e30, 3e6));
+            spaces[k]->add_belt_particles(pos, vel);
+        }
+        CHECK(spaces[0]->get_belt_particles_count() == count);
+        std::shared_ptr<const std::vector<float> > added_points = spaces[0]->get_snapshot()->belt_points;
+        for (int i = 0; i < 100; ++i) {
+            for (int k = 0; k < 2; ++k)
+                spaces[k]->move_one_step();
+        }
+
+        // Nothing has drawn belt, so steps didn't convert it and snapshots share points of edit
+        CHECK(spaces[0]->get_snapshot()->belt_points == added_points);
+        CHECK(spaces[0]->get_snapshot()->belt_count == count);
+
+        // Orbits stay circular, star is not attracted, same bits for 1 and 3 workers
+        std::vector<float> points[2];
+        for (int k = 0; k < 2; ++k)
+            spaces[k]->get_belt_points(points[k]);
+        CHECK(points[0] != *added_points);
+        double max_error = 0;
+        for (size_t i = 1; i < count; ++i) {
+            double r0 = Physics::DistFromPos(Vector2d(), pos[i]);
+            double r = Physics::DistFromPos(Vector2d(), Vector2d(points[0][2 * i], points[0][2 * i + 1]));
+            max_error = std::max(max_error, fabs(r / r0 - 1));
+        }
+        printf("max orbit radius change: %g\n", max_error);
+        CHECK(max_error < 1e-3);
+        CHECK((points[0][0] == 0) && (points[0][1] == 0));
+        CHECK(spaces[0]->planets[0].pos == Vector2d());
+        CHECK(points[0] == points[1]);
+
+        spaces[0]->remove_all_objects();
+        CHECK(spaces[0]->get_belt_particles_count() == 0);
+        for (int k = 0; k < 2; ++k)
+            delete spaces[k];
+    }
+    printf("Test Case 14: Finished\n");
+
+    // ==== Test Case 15 ====
+
+    printf("Test Case 15: Started (tiled gravity solver)\n");
+    {
+        // Odd count: several targets blocks and scalar tail; last bodies are test particles
+        const size_t count = 2501;
+        std::vector<double> x(count), y(count), mass(count), rad(count), soft(count);
+        for (size_t i = 0; i < count; ++i) {
+            x[i] = 4e7 * cos(i * 0.37) * ((i % 97) / 97.0);
+            y[i] = 4e7 * sin(i * 0.37) * ((i % 89) / 89.0);
+            mass[i] = 1e24 * (1 + i % 5);
+            rad[i] = 1e5 * (1 + i % 3);
+            soft[i] = (i % 7 == 0) ? 2e5 : 0;
+        }
+        x[1] = x[0]; // Coinciding pair
+        y[1] = y[0];
+        GravityBodies bodies;
+        bodies.count = count;
+        bodies.massive_count = count - 300;
+        bodies.x = x.data();
+        bodies.y = y.data();
+        bodies.mass = mass.data();
+        bodies.rad = rad.data();
+        bodies.soft = soft.data();
+        bodies.precision = GRAVITY_PRECISION_DOUBLE;
+
+        const Physics::SofteningType types[3] = {Physics::SOFTENING_NONE, Physics::SOFTENING_PLUMMER, Physics::SOFTENING_SPLINE};
+        for (int t = 0; t < 3; ++t) {
+            bodies.softening = types[t];
+            std::vector<Vector2d> acc[3];
+            ScratchArena arena;
+            ScratchBuffer<CollisionPair> candidates[3] = {ScratchBuffer<CollisionPair>(arena, 64),
+                                                          ScratchBuffer<CollisionPair>(arena, 64),
+                                                          ScratchBuffer<CollisionPair>(arena, 64)};
+            for (int k = 0; k < 3; ++k) {
+                WorkerPool pool((k == 2) ? 3 : 1);
+                std::unique_ptr<GravitySolver> solver((k == 0) ? static_cast<GravitySolver*>(new SymmetricGravitySolver(pool))
+                                                               : static_cast<GravitySolver*>(new TiledGravitySolver(pool)));
+                acc[k].resize(count);
+                solver->compute(bodies, acc[k].data(), 1e6, candidates[k]);
+            }
+
+            double max_error = 0;
+            for (size_t i = 0; i < count; ++i) {
+                double error = Physics::DistFromPos(acc[0][i], acc[1][i]) / Physics::DistFromPos(Vector2d(), acc[0][i]);
+                max_error = std::max(max_error, error);
+            }
+            printf("softening %d: max relative deviation from symmetric solver: %g\n", t, max_error);
+            CHECK(max_error < 1e-10);
+            CHECK(std::equal(acc[1].begin(), acc[1].end(), acc[2].begin())); // Same bits for 1 and 3 workers
+            CHECK(candidates[1].size() == candidates[0].size());
+            bool same_candidates = (candidates[1].size() == candidates[2].size());
+            for (size_t k = 0; same_candidates && (k < candidates[1].size()); ++k) {
+                same_candidates = (candidates[1][k].a == candidates[0][k].a) && (candidates[1][k].b == candidates[0][k].b) &&
+                                  (candidates[1][k].a == candidates[2][k].a) && (candidates[1][k].b == candidates[2][k].b);
+            }
+            CHECK(same_candidates);
+        }
+    }
+    printf("Test Case 15: Finished\n");
+
+    // ==== Test Case 16 ====
+
+    printf("Test Case 16: Started (Morton reordering)\n");
+    {
+        // Bodies on grid, added in scattered order
+        SpaceConfig still;
+        still.gravity_enabled = false;
+        SimpleSpace space(10, 1, still);
+        const unsigned int side = 40;
+        for (unsigned int k = 0; k < side * side; ++k) {
+            unsigned int cell = (k * 613) % (side * side);
+            space.add_planet(Planet(Vector2d(-7e7 + (cell % side) * 3.5e6, -4.5e7 + (cell / side) * 2.3e6), Vector2d(), 1e20, 1e5));
+        }
+        const Vector2d tracked_pos = space.planets[100].pos;
+        const unsigned int tracked_id = space.planets[100].id;
+
+        for (int i = 0; i < LOCALITY_CHECK_INTERVAL; ++i)
+            space.move_one_step();
+        CHECK(space.get_reorders_count() == 1);
+        // Storage is local now: neighbours in memory are close in space
+        double mean_step = 0;
+        for (size_t i = 1; i < space.planets.size(); ++i)
+            mean_step += Physics::DistFromPos(space.planets[i - 1].pos, space.planets[i].pos);
+        mean_step /= space.planets.size() - 1;
+        printf("mean distance between neighbours in memory: %g m\n", mean_step);
+        CHECK(mean_step < 1e7);
+
+        // Ordered storage is not reordered again
+        for (int i = 0; i < LOCALITY_CHECK_INTERVAL; ++i)
+            space.move_one_step();
+        CHECK(space.get_reorders_count() == 1);
+
+        // Ids still address the same bodies
+        CHECK(space.find_planet_by_click(tracked_pos).second == tracked_id);
+        Planet moved(Vector2d(1e3, 1e3), Vector2d(), 1e20, 1e5, Color_RGB(), tracked_id);
+        space.post_modify_planet(moved);
+        space.apply_pending_commands();
+        CHECK(space.find_planet_by_click(Vector2d(1e3, 1e3)).second == tracked_id);
+        space.remove_planet(tracked_id);
+        CHECK(space.planets.size() == side * side - 1);
+        CHECK(!space.find_planet_by_click(Vector2d(1e3, 1e3)).first);
+    }
+    {
+        // Bodies gone to infinity or NaN don't spoil grid of the rest
+        SpaceConfig free;
+        free.gravity_enabled = false;
+        free.borders_enabled = false;
+        SimpleSpace space(10, 1, free);
+        const unsigned int side = 40;
+        for (unsigned int k = 0; k < side * side; ++k) {
+            unsigned int cell = (k * 613) % (side * side);
+            space.add_planet(Planet(Vector2d(-7e7 + (cell % side) * 3.5e6, -4.5e7 + (cell / side) * 2.3e6), Vector2d(), 1e20, 1e5));
+        }
+        space.planets[0].pos.x = std::numeric_limits<double>::infinity();
+        space.planets[1].pos.y = -std::numeric_limits<double>::infinity();
+        space.planets[2].pos.x = std::numeric_limits<double>::quiet_NaN();
+
+        for (int i = 0; i < LOCALITY_CHECK_INTERVAL; ++i)
+            space.move_one_step();
+        CHECK(space.get_reorders_count() == 1);
+        double mean_step = 0;
+        size_t steps = 0;
+        for (size_t i = 1; i < space.planets.size(); ++i) {
+            double step = Physics::DistFromPos(space.planets[i - 1].pos, space.planets[i].pos);
+            if (std::isfinite(step)) {
+                mean_step += step;
+                ++steps;
+            }
+        }
+        mean_step /= steps;
+        CHECK(steps >= side * side - 7);
+        CHECK(mean_step < 1e7);
+    }
+    printf("Test Case 16: Finished\n");
+
+    // ==== Test Case 17 ====
+
+    printf("Test Case 17: Started (Scene generator)\n");
+    {
+        // Same scene from 1 and 3 workers, every kind
+        const SceneKind kinds[] = {SCENE_DISK, SCENE_PLUMMER, SCENE_BELT, SCENE_RANDOM_FIELD};
+        for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); ++k) {
+            SceneParams params;
+            params.kind = kinds[k];
+            params.count = 3 * SCENE_CHUNK_SIZE + 17;
+            params.seed = 42;
+            std::vector<Planet> single(params.count);
+            std::vector<Planet> multi(params.count);
+            {
+                WorkerPool pool(1);
+                generate_scene(pool, params, single.data(), 100);
+            }
+            {
+                WorkerPool pool(3);
+                generate_scene(pool, params, multi.data(), 100);
+            }
+            bool same = true;
+            bool in_bounds = true;
+            for (size_t i = 0; i < params.count; ++i) {
+                same = same && single[i].id == multi[i].id &&
+                       single[i].pos.x == multi[i].pos.x && single[i].pos.y == multi[i].pos.y &&
+                       single[i].vel.x == multi[i].vel.x && single[i].vel.y == multi[i].vel.y;
+                double r = Physics::DistFromPos(single[i].pos, params.center);
+                if (kinds[k] == SCENE_DISK || kinds[k] == SCENE_BELT)
+                    in_bounds = in_bounds && r >= params.inner_rad_m * (1 - 1e-12) && r <= params.outer_rad_m * (1 + 1e-12);
+                else if (kinds[k] == SCENE_RANDOM_FIELD)
+                    in_bounds = in_bounds && single[i].pos.x >= params.left && single[i].pos.x < params.right &&
+                                single[i].pos.y >= params.bottom && single[i].pos.y < params.top;
+            }
+            CHECK(same);
+            CHECK(in_bounds);
+            CHECK(single[0].id == 100 && single[params.count - 1].id == 100 + params.count - 1);
+        }
+
+        // Other seed, other scene
+        SceneParams params;
+        Planet a = generate_scene_body(params, 5);
+        params.seed = 2;
+        Planet b = generate_scene_body(params, 5);
+        CHECK(a.pos.x != b.pos.x);
+
+        // Million bodies right into space, then particles
+        SimpleSpace space(10, 1);
+        params.count = 1 << 20;
+        wTime start, end;
+        wTimeNow(&start);
+        space.add_scene(params);
+        wTimeNow(&end);
+        printf("generated %lu bodies in %lu ms\n", space.get_planets_count(), wTimeDiffMs(&start, &end));
+        CHECK(space.get_planets_count() == params.count);
+        CHECK(space.planets[params.count - 1].id == params.count - 1);
+        space.add_scene_particles(params);
+        CHECK(space.get_belt_particles_count() == params.count);
+    }
+    printf("Test Case 17: Finished\n");
+
+    // ==== Test Case 18 ====
+
+    printf("Test Case 18: Started (Scene file)\n");
+    {
+        const char* path = "test_scene.ssc";
+        SimpleSpace space(10, 1);
+        SceneParams params;
+        params.count = 20000;
+        space.add_scene(params);
+        params.kind = SCENE_BELT;
+        params.count = 5000;
+        params.test_particles = true;
+        space.add_scene(params);
+        space.add_scene_particles(params);
+        space.remove_planet(7); // Ids with gap
+        CHECK(space.save_scene(path) == SCENE_FILE_OK);
+
+        // Everything is restored exactly
+        SimpleSpace loaded(10, 3);
+        loaded.add_planet(Planet(Vector2d(), Vector2d(), 1e20, 1e5)); // Replaced by file
+        CHECK(loaded.load_scene(path) == SCENE_FILE_OK);
+        CHECK(loaded.planets.size() == space.planets.size());
+        bool same = loaded.planets.size() == space.planets.size();
+        for (size_t i = 0; same && i < space.planets.size(); ++i) {
+            const Planet& a = space.planets[i];
+            const Planet& b = loaded.planets[i];
+            same = a.id == b.id && a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.vel.x == b.vel.x && a.vel.y == b.vel.y &&
+                   a.mass_kg == b.mass_kg && a.rad_m == b.rad_m && a.softening_m == b.softening_m &&
+                   a.color.R == b.color.R && a.color.G == b.color.G && a.color.B == b.color.B &&
+                   a.test_particle == b.test_particle;
+        }
+        CHECK(same);
+        std::vector<float> loaded_points, space_points;
+        loaded.get_belt_points(loaded_points);
+        space.get_belt_points(space_points);
+        CHECK(loaded_points == space_points);
+        // Ids keep working, new ones don't collide
+        loaded.remove_planet(20001);
+        CHECK(loaded.planets.size() == space.planets.size() - 1);
+        loaded.add_planet(Planet(Vector2d(), Vector2d(), 1e20, 1e5));
+        CHECK(loaded.planets.back().id == 25000);
+
+        // Broken files are rejected, scene stays
+        std::vector<char> bytes;
+        FILE* file = fopen(path, "rb");
+        CHECK(file != NULL);
+        int c;
+        while (file && (c = fgetc(file)) != EOF)
+            bytes.push_back(static_cast<char>(c));
+        if (file)
+            fclose(file);
+
+        struct Broken {
+            size_t offset;
+            char flip;  // Xor-ed with byte at offset
+            size_t size;
+            SceneFileStatus status;
+        } broken[] = {
+            {0, 'X', bytes.size(), SCENE_FILE_BAD_FORMAT},                              // Magic
+            {8, 2, bytes.size(), SCENE_FILE_BAD_VERSION},                               // Version
+            {bytes.size() - 1000, 1, bytes.size(), SCENE_FILE_BAD_CHECKSUM},            // Data
+            {offsetof(SceneFileHeader, planets_count), 1, bytes.size(), SCENE_FILE_BAD_CHECKSUM}, // Header
+            {0, 0, bytes.size() / 2, SCENE_FILE_BAD_FORMAT}                             // Truncated
+        };
+        for (size_t k = 0; k < sizeof(broken) / sizeof(broken[0]); ++k) {
+            std::vector<char> copy(bytes.begin(), bytes.begin() + broken[k].size);
+            copy[broken[k].offset] ^= broken[k].flip;
+            file = fopen(path, "wb");
+            fwrite(copy.data(), 1, copy.size(), file);
+            fclose(file);
+            CHECK(loaded.load_scene(path) == broken[k].status);
+        }
+        CHECK(loaded.planets.size() == space.planets.size());
+        CHECK(loaded.load_scene("no_such_dir/scene.ssc") == SCENE_FILE_IO_ERROR);
+
+        // Well-formed files with duplicate or out of range ids are rejected too
+        SimpleSpace bad_ids(10, 1);
+        for (int i = 0; i < 3; ++i)
+            bad_ids.add_planet(Planet(Vector2d(i * 1e7, 0), Vector2d(), 1e20, 1e5));
+        bad_ids.planets[2].id = bad_ids.planets[0].id;
+        CHECK(bad_ids.save_scene(path) == SCENE_FILE_OK);
+        CHECK(loaded.load_scene(path) == SCENE_FILE_BAD_FORMAT);
+        bad_ids.planets[2].id = 0xFFFFFFFF;
+        CHECK(bad_ids.save_scene(path) == SCENE_FILE_OK);
+        CHECK(loaded.load_scene(path) == SCENE_FILE_BAD_FORMAT);
+        CHECK(loaded.planets.size() == space.planets.size());
+        remove(path);
+    }
+    printf("Test Case 18: Finished\n");
+
+    // ==== Test Case 19 ====
+
+    printf("Test Case 19: Started (Checkpoints)\n");
+    {
+        SpaceConfig config;
+        config.sleep_enabled = true;
+        SimpleSpace space(10, 2, config);
+        space.set_gravity_solver(GRAVITY_SOLVER_SYMMETRIC);
+        SceneParams params;
+        params.count = 2000;
+        space.add_planet(Planet(Vector2d(), Vector2d(), params.central_mass_kg, 3e6));
+        space.add_scene(params);
+        params.kind = SCENE_BELT;
+        params.count = 1000;
+        space.add_scene_particles(params);
+
+        CheckpointConfig checkpoints;
+        checkpoints.interval_steps = 20;
+        checkpoints.retention = 2;
+        checkpoints.prefix = "test_checkpoint";
+        space.set_checkpoints(checkpoints);
+        for (int k = 0; k < 7; ++k) {
+            for (int i = 0; i < 20; ++i)
+                space.move_one_step();
+            space.wait_checkpoints(); // Every writer finishes, none is skipped
+        }
+        CheckpointStats stats = space.get_checkpoint_stats();
+        CHECK(stats.started == 7 && stats.written == 7 && stats.failed == 0 && stats.skipped == 0);
+        CHECK(stats.last_path == "test_checkpoint_000000140.ssc");
+        // Only newest ones are kept
+        FILE* file = fopen("test_checkpoint_000000100.ssc", "rb");
+        CHECK(file == NULL);
+        if (file)
+            fclose(file);
+
+        // Resumed run repeats original one bit by bit (Morton check at step 128 included)
+        SimpleSpace resumed(10, 2);
+        CHECK(resumed.load_scene("test_checkpoint_000000120.ssc") == SCENE_FILE_OK);
+        CHECK(resumed.get_steps_count() == 0);
+        CHECK(resumed.restore_checkpoint("test_checkpoint_000000120.ssc") == SCENE_FILE_OK);
+        CHECK(resumed.get_steps_count() == 120);
+        CHECK(resumed.get_gravity_solver() == GRAVITY_SOLVER_SYMMETRIC && resumed.get_config().sleep_enabled);
+        for (int i = 0; i < 20; ++i)
+            resumed.move_one_step();
+        bool same = resumed.planets.size() == space.planets.size();
+        for (size_t i = 0; same && i < space.planets.size(); ++i) {
+            const Planet& a = space.planets[i];
+            const Planet& b = resumed.planets[i];
+            same = a.id == b.id && a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.vel.x == b.vel.x && a.vel.y == b.vel.y &&
+                   a.mass_kg == b.mass_kg && a.sleeping == b.sleeping;
+        }
+        CHECK(same);
+        std::vector<float> resumed_points, space_points;
+        resumed.get_belt_points(resumed_points);
+        space.get_belt_points(space_points);
+        CHECK(resumed_points == space_points);
+
+        // Out of range enums in engine state are rejected before anything is applied
+        SceneEngineState engine;
+        {
+            SceneFile checkpoint;
+            CHECK(checkpoint.open("test_checkpoint_000000140.ssc") == SCENE_FILE_OK);
+            engine = *checkpoint.engine_state();
+        }
+        const size_t enums[] = {offsetof(SceneEngineState, collision_mode), offsetof(SceneEngineState, gravity_solver),
+                                offsetof(SceneEngineState, gravity_precision), offsetof(SceneEngineState, softening_type)};
+        for (size_t k = 0; k < sizeof(enums) / sizeof(enums[0]); ++k) {
+            SceneEngineState bad = engine;
+            reinterpret_cast<uint8_t*>(&bad)[enums[k]] = 200;
+            CHECK(write_scene_file("test_checkpoint_bad.ssc", std::vector<Planet>(), ParticleBelt(), &bad) == SCENE_FILE_OK);
+            CHECK(resumed.restore_checkpoint("test_checkpoint_bad.ssc") == SCENE_FILE_BAD_FORMAT);
+            CHECK(resumed.planets.size() == space.planets.size());
+            CHECK(resumed.get_gravity_solver() == GRAVITY_SOLVER_SYMMETRIC);
+        }
+        remove("test_checkpoint_bad.ssc");
+
+        // Scene without engine state can be loaded, but not restored
+        CHECK(write_scene_file("test_checkpoint_plain.ssc", space.planets, ParticleBelt()) == SCENE_FILE_OK);
+        CHECK(resumed.restore_checkpoint("test_checkpoint_plain.ssc") == SCENE_FILE_BAD_FORMAT);
+        CHECK(resumed.load_scene("test_checkpoint_plain.ssc") == SCENE_FILE_OK);
+        remove("test_checkpoint_plain.ssc");
+        remove("test_checkpoint_000000120.ssc");
+        remove("test_checkpoint_000000140.ssc");
+    }
+    printf("Test Case 19: Finished\n");
+
+    // ==== Test Case 20 ====
+    // Recorded trajectory is decoded to recorded positions and velocities within half a quantum
+    printf("Test Case 20: Started (Trajectory recording)\n");
+    {
+        SimpleSpace space(10, 2);
+        SceneParams params;
+        params.count = 300;
+        space.add_planet(Planet(Vector2d(), Vector2d(), params.central_mass_kg, 3e6));
+        space.add_scene(params);
+
+        TrajectoryConfig config;
+        config.interval_steps = 2;
+        config.fields = TRAJECTORY_FIELD_VELOCITY;
+        config.ring_frames = 2;
+        config.policy = TRAJECTORY_BLOCK;
+        CHECK(space.start_recording("test_trajectory.sst", config));
+
+        std::vector<TrajectoryFrame> expected;
+        for (int i = 0; i < 150; ++i) {
+            if (i == 40)
+                space.remove_planet(space.planets[5].id);
+            if (i == 70)
+                space.add_planet(Planet(Vector2d(1e8, 1e8), Vector2d(10, -10), 1e20, 1e6));
+            space.move_one_step();
+            if (space.get_steps_count() % config.interval_steps == 0) {
+                TrajectoryFrame frame;
+                frame.step = space.get_steps_count();
+                for (size_t j = 0; j < space.planets.size(); ++j) {
+                    frame.id.push_back(space.planets[j].id);
+                    frame.x.push_back(space.planets[j].pos.x);
+                    frame.y.push_back(space.planets[j].pos.y);
+                    frame.vx.push_back(space.planets[j].vel.x);
+                    frame.vy.push_back(space.planets[j].vel.y);
+                }
+                expected.push_back(frame);
+            }
+        }
+        space.stop_recording();
+
+        TrajectoryStats stats = space.get_recording_stats();
+        CHECK(stats.frames_captured == 75 && stats.frames_written == 75 && stats.frames_dropped == 0);
+        CHECK(stats.blocks_written == 2 && !stats.failed);
+#if TRAJECTORY_ZLIB
+        CHECK(stats.bytes_stored < stats.bytes_encoded);
+#endif
+        printf("Trajectory: %lu frames, %llu bytes encoded, %llu bytes stored, writer busy %lu ms of %lu ms\n",
+               stats.frames_written, (unsigned long long)stats.bytes_encoded, (unsigned long long)stats.bytes_stored,
+               stats.writer_busy_ms, stats.elapsed_ms);
+
+        TrajectoryReader reader;
+        CHECK(reader.open("test_trajectory.sst"));
+        TrajectoryFrame frame;
+        size_t frames = 0;
+        bool same = true;
+        while (reader.next_frame(frame)) {
+            if (frames >= expected.size()) {
+                same = false;
+                break;
+            }
+            const TrajectoryFrame& ref = expected[frames++];
+            same = same && frame.step == ref.step && frame.id == ref.id && frame.vx.size() == ref.id.size();
+            for (size_t j = 0; same && j < ref.id.size(); ++j) {
+                same = std::fabs(frame.x[j] - ref.x[j]) <= config.pos_quantum_m / 2 + 1e-6 &&
+                       std::fabs(frame.y[j] - ref.y[j]) <= config.pos_quantum_m / 2 + 1e-6 &&
+                       std::fabs(frame.vx[j] - ref.vx[j]) <= config.vel_quantum / 2 + 1e-6 &&
+                       std::fabs(frame.vy[j] - ref.vy[j]) <= config.vel_quantum / 2 + 1e-6;
+            }
+        }
+        CHECK(same && frames == expected.size());
+        reader.close();
+
+        // Dropping policy never stalls steps; every due frame is either captured or dropped
+        config.ring_frames = 1;
+        config.policy = TRAJECTORY_DROP;
+        CHECK(space.start_recording("test_trajectory.sst", config));
+        for (int i = 0; i < 100; ++i)
+            space.move_one_step();
+        space.stop_recording();
+        stats = space.get_recording_stats();
+        CHECK(stats.frames_captured + stats.frames_dropped == 50 && stats.steps_blocked == 0);
+        CHECK(stats.frames_written == stats.frames_captured);
+        CHECK(reader.open("test_trajectory.sst"));
+        frames = 0;
+        while (reader.next_frame(frame))
+            ++frames;
+        CHECK(frames == stats.frames_captured);
+        reader.close();
+        remove("test_trajectory.sst");
+    }
+    printf("Test Case 20: Finished\n");
+
+    // ==== Test Case 21 ====
+    // Replay at any step gives the same frame as sequential decoding
+    printf("Test Case 21: Started (Trajectory replay)\n");
+    {
+        SimpleSpace space(10, 2);
+        SceneParams params;
+        params.count = 200;
+        space.add_planet(Planet(Vector2d(), Vector2d(), params.central_mass_kg, 3e6));
+        space.add_scene(params);
+        TrajectoryConfig config;
+        CHECK(space.start_recording("test_replay.sst", config));
+        for (int i = 0; i < 300; ++i)
+            space.move_one_step();
+        space.stop_recording();
+
+        std::vector<TrajectoryFrame> expected;
+        TrajectoryReader reader;
+        CHECK(reader.open("test_replay.sst"));
+        CHECK(reader.blocks_count() == 5 && reader.frames_count() == 300);
+        CHECK(reader.first_step() == 1 && reader.last_step() == 300);
+        CHECK(reader.find_block(0) == 0 && reader.find_block(65) == 1 && reader.find_block(1000) == 4);
+        TrajectoryFrame frame;
+        while (reader.next_frame(frame))
+            expected.push_back(frame);
+        CHECK(expected.size() == 300);
+        reader.close();
+
+        TrajectoryPlayer player;
+        CHECK(player.open("test_replay.sst"));
+        CHECK(player.first_step() == 1 && player.last_step() == 300 && player.frames_count() == 300);
+        bool same = true;
+        unsigned int calls = 0;
+        uint64_t step = 1;
+        for (int i = 0; i < 600 && same; ++i, ++calls) {
+            // Playback with random jumps
+            step = (i % 50 == 0) ? (step * 7919 + 13) % 320 : step + 1;
+            std::shared_ptr<const ReplayBlock> holder;
+            const TrajectoryFrame* found = player.frame_at(step, holder);
+            const TrajectoryFrame& ref = expected[(step == 0) ? 0 : std::min<uint64_t>(step, 300) - 1];
+            same = found && found->step == ref.step && found->id == ref.id && found->x == ref.x && found->y == ref.y;
+        }
+        CHECK(same);
+        ReplayStats stats = player.stats();
+        CHECK(stats.hits + stats.misses == calls && stats.misses <= 5 + stats.hits);
+        printf("Replay: %lu hits, %lu misses, %lu blocks prefetched\n", stats.hits, stats.misses, stats.prefetched);
+        player.close();
+
+        // Interrupted recording is played up to last complete block
+        FILE* src = fopen("test_replay.sst", "rb");
+        FILE* dst = fopen("test_replay_cut.sst", "wb");
+        CHECK(src && dst);
+        if (src && dst) {
+            std::vector<char> data(1 << 20);
+            size_t size = fread(data.data(), 1, data.size(), src);
+            fwrite(data.data(), 1, size - 10, dst);
+        }
+        if (src)
+            fclose(src);
+        if (dst)
+            fclose(dst);
+        CHECK(reader.open("test_replay_cut.sst"));
+        CHECK(reader.blocks_count() == 4 && reader.frames_count() == 256 && reader.last_step() == 256);
+        size_t frames = 0;
+        while (reader.next_frame(frame))
+            ++frames;
+        CHECK(frames == 256);
+        reader.close();
+        remove("test_replay_cut.sst");
+
+        // Version 1 file (block headers without last step) reads the same
+        std::vector<char> data;
+        src = fopen("test_replay.sst", "rb");
+        int c;
+        while (src && (c = fgetc(src)) != EOF)
+            data.push_back(static_cast<char>(c));
+        if (src)
+            fclose(src);
+        TrajectoryFileHeader file_header;
+        memcpy(&file_header, data.data(), sizeof(file_header));
+        file_header.version = 1;
+        std::vector<char> v1(reinterpret_cast<char*>(&file_header), reinterpret_cast<char*>(&file_header) + sizeof(file_header));
+        for (size_t offset = sizeof(file_header); offset < data.size(); ) {
+            TrajectoryBlockHeader block;
+            memcpy(&block, &data[offset], sizeof(block));
+            offset += sizeof(block);
+            const uint64_t fields[] = {block.first_step, block.raw_size, block.stored_size, block.checksum};
+            v1.insert(v1.end(), reinterpret_cast<char*>(&block.method), reinterpret_cast<char*>(&block.first_step));
+            v1.insert(v1.end(), reinterpret_cast<const char*>(fields), reinterpret_cast<const char*>(fields + 4));
+            v1.insert(v1.end(), data.begin() + offset, data.begin() + offset + block.stored_size);
+            offset += block.stored_size;
+        }
+        dst = fopen("test_replay_v1.sst", "wb");
+        CHECK(dst != NULL);
+        if (dst) {
+            fwrite(v1.data(), 1, v1.size(), dst);
+            fclose(dst);
+        }
+        CHECK(reader.open("test_replay_v1.sst"));
+        CHECK(reader.blocks_count() == 5 && reader.frames_count() == 300);
+        CHECK(reader.first_step() == 1 && reader.last_step() == 300 && reader.block_info(1).last_step == 128);
+        std::vector<TrajectoryFrame> last_block;
+        CHECK(reader.read_block_frames(4, last_block) && last_block.back().step == 300);
+        CHECK(reader.seek_block(0));
+        same = true;
+        for (size_t i = 0; same && i < expected.size(); ++i)
+            same = reader.next_frame(frame) && frame.step == expected[i].step && frame.id == expected[i].id &&
+                   frame.x == expected[i].x && frame.y == expected[i].y;
+        CHECK(same);
+        reader.close();
+        remove("test_replay_v1.sst");
+        remove("test_replay.sst");
+    }
+    printf("Test Case 21: Finished\n");
+
+    // ==== Test Case 22 ====
+    // Session replayed from input journal ends in exactly the same state
+    printf("Test Case 22: Started (Input journal)\n");
+    {
+        SpaceConfig config;
+        config.sleep_enabled = true;
+        SimpleSpace space(10, 2, config);
+        SceneParams params;
+        params.count = 300;
+        space.add_planet(Planet(Vector2d(), Vector2d(), params.central_mass_kg, 3e6));
+        space.add_scene(params);
+        for (int i = 0; i < 50; ++i)
+            space.move_one_step(); // Journal starts mid-session
+        CHECK(space.start_journal("test_journal.ssj") == JOURNAL_OK);
+
+        for (int i = 0; i < 700; ++i) {
+            if (i == 20)
+                space.post_add_planet(Planet(Vector2d(2e7, 0), Vector2d(0, 1e6), 1e22, 5e5, Color_RGB(1, 0, 0)));
+            if (i == 60)
+                space.remove_planet(space.planets[7].id);
+            if (i == 90) {
+                Planet pl = space.planets[3];
+                pl.vel = Vector2d(pl.vel.x * 0.5, pl.vel.y * 0.5);
+                space.post_modify_planet(pl);
+            }
+            if (i == 150)
+                space.set_gravity_solver(GRAVITY_SOLVER_SYMMETRIC);
+            if (i == 200) {
+                SceneParams belt_params;
+                belt_params.kind = SCENE_BELT;
+                belt_params.count = 2000;
+                space.add_scene_particles(belt_params);
+                space.journal_front_end_event(JOURNAL_MODEL_SPEED, 10);
+            }
+            if (i == 300) {
+                space.journal_front_end_event(JOURNAL_PAUSE);
+                CHECK(space.save_scene("test_journal_scene.ssc") == SCENE_FILE_OK);
+                space.remove_belt_particles();
+                space.journal_front_end_event(JOURNAL_RESUME);
+            }
+            if (i == 400)
+                CHECK(space.load_scene("test_journal_scene.ssc") == SCENE_FILE_OK);
+            if (i == 500) {
+                params.kind = SCENE_RANDOM_FIELD;
+                params.count = 50;
+                params.seed = 3;
+                space.add_scene(params);
+            }
+            space.move_one_step();
+        }
+        space.stop_journal();
+        remove("test_journal_scene.ssc"); // Replay uses its copy
+
+        SimpleSpace replayed(10, 2);
+        JournalReplayStats stats;
+        CHECK(replayed.replay_journal("test_journal.ssj", ULONG_MAX, &stats) == JOURNAL_OK);
+        CHECK(stats.checks == 2 && stats.diverged_step == 0);
+        CHECK(replayed.get_steps_count() == space.get_steps_count());
+        bool same = replayed.planets.size() == space.planets.size();
+        for (size_t i = 0; same && i < space.planets.size(); ++i) {
+            const Planet& a = space.planets[i];
+            const Planet& b = replayed.planets[i];
+            same = a.id == b.id && a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.vel.x == b.vel.x && a.vel.y == b.vel.y;
+        }
+        CHECK(same);
+        std::vector<float> replayed_points, space_points;
+        replayed.get_belt_points(replayed_points);
+        space.get_belt_points(space_points);
+        CHECK(replayed_points == space_points);
+        CHECK(replayed.get_gravity_solver() == GRAVITY_SOLVER_SYMMETRIC);
+
+        FILE* file = fopen("test_journal.ssj", "rb");
+        if (file) {
+            fseek(file, 0, SEEK_END);
+            printf("Journal: %ld bytes for %lu events of %lu steps\n", ftell(file), stats.events, space.get_steps_count() - 50);
+            fclose(file);
+        }
+
+        // Partial replay, e.g. to look at state just before a bug
+        SimpleSpace partial(10, 2);
+        CHECK(partial.replay_journal("test_journal.ssj", 350) == JOURNAL_OK);
+        CHECK(partial.get_steps_count() == 350 && partial.get_belt_particles_count() == 0);
+
+        // Results don't depend on workers number
+        SimpleSpace other(10, 1);
+        CHECK(other.replay_journal("test_journal.ssj") == JOURNAL_OK);
+        CHECK(journal_state_hash(other.planets, ParticleBelt()) == journal_state_hash(space.planets, ParticleBelt()));
+
+        // Hash covers state next step depends on, besides positions and velocities
+        std::vector<Planet> changed = space.planets;
+        const uint64_t hash = journal_state_hash(changed, ParticleBelt());
+        const uint64_t hash_v1 = journal_state_hash(changed, ParticleBelt(), 1);
+        changed[0].prev_pos.x += 1;
+        CHECK(journal_state_hash(changed, ParticleBelt()) != hash);
+        CHECK(journal_state_hash(changed, ParticleBelt(), 1) == hash_v1);
+        changed = space.planets;
+        changed[0].sleeping = !changed[0].sleeping;
+        CHECK(journal_state_hash(changed, ParticleBelt()) != hash);
+        changed = space.planets;
+        ++changed[0].rest_steps;
+        CHECK(journal_state_hash(changed, ParticleBelt()) != hash);
+        ParticleBelt belt;
+        belt.add(Vector2d(1e7, 0), Vector2d(0, 1e3));
+        const uint64_t belt_hash = journal_state_hash(changed, belt);
+        belt.vy()[0] += 1;
+        CHECK(journal_state_hash(changed, belt) != belt_hash);
+
+        remove("test_journal.ssj");
+        remove("test_journal.ssj.0.ssc");
+        remove("test_journal.ssj.1.ssc");
+    }
+    printf("Test Case 22: Finished\n");
+
+    printf("Test Case 23: Started (Undo history)\n");
+    {
+        // Chunks before first changed planet are shared with previous state
+        std::vector<Planet> bodies(2 * UNDO_CHUNK_PLANETS + 100);
+        for (size_t i = 0; i < bodies.size(); ++i)
+            bodies[i].id = static_cast<unsigned int>(i);
+        ParticleBelt belt;
+        belt.add(Vector2d(1, 2), Vector2d(3, 4));
+        UndoHistory history;
+        std::shared_ptr<const UndoState> first = history.capture(bodies, 0, belt, true);
+        bodies[UNDO_CHUNK_PLANETS + 5].mass_kg = 42;
+        std::shared_ptr<const UndoState> second = history.capture(bodies, UNDO_CHUNK_PLANETS + 5, belt, false);
+        CHECK(first->chunks.size() == 3 && second->chunks.size() == 3);
+        CHECK(first->chunks[0] == second->chunks[0]);
+        CHECK(first->chunks[1] != second->chunks[1] && first->chunks[2] != second->chunks[2]);
+        CHECK(first->belt == second->belt);
+        history.push(first);
+        history.push(second);
+        CHECK(history.bytes() == (bodies.size() + UNDO_CHUNK_PLANETS + 100) * sizeof(Planet) + 4 * sizeof(double));
+
+        std::vector<Planet> restored;
+        ParticleBelt restored_belt;
+        UndoHistory::restore(*first, restored, restored_belt);
+        CHECK(restored.size() == bodies.size() && restored[UNDO_CHUNK_PLANETS + 5].mass_kg != 42);
+        CHECK(restored.back().id == bodies.back().id && restored_belt.size() == 1 && restored_belt.vy()[0] == 4);
+    }
+    {
+        SimpleSpace space(10, 2);
+        SceneParams params;
+        params.count = 3000;
+        space.add_scene(params);
+        SceneParams belt_params;
+        belt_params.kind = SCENE_BELT;
+        belt_params.count = 500;
+        space.add_scene_particles(belt_params);
+        for (int i = 0; i < 5; ++i)
+            space.move_one_step();
+        const std::vector<Planet> before = space.planets;
+        std::vector<float> before_belt;
+        space.get_belt_points(before_belt);
+        CHECK(!space.can_undo() && !space.undo());
+
+        // Accidental clear is undone exactly
+        space.save_undo_point();
+        space.post_remove_all_objects();
+        space.apply_pending_commands();
+        CHECK(space.planets.empty() && space.can_undo());
+        CHECK(space.undo());
+        bool same = space.planets.size() == before.size();
+        for (size_t i = 0; same && i < before.size(); ++i)
+            same = space.planets[i].id == before[i].id && space.planets[i].pos.x == before[i].pos.x &&
+                   space.planets[i].pos.y == before[i].pos.y && space.planets[i].vel.x == before[i].vel.x &&
+                   space.planets[i].vel.y == before[i].vel.y && space.planets[i].mass_kg == before[i].mass_kg;
+        CHECK(same);
+        std::vector<float> undone_belt;
+        space.get_belt_points(undone_belt);
+        CHECK(undone_belt == before_belt);
+        CHECK(space.can_redo() && space.redo() && space.planets.empty());
+        CHECK(space.undo() && space.planets.size() == before.size());
+
+        // Restored bodies are found by id, and steps after undo point are undone too
+        space.save_undo_point();
+        CHECK(!space.can_redo());
+        for (int i = 0; i < 5; ++i)
+            space.move_one_step();
+        space.remove_planet(before[10].id);
+        CHECK(space.planets.size() == before.size() - 1);
+        CHECK(space.undo());
+        CHECK(space.planets.size() == before.size() && space.planets[10].pos.x == before[10].pos.x);
+        space.remove_planet(before[10].id);
+        CHECK(space.planets.size() == before.size() - 1);
+
+        // Direct change of planets (in first chunk of undo state, while engine's change
+        // is in another one) is captured once lookup by id notices it
+        {
+            SimpleSpace big(10, 2);
+            SceneParams big_params;
+            big_params.count = UNDO_CHUNK_PLANETS + 1000;
+            big.add_scene(big_params);
+            big.save_undo_point();
+            std::swap(big.planets[0], big.planets[UNDO_CHUNK_PLANETS + 500]);
+            const unsigned int moved_id = big.planets[UNDO_CHUNK_PLANETS + 500].id;
+            const unsigned int front_id = big.planets[0].id;
+            big.remove_planet(moved_id);
+            big.save_undo_point();
+            CHECK(big.undo() && big.planets[0].id == front_id);
+        }
+
+        // Journal has undo and redo of states saved while recording as events, older
+        // states as scene copies; replay ends in the same state
+        const unsigned int front_id = space.planets[0].id;
+        space.save_undo_point();
+        CHECK(space.start_journal("test_undo_journal.ssj") == JOURNAL_OK);
+        space.save_undo_point();
+        for (int i = 0; i < 5; ++i)
+            space.move_one_step();
+        space.remove_planet(front_id);
+        CHECK(space.undo() && space.redo() && space.undo());
+        CHECK(space.undo()); // Saved before journal
+        for (int i = 0; i < 5; ++i)
+            space.move_one_step();
+        CHECK(space.redo()); // Captured when restoring older state, replay doesn't have it either
+        for (int i = 0; i < 5; ++i)
+            space.move_one_step();
+        space.stop_journal();
+        FILE* copy = fopen("test_undo_journal.ssj.1.ssc", "rb");
+        CHECK(copy != NULL);
+        if (copy)
+            fclose(copy);
+        copy = fopen("test_undo_journal.ssj.3.ssc", "rb");
+        CHECK(copy == NULL);
+        SimpleSpace replayed(10, 2);
+        CHECK(replayed.replay_journal("test_undo_journal.ssj") == JOURNAL_OK);
+        CHECK(journal_state_hash(replayed.planets, ParticleBelt()) == journal_state_hash(space.planets, ParticleBelt()));
+        // Replay's history has states of journaled events, same ones as recorded session
+        CHECK(replayed.redo() && space.redo());
+        CHECK(journal_state_hash(replayed.planets, ParticleBelt()) == journal_state_hash(space.planets, ParticleBelt()));
+        remove("test_undo_journal.ssj");
+        for (int k = 0; k < 3; ++k) {
+            std::string path = JournalWriter::scene_copy_path("test_undo_journal.ssj", k);
+            remove(path.c_str());
+        }
+    }
+    printf("Test Case 23: Finished\n");
+
+    printf("Test Case 24: Started (Same results with any workers number)\n");
+    {
+        // Big enough for Morton reordering (check after LOCALITY_CHECK_INTERVAL steps) and
+        // many tiles of fused sweeps
+        const GravitySolverType solvers[] = {GRAVITY_SOLVER_REFERENCE, GRAVITY_SOLVER_SYMMETRIC,
+                                             GRAVITY_SOLVER_SYMMETRIC, GRAVITY_SOLVER_TILED, GRAVITY_SOLVER_PM};
+        const unsigned int workers[] = {1, 3, 8};
+        const int steps = LOCALITY_CHECK_INTERVAL + 1;
+        for (size_t s = 0; s < sizeof(solvers) / sizeof(solvers[0]); ++s) {
+            uint64_t hashes[3];
+            std::vector<float> belt_points[3];
+            SpaceDiagnostics diagnostics[3];
+            for (size_t w = 0; w < 3; ++w) {
+                SpaceConfig config;
+                config.sleep_enabled = true;
+                if (s == 0)
+                    config.collision_mode = COLLISION_MODE_MERGE;
+                SimpleSpace space(10, workers[w], config);
+                space.set_gravity_solver(solvers[s]);
+                if (s == 2)
+                    space.set_gravity_precision(GRAVITY_PRECISION_MIXED);
+                space.set_diagnostics_interval(LOCALITY_CHECK_INTERVAL);
+                SceneParams params;
+                params.kind = SCENE_PLUMMER;
+                params.count = MORTON_REORDER_MIN_BODIES + 100;
+                params.body_rad_m = 2e4; // Few merges, so bodies stay over MORTON_REORDER_MIN_BODIES
+                space.add_scene(params);
+                params.test_particles = true;
+                params.count = 200;
+                params.seed = 2;
+                space.add_scene(params);
+                SceneParams belt_params;
+                belt_params.kind = SCENE_BELT;
+                belt_params.count = 500;
+                space.add_scene_particles(belt_params);
+                CHECK(space.planets.size() > 16 * FUSED_TILE_SIZE);
+                for (int i = 0; i < steps; ++i)
+                    space.move_one_step();
+                CHECK(space.get_reorders_count() == 1);
+                hashes[w] = journal_state_hash(space.planets, ParticleBelt());
+                space.get_belt_points(belt_points[w]);
+                diagnostics[w] = space.get_snapshot()->diagnostics;
+                CHECK(diagnostics[w].valid && (diagnostics[w].step == static_cast<unsigned long>(steps - 1)));
+            }
+            CHECK(hashes[0] == hashes[1] && hashes[0] == hashes[2]);
+            CHECK(belt_points[0] == belt_points[1] && belt_points[0] == belt_points[2]);
+            for (size_t w = 1; w < 3; ++w) {
+                CHECK(diagnostics[w].kinetic_j == diagnostics[0].kinetic_j);
+                CHECK(diagnostics[w].potential_j == diagnostics[0].potential_j);
+                CHECK(diagnostics[w].momentum.x == diagnostics[0].momentum.x);
+                CHECK(diagnostics[w].momentum.y == diagnostics[0].momentum.y);
+                CHECK(diagnostics[w].angular_momentum == diagnostics[0].angular_momentum);
+            }
+        }
+    }
+    printf("Test Case 24: Finished\n");
+
+    printf("Test Case 25: Started (Energy, momentum and angular momentum diagnostics)\n");
+    {
+        // Potential kernels match force ones: -d(InvDist)/dr = r * InvDist3
+        const Physics::SofteningType softenings[] = {Physics::SOFTENING_NONE, Physics::SOFTENING_PLUMMER, Physics::SOFTENING_SPLINE};
+        const double eps = 1e6;
+        for (size_t s = 0; s < 3; ++s) {
+            for (double r = 1e5; r < 4e6; r *= 1.7) {
+                const double dr = r * 1e-6;
+                const double derivative = (Physics::SoftenedInvDist((r - dr) * (r - dr), eps, softenings[s]) -
+                                           Physics::SoftenedInvDist((r + dr) * (r + dr), eps, softenings[s])) / (2 * dr);
+                const double expected = r * Physics::SoftenedInvDist3(r * r, eps, softenings[s]);
+                CHECK(std::fabs(derivative - expected) < 1e-6 * expected);
+            }
+        }
+
+        // Potential of every solver computing it matches the reference one
+        const GravitySolverType solvers[] = {GRAVITY_SOLVER_REFERENCE, GRAVITY_SOLVER_SYMMETRIC,
+                                             GRAVITY_SOLVER_SYMMETRIC, GRAVITY_SOLVER_TILED, GRAVITY_SOLVER_PM};
+        SpaceDiagnostics measured[5];
+        for (size_t s = 0; s < 5; ++s) {
+            SimpleSpace space(10);
+            space.set_gravity_solver(solvers[s]);
+            if (s == 2)
+                space.set_gravity_precision(GRAVITY_PRECISION_MIXED);
+            space.set_softening(Physics::SOFTENING_PLUMMER, 1e5);
+            space.set_diagnostics_interval(1);
+            SceneParams params;
+            params.kind = SCENE_PLUMMER;
+            params.count = 300;
+            space.add_scene(params);
+            params.test_particles = true;
+            params.count = 200;
+            params.seed = 2;
+            space.add_scene(params);
+            space.move_one_step();
+            measured[s] = space.get_snapshot()->diagnostics;
+            CHECK(measured[s].valid && (measured[s].step == 0) && (measured[s].bodies == 500));
+        }
+        CHECK(measured[0].potential_valid && (measured[0].potential_j < 0));
+        CHECK(std::fabs(measured[1].potential_j - measured[0].potential_j) < 1e-9 * std::fabs(measured[0].potential_j));
+        CHECK(std::fabs(measured[2].potential_j - measured[0].potential_j) < 1e-4 * std::fabs(measured[0].potential_j));
+        CHECK(std::fabs(measured[3].potential_j - measured[0].potential_j) < 1e-9 * std::fabs(measured[0].potential_j));
+        CHECK(!measured[4].potential_valid);
+        for (size_t s = 1; s < 5; ++s)
+            CHECK(measured[s].kinetic_j == measured[0].kinetic_j);
+
+        // Two bodies orbiting each other: momentum is conserved, energy and angular momentum
+        // errors are the integrator ones, so they halve with time step
+        double drift[2], angular_change[2];
+        for (int t = 0; t < 2; ++t) {
+            SpaceConfig config;
+            config.borders_enabled = false;
+            SimpleSpace space(10 >> t, 2, config);
+            space.set_gravity_solver(GRAVITY_SOLVER_SYMMETRIC);
+            space.set_diagnostics_interval(10);
+            const double v = sqrt(CONST_G * 1.1e30 / 1e7);
+            space.add_planet(Planet(Vector2d(0, 0), Vector2d(0, -v / 11), 1e30, 3e6));
+            space.add_planet(Planet(Vector2d(1e7, 0), Vector2d(0, v * 10 / 11), 1e29, 1e6));
+            space.move_one_step();
+            const SpaceDiagnostics first = space.get_snapshot()->diagnostics;
+            for (int i = 0; i < (1000 << t); ++i)
+                space.move_one_step();
+            const SpaceDiagnostics last = space.get_snapshot()->diagnostics;
+            CHECK(first.valid && (first.step == 0) && (last.step == (1000u << t)));
+            CHECK(first.potential_j < 0 && first.total_j() < 0);
+            CHECK(std::fabs(last.momentum.x - first.momentum.x) < 1e-9 * 1e29 * v);
+            CHECK(std::fabs(last.momentum.y - first.momentum.y) < 1e-9 * 1e29 * v);
+            CHECK(last.collision_loss_j == 0);
+            drift[t] = std::fabs(last.drift());
+            angular_change[t] = std::fabs(last.angular_momentum / first.angular_momentum - 1);
+        }
+        CHECK(drift[0] < 2e-2 && drift[1] < 0.6 * drift[0]);
+        CHECK(angular_change[0] < 2e-2 && angular_change[1] < 0.6 * angular_change[0]);
+
+        // Collisions: what bounces and merges take is counted, so energy balance holds
+        const CollisionMode modes[] = {COLLISION_MODE_BOUNCE, COLLISION_MODE_MERGE};
+        for (size_t m = 0; m < 2; ++m) {
+            SpaceConfig config;
+            config.gravity_enabled = false;
+            config.borders_enabled = false;
+            config.coef_res = 0.5;
+            config.collision_mode = modes[m];
+            SimpleSpace space(10, 2, config);
+            space.set_diagnostics_interval(5);
+            space.add_planet(Planet(Vector2d(-5e6, 0), Vector2d( 1e8, 0), 2e29, 2e6));
+            space.add_planet(Planet(Vector2d( 5e6, 0), Vector2d(-1e8, 0), 1e29, 2e6));
+            for (int i = 0; i < 21; ++i)
+                space.move_one_step();
+            const SpaceDiagnostics last = space.get_snapshot()->diagnostics;
+            CHECK(last.step == 20);
+            CHECK(last.collision_loss_j > 0.1 * last.initial_j);
+            CHECK(std::fabs(last.drift()) < 1e-9);
+            CHECK(std::fabs(last.momentum.x - 1e29 * 1e8) < 1e-9 * 1e29 * 1e8);
+        }
+
+        // Same diagnostics with any workers number, same steps with diagnostics on or off
+        SpaceDiagnostics by_workers[2];
+        uint64_t hashes[3];
+        const unsigned int workers[] = {1, 3, 3};
+        for (size_t w = 0; w < 3; ++w) {
+            SpaceConfig config;
+            config.coef_res = 0.9;
+            SimpleSpace space(10, workers[w], config);
+            space.set_gravity_solver(GRAVITY_SOLVER_TILED);
+            if (w < 2)
+                space.set_diagnostics_interval(4);
+            SceneParams params;
+            params.kind = SCENE_PLUMMER;
+            params.count = 1000;
+            space.add_scene(params);
+            params.test_particles = true;
+            params.seed = 3;
+            space.add_scene(params);
+            for (int i = 0; i < 30; ++i)
+                space.move_one_step();
+            if (w < 2)
+                by_workers[w] = space.get_snapshot()->diagnostics;
+            hashes[w] = journal_state_hash(space.planets, ParticleBelt());
+        }
+        CHECK(by_workers[0].step == 28);
+        CHECK(by_workers[0].kinetic_j == by_workers[1].kinetic_j);
+        CHECK(by_workers[0].potential_j == by_workers[1].potential_j);
+        CHECK(by_workers[0].momentum.x == by_workers[1].momentum.x && by_workers[0].momentum.y == by_workers[1].momentum.y);
+        CHECK(by_workers[0].angular_momentum == by_workers[1].angular_momentum);
+        CHECK(by_workers[0].collision_loss_j == by_workers[1].collision_loss_j);
+        CHECK(hashes[0] == hashes[1] && hashes[0] == hashes[2]);
+    }
+    printf("Test Case 25: Finished\n");
+
+    printf("Failures: %d\n", failures);
+
+    logsDeinit();
+    wTimeDeinit();
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}